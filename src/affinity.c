@@ -0,0 +1,167 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "affinity.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <errno.h>
+#endif
+
+#if defined(_WIN32) || defined(_WIN64) || defined(_MSC_VER)
+#define ICH_WINDOWS
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define LOG_PREFIX "[affinity]"
+#include "logger.h"
+
+size_t affinity_cpu_count(void) {
+#ifdef ICH_WINDOWS
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t)n : 1;
+#endif
+}
+
+void affinity_init(affinity* a) {
+    a->mode = AFFINITY_NONE;
+    a->node = -1;
+    memset(a->cpus,0,sizeof(a->cpus));
+}
+
+static int affinity_number(const strbuf* s, size_t* pos, unsigned int* val) {
+    size_t i = *pos;
+    unsigned int v = 0;
+
+    while(i < s->len && (s->x[i] == ' ' || s->x[i] == '\t')) i++;
+    if(i == s->len || s->x[i] < '0' || s->x[i] > '9') return -1;
+
+    while(i < s->len && s->x[i] >= '0' && s->x[i] <= '9') {
+        v = (v * 10) + (s->x[i] - '0');
+        if(v >= AFFINITY_MAX_CPUS) return -1;
+        i++;
+    }
+    while(i < s->len && (s->x[i] == ' ' || s->x[i] == '\t')) i++;
+
+    *pos = i;
+    *val = v;
+    return 0;
+}
+
+int affinity_parse_cpus(affinity* a, const strbuf* list) {
+    size_t pos = 0;
+    unsigned int first;
+    unsigned int last;
+    unsigned int cpu;
+
+    memset(a->cpus,0,sizeof(a->cpus));
+
+    while(pos < list->len) {
+        if(affinity_number(list,&pos,&first) != 0) return -1;
+        last = first;
+        if(pos < list->len && list->x[pos] == '-') {
+            pos++;
+            if(affinity_number(list,&pos,&last) != 0) return -1;
+            if(last < first) return -1;
+        }
+        for(cpu=first;cpu<=last;cpu++) {
+            a->cpus[cpu / 8] |= (uint8_t)(1 << (cpu % 8));
+        }
+        if(pos == list->len) break;
+        if(list->x[pos] != ',' && list->x[pos] != '\n') return -1;
+        pos++;
+    }
+
+    a->mode = AFFINITY_CPUS;
+    a->node = -1;
+    return 0;
+}
+
+int affinity_parse_node(affinity* a, const strbuf* node) {
+    int r = -1;
+    unsigned long n;
+    FILE* f = NULL;
+    char path[64];
+    char buf[4096];
+    strbuf list = STRBUF_ZERO;
+
+    if(node->len == 0 || node->x[0] < '0' || node->x[0] > '9') return -1;
+    n = strbuf_strtoul(node,10);
+
+    snprintf(path,sizeof(path),"/sys/devices/system/node/node%lu/cpulist",n);
+    if( (f = fopen(path,"r")) == NULL) {
+        fprintf(stderr,"[affinity] unable to find NUMA node %lu\n",n);
+        return -1;
+    }
+
+    if(fgets(buf,sizeof(buf),f) == NULL) goto cleanup;
+
+    list.x = (uint8_t*)buf;
+    list.len = strlen(buf);
+    while(list.len && (list.x[list.len-1] == '\n' || list.x[list.len-1] == ' ')) list.len--;
+
+    if(list.len == 0) {
+        fprintf(stderr,"[affinity] NUMA node %lu has no CPUs\n",n);
+        goto cleanup;
+    }
+
+    if( (r = affinity_parse_cpus(a,&list)) != 0) goto cleanup;
+    a->node = (int)n;
+
+    cleanup:
+    fclose(f);
+    return r;
+}
+
+int affinity_resolve(affinity* a, const affinity* source) {
+    if(a->mode != AFFINITY_AUTO) return 0;
+    /* an unpinned source can move between CPUs and nodes, so
+     * there's nothing to copy */
+    if(source->mode != AFFINITY_CPUS) return -1;
+    *a = *source;
+    return 0;
+}
+
+int affinity_apply(const affinity* a) {
+#if defined(__linux__)
+    unsigned int cpu;
+    cpu_set_t set;
+#endif
+
+    if(a->mode != AFFINITY_CPUS) return 0;
+
+#if defined(__linux__)
+    CPU_ZERO(&set);
+    for(cpu=0;cpu<AFFINITY_MAX_CPUS && cpu<CPU_SETSIZE;cpu++) {
+        if(a->cpus[cpu / 8] & (1 << (cpu % 8))) CPU_SET(cpu,&set);
+    }
+
+    if(sched_setaffinity(0,sizeof(set),&set) != 0) {
+        log_warn("unable to set CPU affinity: %s", strerror(errno));
+        return -1;
+    }
+
+    if(a->node != -1) {
+        log_debug("pinned to NUMA node %d",a->node);
+    } else {
+        logs_debug("pinned to CPU list");
+    }
+    return 0;
+#else
+    logs_warn("CPU affinity isn't supported on this platform");
+    return 0;
+#endif
+}
@@ -0,0 +1,68 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+/* CPU pinning for source/destination threads.
+ *
+ * An affinity is a set of CPUs, given either as a list
+ * ("0-3,8,10-11") or as a NUMA node, in which case we use
+ * every CPU on that node. A destination can also be set to
+ * "auto", which copies whatever its source is using so the
+ * source and its destinations share a node - the source needs
+ * an affinity of its own for that.
+ *
+ * Memory is placed on first touch, so pinning a source also
+ * places the frames it hands to its destinations, and pinning
+ * a destination places its filter/encoder/muxer buffers.
+ *
+ * Only implemented on Linux, elsewhere applying an affinity
+ * logs a warning and carries on. */
+
+#include "strbuf.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define AFFINITY_MAX_CPUS 1024
+
+enum affinity_mode {
+    AFFINITY_NONE = 0,
+    AFFINITY_CPUS = 1,
+    AFFINITY_AUTO = 2, /* use the source's affinity */
+};
+
+typedef enum affinity_mode affinity_mode;
+
+struct affinity {
+    affinity_mode mode;
+    int node; /* NUMA node the CPUs came from, or -1 */
+    uint8_t cpus[AFFINITY_MAX_CPUS / 8];
+};
+
+typedef struct affinity affinity;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* number of online CPUs */
+size_t affinity_cpu_count(void);
+
+void affinity_init(affinity*);
+
+/* parses a list like "0-3,8,10-11" */
+int affinity_parse_cpus(affinity*, const strbuf* list);
+
+/* looks up the CPUs on a NUMA node */
+int affinity_parse_node(affinity*, const strbuf* node);
+
+/* resolves an "auto" affinity against the source's affinity,
+ * returns an error if the source isn't pinned */
+int affinity_resolve(affinity*, const affinity* source);
+
+/* pins the calling thread */
+int affinity_apply(const affinity*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,245 @@
+#include "audio_fifo.h"
+
+#include <string.h>
+
+/* smallest ring we'll allocate, in samples */
+#define AUDIO_FIFO_MIN_CAPACITY 4096
+
+void audio_fifo_init(audio_fifo* f) {
+    frame_init(&f->ring);
+    frame_init(&f->view);
+    f->format = SAMPLEFMT_UNKNOWN;
+    f->channels = 0;
+    f->sample_rate = 0;
+    f->capacity = 0;
+    f->reserve = 0;
+    f->head = 0;
+    f->duration = 0;
+    f->pts = 0;
+}
+
+void audio_fifo_free(audio_fifo* f) {
+    frame_free(&f->ring);
+    frame_free(&f->view);
+    audio_fifo_init(f);
+}
+
+static inline size_t audio_fifo_planes(const audio_fifo* f) {
+    return samplefmt_is_planar(f->format) ? f->channels : 1;
+}
+
+/* bytes per sample within a plane */
+static inline size_t audio_fifo_unit(const audio_fifo* f) {
+    return samplefmt_size(f->format) * (samplefmt_is_planar(f->format) ? 1 : f->channels);
+}
+
+static inline uint8_t* audio_fifo_at(const audio_fifo* f, const frame* ring, size_t plane, size_t pos) {
+    return (uint8_t*)frame_get_channel_samples(ring, plane) + (pos * audio_fifo_unit(f));
+}
+
+int audio_fifo_open(audio_fifo* f, samplefmt format, unsigned int channels, unsigned int sample_rate) {
+    if(f->format != format || f->channels != channels) {
+        frame_free(&f->ring);
+        f->capacity = 0;
+        f->reserve = 0;
+    }
+
+    f->format = format;
+    f->channels = channels;
+    f->sample_rate = sample_rate;
+    audio_fifo_reset(f);
+
+    return channels == 0 ? -1 : 0;
+}
+
+void audio_fifo_reset(audio_fifo* f) {
+    f->head = 0;
+    f->duration = 0;
+}
+
+/* moves the queued samples into a new ring, starting at
+ * position 0 */
+static int audio_fifo_resize(audio_fifo* f, size_t capacity, size_t reserve) {
+    int r;
+    size_t i;
+    size_t first;
+    size_t mirror;
+    size_t unit;
+    frame ring;
+
+    frame_init(&ring);
+    ring.format = f->format;
+    ring.channels = f->channels;
+    ring.sample_rate = f->sample_rate;
+    ring.duration = (unsigned int)(capacity + reserve);
+
+    if( (r = frame_buffer(&ring)) != 0) {
+        frame_free(&ring);
+        return r;
+    }
+
+    if(f->duration > 0) {
+        unit = audio_fifo_unit(f);
+        first = f->capacity - f->head;
+        if(first > f->duration) first = f->duration;
+        mirror = f->duration < reserve ? f->duration : reserve;
+
+        for(i=0;i<audio_fifo_planes(f);i++) {
+            memcpy(audio_fifo_at(f, &ring, i, 0), audio_fifo_at(f, &f->ring, i, f->head), first * unit);
+            memcpy(audio_fifo_at(f, &ring, i, first), audio_fifo_at(f, &f->ring, i, 0), (f->duration - first) * unit);
+            memcpy(audio_fifo_at(f, &ring, i, capacity), audio_fifo_at(f, &ring, i, 0), mirror * unit);
+        }
+    }
+
+    frame_free(&f->ring);
+    f->ring = ring;
+    f->capacity = capacity;
+    f->reserve = reserve;
+    f->head = 0;
+    return 0;
+}
+
+/* writes count samples from src (starting at sample offset) to
+ * ring position pos, or silence if src is NULL. The write can't
+ * cross the end of the ring */
+static void audio_fifo_store(audio_fifo* f, size_t pos, const frame* src, size_t offset, size_t count) {
+    size_t i;
+    size_t mirror;
+    size_t unit;
+    size_t srcsize;
+    const uint8_t* s;
+    int src_planar, dest_planar;
+    const void* src_planes[SAMPLEFMT_INTERLEAVE_MAX_CHANNELS];
+    void* dest_planes[SAMPLEFMT_INTERLEAVE_MAX_CHANNELS];
+
+    unit = audio_fifo_unit(f);
+
+    if(src == NULL) {
+        for(i=0;i<audio_fifo_planes(f);i++) {
+            memset(audio_fifo_at(f, &f->ring, i, pos), 0, count * unit);
+        }
+    } else {
+        srcsize = samplefmt_size(src->format);
+        src_planar = samplefmt_is_planar(src->format);
+        dest_planar = samplefmt_is_planar(f->format);
+
+        if(src_planar && dest_planar) {
+            for(i=0;i<f->channels;i++) {
+                s = (const uint8_t*)frame_get_channel_samples(src, i) + (offset * srcsize);
+                samplefmt_convert(audio_fifo_at(f, &f->ring, i, pos), s, src->format, f->format, count, 1, 0, 1, 0);
+            }
+        } else if(!src_planar && !dest_planar) {
+            s = (const uint8_t*)frame_get_channel_samples(src, 0) + (offset * srcsize * f->channels);
+            samplefmt_convert(audio_fifo_at(f, &f->ring, 0, pos), s, src->format, f->format, count * f->channels, 1, 0, 1, 0);
+        } else if(f->channels <= SAMPLEFMT_INTERLEAVE_MAX_CHANNELS) {
+            if(!src_planar) {
+                s = (const uint8_t*)frame_get_channel_samples(src, 0) + (offset * srcsize * f->channels);
+                for(i=0;i<f->channels;i++) {
+                    dest_planes[i] = audio_fifo_at(f, &f->ring, i, pos);
+                }
+                samplefmt_deinterleave(dest_planes, s, src->format, f->format, count, f->channels);
+            } else {
+                for(i=0;i<f->channels;i++) {
+                    src_planes[i] = (const uint8_t*)frame_get_channel_samples(src, i) + (offset * srcsize);
+                }
+                samplefmt_interleave(audio_fifo_at(f, &f->ring, 0, pos), src_planes, src->format, f->format, count, f->channels);
+            }
+        } else if(!src_planar && dest_planar) {
+            s = (const uint8_t*)frame_get_channel_samples(src, 0) + (offset * srcsize * f->channels);
+            for(i=0;i<f->channels;i++) {
+                samplefmt_convert(audio_fifo_at(f, &f->ring, i, pos), s, src->format, f->format, count, f->channels, i, 1, 0);
+            }
+        } else {
+            for(i=0;i<f->channels;i++) {
+                s = (const uint8_t*)frame_get_channel_samples(src, i) + (offset * srcsize);
+                samplefmt_convert(audio_fifo_at(f, &f->ring, 0, pos), s, src->format, f->format, count, 1, 0, f->channels, i);
+            }
+        }
+    }
+
+    /* keep the mirror past the end of the ring up to date */
+    if(pos < f->reserve) {
+        mirror = f->reserve - pos;
+        if(mirror > count) mirror = count;
+        for(i=0;i<audio_fifo_planes(f);i++) {
+            memcpy(audio_fifo_at(f, &f->ring, i, f->capacity + pos), audio_fifo_at(f, &f->ring, i, pos), mirror * unit);
+        }
+    }
+}
+
+static int audio_fifo_push(audio_fifo* f, const frame* src, size_t len) {
+    int r;
+    size_t capacity;
+    size_t tail;
+    size_t first;
+
+    if(len == 0) return 0;
+
+    if(f->duration + len > f->capacity) {
+        capacity = f->capacity == 0 ? AUDIO_FIFO_MIN_CAPACITY : f->capacity;
+        while(capacity < f->duration + len) capacity *= 2;
+        if( (r = audio_fifo_resize(f, capacity, f->reserve)) != 0) return r;
+    }
+
+    tail = f->head + f->duration;
+    if(tail >= f->capacity) tail -= f->capacity;
+
+    first = f->capacity - tail;
+    if(first > len) first = len;
+
+    audio_fifo_store(f, tail, src, 0, first);
+    if(first < len) audio_fifo_store(f, 0, src, first, len - first);
+
+    f->duration += len;
+    return 0;
+}
+
+int audio_fifo_write(audio_fifo* f, const frame* src) {
+    if(src->channels != f->channels) return -1;
+    if(src->sample_rate != f->sample_rate) return -1;
+    return audio_fifo_push(f, src, src->duration);
+}
+
+int audio_fifo_fill(audio_fifo* f, unsigned int duration) {
+    if(duration <= f->duration) return 0;
+    return audio_fifo_push(f, NULL, duration - f->duration);
+}
+
+const frame* audio_fifo_peek(audio_fifo* f, unsigned int len) {
+    size_t i;
+    membuf* m;
+
+    if(len == 0 || len > f->duration) return NULL;
+
+    if(len > f->reserve) {
+        if(audio_fifo_resize(f, f->capacity, len) != 0) return NULL;
+    }
+
+    f->view.format = f->format;
+    f->view.channels = f->channels;
+    f->view.sample_rate = f->sample_rate;
+    f->view.duration = len;
+    f->view.pts = f->pts;
+
+    if(frame_ready(&f->view) != 0) return NULL;
+
+    for(i=0;i<audio_fifo_planes(f);i++) {
+        m = frame_get_channel(&f->view, i);
+        m->x = audio_fifo_at(f, &f->ring, i, f->head);
+        m->a = 0; /* owned by the ring */
+    }
+
+    return &f->view;
+}
+
+int audio_fifo_consume(audio_fifo* f, unsigned int len) {
+    if(len > f->duration) return -1;
+
+    f->head += len;
+    if(f->head >= f->capacity) f->head -= f->capacity;
+    f->duration -= len;
+    f->pts += len;
+    if(f->duration == 0) f->head = 0;
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef AUDIO_FIFO_H
+#define AUDIO_FIFO_H
+
+/* a queue of audio samples, for encoders that take input
+ * in fixed-size frames.
+ *
+ * Encoders used to collect samples with frame_append() and
+ * drop them with frame_trim(), which memmove()s everything
+ * left over to the front of the buffer for every frame encoded.
+ * Here the samples live in a ring instead, so consuming
+ * samples is just moving the read position.
+ *
+ * Encoders want to read a frame's worth of samples from one
+ * pointer though, so the first "reserve" samples of the ring
+ * are mirrored just past its end. Any read of up to reserve
+ * samples is contiguous no matter where in the ring it starts.
+ * Reserve grows to fit the largest read, so usually it's the
+ * encoder's frame length.
+ */
+
+#include "frame.h"
+#include "samplefmt.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct audio_fifo {
+    frame ring;           /* sample storage, capacity + reserve samples long */
+    frame view;           /* handed out by audio_fifo_peek */
+    samplefmt format;
+    unsigned int channels;
+    unsigned int sample_rate;
+    size_t capacity;      /* samples the ring can queue */
+    size_t reserve;       /* longest contiguous read */
+    size_t head;          /* read position */
+    unsigned int duration; /* samples queued */
+    uint64_t pts;         /* samples consumed so far */
+};
+
+typedef struct audio_fifo audio_fifo;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void audio_fifo_init(audio_fifo*);
+void audio_fifo_free(audio_fifo*);
+
+/* sets the format samples are stored in, and drops any queued samples */
+int audio_fifo_open(audio_fifo*, samplefmt format, unsigned int channels, unsigned int sample_rate);
+
+/* drops any queued samples */
+void audio_fifo_reset(audio_fifo*);
+
+/* queues a frame, converting it to the fifo's format */
+int audio_fifo_write(audio_fifo*, const frame*);
+
+/* pads the queue with silence up to duration samples */
+int audio_fifo_fill(audio_fifo*, unsigned int duration);
+
+/* returns a frame with the first len queued samples, without
+ * consuming them. The frame points into the fifo and is only
+ * valid until the next call that changes the fifo. Returns NULL
+ * if len is zero or more than what's queued, or on allocation failure */
+const frame* audio_fifo_peek(audio_fifo*, unsigned int len);
+
+/* drops len samples from the front of the queue */
+int audio_fifo_consume(audio_fifo*, unsigned int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,373 @@
+/* microbenchmarks for sample conversion and the frame operations
+ * used on every frame, built with "make bench".
+ *
+ * Every benchmark reports nanoseconds per sample (a sample being
+ * one value in one channel) and GB/s, counting bytes read plus
+ * bytes written. Pass -t for tab-separated output, one line per
+ * result, for tracking regressions with a script. Pass -n to skip
+ * samplefmt_global_init() and measure the scalar conversions. */
+
+#include "frame.h"
+#include "samplefmt.h"
+#include "sample_pool.h"
+#include "memacct.h"
+#include "ich_time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* each benchmark runs for at least this long */
+#define BENCH_MIN_NS 50000000LL
+
+typedef void (*bench_fn)(void* ud);
+
+struct bench_result {
+    double ns_per_sample;
+    double gb_per_sec;
+};
+
+typedef struct bench_result bench_result;
+
+struct bench_convert {
+    void* dest;
+    const void* src;
+    samplefmt srcfmt;
+    samplefmt destfmt;
+    size_t samples;
+};
+
+typedef struct bench_convert bench_convert;
+
+struct bench_frame {
+    frame src;
+    frame dest;
+    samplefmt destfmt;
+    unsigned int duration;
+    unsigned int len;
+};
+
+typedef struct bench_frame bench_frame;
+
+static int tabs = 0;
+static long long min_ns = BENCH_MIN_NS;
+
+static const unsigned int bench_channels[] = { 1, 2, 6, 8 };
+static const unsigned int bench_durations[] = { 1024, 4096 };
+
+#define BENCH_COUNT(a) (sizeof(a) / sizeof(a[0]))
+
+static const samplefmt bench_formats[] = {
+    SAMPLEFMT_U8,
+    SAMPLEFMT_S16,
+    SAMPLEFMT_S32,
+    SAMPLEFMT_S64,
+    SAMPLEFMT_FLOAT,
+    SAMPLEFMT_DOUBLE,
+};
+
+static long long bench_elapsed(const ich_time* start) {
+    ich_time now;
+    ich_time diff;
+
+    ich_time_now(&now);
+    ich_time_sub(&diff, &now, start);
+    return (diff.seconds * 1000000000LL) + diff.nanoseconds;
+}
+
+/* runs fn in batches, doubling the batch size until a batch
+ * takes at least min_ns. Returns the nanoseconds per call */
+static double bench_run(bench_fn fn, void* ud) {
+    ich_time start;
+    unsigned long i;
+    unsigned long iterations = 1;
+    long long ns;
+
+    fn(ud); /* warm up, gets any allocations out of the way */
+
+    for(;;) {
+        ich_time_now(&start);
+        for(i=0;i<iterations;i++) fn(ud);
+        ns = bench_elapsed(&start);
+        if(ns >= min_ns) break;
+        iterations *= 2;
+    }
+
+    return (double)ns / (double)iterations;
+}
+
+static bench_result bench_measure(bench_fn fn, void* ud, size_t samples, size_t bytes) {
+    bench_result res;
+    double ns;
+
+    ns = bench_run(fn, ud);
+    res.ns_per_sample = ns / (double)samples;
+    res.gb_per_sec = (double)bytes / ns;
+    return res;
+}
+
+static void bench_print_header(void) {
+    if(tabs) {
+        printf("bench\tcase\tchannels\tduration\tns_per_sample\tgb_per_sec\tsimd\n");
+    } else {
+        printf("simd: %s\n", samplefmt_simd_str());
+    }
+}
+
+static void bench_print(const char* bench, const char* c, unsigned int channels, unsigned int duration, const bench_result* res) {
+    if(tabs) {
+        printf("%s\t%s\t%u\t%u\t%.4f\t%.3f\t%s\n", bench, c, channels, duration,
+          res->ns_per_sample, res->gb_per_sec, samplefmt_simd_str());
+    } else {
+        printf("%-20s %-16s %u ch %5u samples %9.4f ns/sample %8.3f GB/s\n", bench, c, channels, duration,
+          res->ns_per_sample, res->gb_per_sec);
+    }
+    fflush(stdout);
+}
+
+/* fills a buffer with something resembling audio, floats and
+ * doubles stay within -1.0 ... 1.0 so nothing gets clamped */
+static void bench_fill(void* buf, samplefmt fmt, size_t samples) {
+    size_t i;
+    double t;
+
+    for(i=0;i<samples;i++) {
+        t = ((double)rand() / (double)RAND_MAX) * 2.0 - 1.0;
+        switch(fmt) {
+            case SAMPLEFMT_U8: /* fall-through */
+            case SAMPLEFMT_U8P: ((uint8_t*)buf)[i] = (uint8_t)(t * 127.0 + 128.0); break;
+            case SAMPLEFMT_S16: /* fall-through */
+            case SAMPLEFMT_S16P: ((int16_t*)buf)[i] = (int16_t)(t * 32767.0); break;
+            case SAMPLEFMT_S32: /* fall-through */
+            case SAMPLEFMT_S32P: ((int32_t*)buf)[i] = (int32_t)(t * 2147483647.0); break;
+            case SAMPLEFMT_S64: /* fall-through */
+            case SAMPLEFMT_S64P: ((int64_t*)buf)[i] = (int64_t)(t * 9223372036854775807.0); break;
+            case SAMPLEFMT_FLOAT: /* fall-through */
+            case SAMPLEFMT_FLOATP: ((float*)buf)[i] = (float)t; break;
+            case SAMPLEFMT_DOUBLE: /* fall-through */
+            case SAMPLEFMT_DOUBLEP: ((double*)buf)[i] = t; break;
+            default: break;
+        }
+    }
+}
+
+static int bench_frame_open(frame* f, samplefmt fmt, unsigned int channels, unsigned int duration) {
+    int r;
+    size_t i;
+
+    f->format = fmt;
+    f->channels = channels;
+    f->duration = duration;
+    f->sample_rate = 48000;
+
+    if( (r = frame_ready(f)) != 0) return r;
+    if( (r = frame_buffer(f)) != 0) return r;
+
+    if(samplefmt_is_planar(fmt)) {
+        for(i=0;i<channels;i++) {
+            bench_fill(frame_get_channel_samples(f,i), fmt, duration);
+        }
+    } else {
+        bench_fill(frame_get_channel_samples(f,0), fmt, (size_t)duration * channels);
+    }
+    return 0;
+}
+
+static void bench_convert_fn(void* ud) {
+    bench_convert* b = (bench_convert*)ud;
+    samplefmt_convert(b->dest, b->src, b->srcfmt, b->destfmt, b->samples, 1, 0, 1, 0);
+}
+
+static int bench_convert_all(void) {
+    size_t i, j;
+    bench_convert b;
+    bench_result res;
+    char name[64];
+    void* src = NULL;
+    void* dest = NULL;
+    /* about one frame of decoder output */
+    const unsigned int channels = 2;
+    const unsigned int duration = 4096;
+
+    b.samples = (size_t)duration * channels;
+
+    if( (src = malloc(b.samples * sizeof(double))) == NULL) return -1;
+    if( (dest = malloc(b.samples * sizeof(double))) == NULL) {
+        free(src);
+        return -1;
+    }
+
+    for(i=0;i<BENCH_COUNT(bench_formats);i++) {
+        bench_fill(src, bench_formats[i], b.samples);
+        for(j=0;j<BENCH_COUNT(bench_formats);j++) {
+            b.src = src;
+            b.dest = dest;
+            b.srcfmt = bench_formats[i];
+            b.destfmt = bench_formats[j];
+
+            res = bench_measure(bench_convert_fn, &b, b.samples,
+              b.samples * (samplefmt_size(b.srcfmt) + samplefmt_size(b.destfmt)));
+            snprintf(name, sizeof(name), "%s>%s", samplefmt_str(b.srcfmt), samplefmt_str(b.destfmt));
+            bench_print("samplefmt_convert", name, channels, duration, &res);
+        }
+    }
+
+    free(src);
+    free(dest);
+    return 0;
+}
+
+/* the timed functions can't return anything, and a failed call
+ * would just make for a fast, meaningless number */
+static void bench_check(int r, const char* fn) {
+    if(r == 0) return;
+    fprintf(stderr,"[bench] %s failed\n", fn);
+    abort();
+}
+
+static void bench_copy_fn(void* ud) {
+    bench_frame* b = (bench_frame*)ud;
+    bench_check(frame_copy(&b->dest, &b->src), "frame_copy");
+}
+
+static void bench_append_convert_fn(void* ud) {
+    bench_frame* b = (bench_frame*)ud;
+    b->dest.duration = 0;
+    bench_check(frame_append_convert(&b->dest, &b->src, b->destfmt), "frame_append_convert");
+}
+
+/* moves and trims put the source back to its full duration
+ * afterwards, the sample data is garbage by then but it's still
+ * the right size */
+static void bench_move_fn(void* ud) {
+    bench_frame* b = (bench_frame*)ud;
+    bench_check(frame_move(&b->dest, &b->src, b->len), "frame_move");
+    b->src.duration = b->duration;
+}
+
+static void bench_trim_fn(void* ud) {
+    bench_frame* b = (bench_frame*)ud;
+    bench_check(frame_trim(&b->src, b->len), "frame_trim");
+    b->src.duration = b->duration;
+}
+
+struct bench_frame_case {
+    const char* bench;
+    bench_fn fn;
+    samplefmt srcfmt;
+    samplefmt destfmt;
+};
+
+typedef struct bench_frame_case bench_frame_case;
+
+static const bench_frame_case bench_frame_cases[] = {
+    { "frame_copy",           bench_copy_fn,           SAMPLEFMT_S32P,   SAMPLEFMT_S32P },
+    { "frame_copy",           bench_copy_fn,           SAMPLEFMT_S16,    SAMPLEFMT_S16 },
+    { "frame_append_convert", bench_append_convert_fn, SAMPLEFMT_S32P,   SAMPLEFMT_S16 },
+    { "frame_append_convert", bench_append_convert_fn, SAMPLEFMT_S32P,   SAMPLEFMT_S32 },
+    { "frame_append_convert", bench_append_convert_fn, SAMPLEFMT_S32P,   SAMPLEFMT_FLOATP },
+    { "frame_append_convert", bench_append_convert_fn, SAMPLEFMT_FLOATP, SAMPLEFMT_S16 },
+    { "frame_append_convert", bench_append_convert_fn, SAMPLEFMT_FLOATP, SAMPLEFMT_FLOAT },
+    { "frame_append_convert", bench_append_convert_fn, SAMPLEFMT_S16,    SAMPLEFMT_FLOATP },
+    { "frame_move",           bench_move_fn,           SAMPLEFMT_S32P,   SAMPLEFMT_S32P },
+    { "frame_move",           bench_move_fn,           SAMPLEFMT_S16,    SAMPLEFMT_S16 },
+    { "frame_trim",           bench_trim_fn,           SAMPLEFMT_S32P,   SAMPLEFMT_S32P },
+    { "frame_trim",           bench_trim_fn,           SAMPLEFMT_S16,    SAMPLEFMT_S16 },
+};
+
+static int bench_frame_one(const bench_frame_case* c, unsigned int channels, unsigned int duration) {
+    int r;
+    size_t samples;
+    size_t bytes;
+    bench_frame b;
+    bench_result res;
+    char name[64];
+
+    frame_init(&b.src);
+    frame_init(&b.dest);
+    b.duration = duration;
+    b.len = duration / 4; /* like an encoder pulling off a block */
+    b.destfmt = c->destfmt;
+
+    if( (r = bench_frame_open(&b.src, c->srcfmt, channels, duration)) != 0) goto cleanup;
+    if( (r = bench_frame_open(&b.dest, c->destfmt, channels, duration)) != 0) goto cleanup;
+
+    samples = (size_t)duration * channels;
+    bytes = samples * (samplefmt_size(c->srcfmt) + samplefmt_size(c->destfmt));
+    if(c->fn == bench_trim_fn) {
+        /* only the samples left over get moved */
+        bytes = (samples - ((size_t)b.len * channels)) * samplefmt_size(c->srcfmt) * 2;
+    }
+
+    res = bench_measure(c->fn, &b, samples, bytes);
+    snprintf(name, sizeof(name), "%s>%s", samplefmt_str(c->srcfmt), samplefmt_str(c->destfmt));
+    bench_print(c->bench, name, channels, duration, &res);
+
+    cleanup:
+    frame_free(&b.src);
+    frame_free(&b.dest);
+    return r;
+}
+
+static int bench_frame_all(void) {
+    int r;
+    size_t i, j, k;
+
+    for(i=0;i<BENCH_COUNT(bench_frame_cases);i++) {
+        for(j=0;j<BENCH_COUNT(bench_channels);j++) {
+            for(k=0;k<BENCH_COUNT(bench_durations);k++) {
+                if( (r = bench_frame_one(&bench_frame_cases[i], bench_channels[j], bench_durations[k])) != 0) {
+                    fprintf(stderr,"[bench] error allocating frame\n");
+                    return r;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,"Usage: %s [-t] [-n] [-q]\n", argv0);
+    fprintf(stderr,"  -t  tab-separated output\n");
+    fprintf(stderr,"  -n  no SIMD, use the scalar conversions\n");
+    fprintf(stderr,"  -q  quick run, less accurate\n");
+}
+
+int main(int argc, const char* argv[]) {
+    int r = 1;
+    int i;
+    int simd = 1;
+
+    for(i=1;i<argc;i++) {
+        if(strcmp(argv[i],"-t") == 0) {
+            tabs = 1;
+        } else if(strcmp(argv[i],"-n") == 0) {
+            simd = 0;
+        } else if(strcmp(argv[i],"-q") == 0) {
+            min_ns = BENCH_MIN_NS / 10;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    /* nothing here logs, so the logger is left alone */
+    if(sample_pool_global_init() != 0) return 1;
+    if(memacct_global_init() != 0) goto cleanup_pool;
+    if(simd) samplefmt_global_init();
+
+    srand(1);
+    bench_print_header();
+
+    if(bench_convert_all() != 0) goto cleanup;
+    if(bench_frame_all() != 0) goto cleanup;
+
+    r = 0;
+
+    cleanup:
+    memacct_global_deinit();
+    cleanup_pool:
+    sample_pool_global_deinit();
+    return r;
+}
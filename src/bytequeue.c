@@ -0,0 +1,76 @@
+#include "bytequeue.h"
+#include "memacct.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define BLOCKSIZE 512
+
+void bytequeue_init(bytequeue* q) {
+    q->x = NULL;
+    q->len = 0;
+    q->base = NULL;
+    q->a = 0;
+    q->blocksize = BLOCKSIZE;
+    q->acct = 0;
+}
+
+void bytequeue_free(bytequeue* q) {
+    if(q->a != 0) {
+        memacct_resize(q->acct, q->a, 0);
+        free(q->base);
+    }
+    bytequeue_init(q);
+}
+
+void bytequeue_reset(bytequeue* q) {
+    q->x = q->base;
+    q->len = 0;
+}
+
+int bytequeue_readyplus(bytequeue* q, size_t len) {
+    uint8_t* t;
+    size_t a;
+    size_t need;
+
+    if((size_t)(q->x - q->base) + q->len + len <= q->a) return 0;
+
+    /* out of room at the end, move the unread bytes back to the start */
+    if(q->x != q->base && q->len > 0) memmove(q->base, q->x, q->len);
+    q->x = q->base;
+
+    /* grow if the queue would be over half full afterwards, so
+     * a queue that's kept full doesn't end up moving its whole
+     * contents for every append */
+    need = q->len + len;
+    if(need > q->a / 2) {
+        a = need * 2;
+        a = (a + (q->blocksize-1)) & -q->blocksize;
+        t = realloc(q->base, a);
+        if(t == NULL) return -1;
+        q->acct = memacct_resize(q->acct, q->a, a);
+        q->base = t;
+        q->x = t;
+        q->a = a;
+    }
+
+    return 0;
+}
+
+int bytequeue_append(bytequeue* q, const void* src, size_t len) {
+    int r;
+
+    if(len == 0) return 0;
+    if( (r = bytequeue_readyplus(q,len)) != 0) return r;
+    memcpy(&q->x[q->len],src,len);
+    q->len += len;
+    return 0;
+}
+
+int bytequeue_consume(bytequeue* q, size_t len) {
+    if(len > q->len) return -1;
+    q->x += len;
+    q->len -= len;
+    if(q->len == 0) q->x = q->base;
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef BYTEQUEUE_H
+#define BYTEQUEUE_H
+
+/* a byte queue for input buffering - data gets appended to
+ * the end and consumed from the front.
+ *
+ * This looks like a membuf to readers: x points at the first
+ * unread byte and len is the number of unread bytes, so code
+ * that parses out of a membuf works on a bytequeue unchanged.
+ * The difference is consuming bytes just moves x forward,
+ * instead of membuf_trim()'s memmove of everything left over.
+ * The unread bytes are only moved back to the start of the
+ * allocation when an append wouldn't fit after them. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct bytequeue {
+    uint8_t* x;     /* first unread byte */
+    size_t len;     /* number of unread bytes */
+    uint8_t* base;  /* start of the allocation */
+    size_t a;       /* size of the allocation */
+    size_t blocksize;
+    uint32_t acct;  /* memory accounting, see memacct.h */
+};
+
+typedef struct bytequeue bytequeue;
+
+#define BYTEQUEUE_ZERO { .x = NULL, .len = 0, .base = NULL, .a = 0, .blocksize = 512, .acct = 0 }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void bytequeue_init(bytequeue*);
+void bytequeue_free(bytequeue*);
+
+/* drops every unread byte */
+void bytequeue_reset(bytequeue*);
+
+/* makes room to write len bytes at &x[len] */
+int bytequeue_readyplus(bytequeue*, size_t len);
+
+int bytequeue_append(bytequeue*, const void* src, size_t len);
+
+/* removes len bytes from the front */
+int bytequeue_consume(bytequeue*, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,257 @@
+#include "crc32.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32_X64
+#endif
+
+#ifdef CRC32_X64
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define CRC32_ENABLE_PCLMUL
+#define CRC32_TARGET_PCLMUL __attribute__((target("pclmul,ssse3")))
+#elif defined(_MSC_VER)
+#define CRC32_ENABLE_PCLMUL
+#define CRC32_TARGET_PCLMUL
+#endif
+#endif
+
+#define CRC32_POLY 0x104C11DB7ULL
+
+static const uint32_t crc32_table[256] = {
+    0x00000000, 0x04C11DB7L, 0x09823B6EL, 0x0D4326D9L,
+    0x130476DC, 0x17C56B6BL, 0x1A864DB2L, 0x1E475005L,
+    0x2608EDB8, 0x22C9F00FL, 0x2F8AD6D6L, 0x2B4BCB61L,
+    0x350C9B64, 0x31CD86D3L, 0x3C8EA00AL, 0x384FBDBDL,
+    0x4C11DB70, 0x48D0C6C7L, 0x4593E01EL, 0x4152FDA9L,
+    0x5F15ADAC, 0x5BD4B01BL, 0x569796C2L, 0x52568B75L,
+    0x6A1936C8, 0x6ED82B7FL, 0x639B0DA6L, 0x675A1011L,
+    0x791D4014, 0x7DDC5DA3L, 0x709F7B7AL, 0x745E66CDL,
+    0x9823B6E0, 0x9CE2AB57L, 0x91A18D8EL, 0x95609039L,
+    0x8B27C03C, 0x8FE6DD8BL, 0x82A5FB52L, 0x8664E6E5L,
+    0xBE2B5B58, 0xBAEA46EFL, 0xB7A96036L, 0xB3687D81L,
+    0xAD2F2D84, 0xA9EE3033L, 0xA4AD16EAL, 0xA06C0B5DL,
+    0xD4326D90, 0xD0F37027L, 0xDDB056FEL, 0xD9714B49L,
+    0xC7361B4C, 0xC3F706FBL, 0xCEB42022L, 0xCA753D95L,
+    0xF23A8028, 0xF6FB9D9FL, 0xFBB8BB46L, 0xFF79A6F1L,
+    0xE13EF6F4, 0xE5FFEB43L, 0xE8BCCD9AL, 0xEC7DD02DL,
+    0x34867077, 0x30476DC0L, 0x3D044B19L, 0x39C556AEL,
+    0x278206AB, 0x23431B1CL, 0x2E003DC5L, 0x2AC12072L,
+    0x128E9DCF, 0x164F8078L, 0x1B0CA6A1L, 0x1FCDBB16L,
+    0x018AEB13, 0x054BF6A4L, 0x0808D07DL, 0x0CC9CDCAL,
+    0x7897AB07, 0x7C56B6B0L, 0x71159069L, 0x75D48DDEL,
+    0x6B93DDDB, 0x6F52C06CL, 0x6211E6B5L, 0x66D0FB02L,
+    0x5E9F46BF, 0x5A5E5B08L, 0x571D7DD1L, 0x53DC6066L,
+    0x4D9B3063, 0x495A2DD4L, 0x44190B0DL, 0x40D816BAL,
+    0xACA5C697, 0xA864DB20L, 0xA527FDF9L, 0xA1E6E04EL,
+    0xBFA1B04B, 0xBB60ADFCL, 0xB6238B25L, 0xB2E29692L,
+    0x8AAD2B2F, 0x8E6C3698L, 0x832F1041L, 0x87EE0DF6L,
+    0x99A95DF3, 0x9D684044L, 0x902B669DL, 0x94EA7B2AL,
+    0xE0B41DE7, 0xE4750050L, 0xE9362689L, 0xEDF73B3EL,
+    0xF3B06B3B, 0xF771768CL, 0xFA325055L, 0xFEF34DE2L,
+    0xC6BCF05F, 0xC27DEDE8L, 0xCF3ECB31L, 0xCBFFD686L,
+    0xD5B88683, 0xD1799B34L, 0xDC3ABDEDL, 0xD8FBA05AL,
+    0x690CE0EE, 0x6DCDFD59L, 0x608EDB80L, 0x644FC637L,
+    0x7A089632, 0x7EC98B85L, 0x738AAD5CL, 0x774BB0EBL,
+    0x4F040D56, 0x4BC510E1L, 0x46863638L, 0x42472B8FL,
+    0x5C007B8A, 0x58C1663DL, 0x558240E4L, 0x51435D53L,
+    0x251D3B9E, 0x21DC2629L, 0x2C9F00F0L, 0x285E1D47L,
+    0x36194D42, 0x32D850F5L, 0x3F9B762CL, 0x3B5A6B9BL,
+    0x0315D626, 0x07D4CB91L, 0x0A97ED48L, 0x0E56F0FFL,
+    0x1011A0FA, 0x14D0BD4DL, 0x19939B94L, 0x1D528623L,
+    0xF12F560E, 0xF5EE4BB9L, 0xF8AD6D60L, 0xFC6C70D7L,
+    0xE22B20D2, 0xE6EA3D65L, 0xEBA91BBCL, 0xEF68060BL,
+    0xD727BBB6, 0xD3E6A601L, 0xDEA580D8L, 0xDA649D6FL,
+    0xC423CD6A, 0xC0E2D0DDL, 0xCDA1F604L, 0xC960EBB3L,
+    0xBD3E8D7E, 0xB9FF90C9L, 0xB4BCB610L, 0xB07DABA7L,
+    0xAE3AFBA2, 0xAAFBE615L, 0xA7B8C0CCL, 0xA379DD7BL,
+    0x9B3660C6, 0x9FF77D71L, 0x92B45BA8L, 0x9675461FL,
+    0x8832161A, 0x8CF30BADL, 0x81B02D74L, 0x857130C3L,
+    0x5D8A9099, 0x594B8D2EL, 0x5408ABF7L, 0x50C9B640L,
+    0x4E8EE645, 0x4A4FFBF2L, 0x470CDD2BL, 0x43CDC09CL,
+    0x7B827D21, 0x7F436096L, 0x7200464FL, 0x76C15BF8L,
+    0x68860BFD, 0x6C47164AL, 0x61043093L, 0x65C52D24L,
+    0x119B4BE9, 0x155A565EL, 0x18197087L, 0x1CD86D30L,
+    0x029F3D35, 0x065E2082L, 0x0B1D065BL, 0x0FDC1BECL,
+    0x3793A651, 0x3352BBE6L, 0x3E119D3FL, 0x3AD08088L,
+    0x2497D08D, 0x2056CD3AL, 0x2D15EBE3L, 0x29D4F654L,
+    0xC5A92679, 0xC1683BCEL, 0xCC2B1D17L, 0xC8EA00A0L,
+    0xD6AD50A5, 0xD26C4D12L, 0xDF2F6BCBL, 0xDBEE767CL,
+    0xE3A1CBC1, 0xE760D676L, 0xEA23F0AFL, 0xEEE2ED18L,
+    0xF0A5BD1D, 0xF464A0AAL, 0xF9278673L, 0xFDE69BC4L,
+    0x89B8FD09, 0x8D79E0BEL, 0x803AC667L, 0x84FBDBD0L,
+    0x9ABC8BD5, 0x9E7D9662L, 0x933EB0BBL, 0x97FFAD0CL,
+    0xAFB010B1, 0xAB710D06L, 0xA6322BDFL, 0xA2F33668L,
+    0xBCB4666D, 0xB8757BDAL, 0xB5365D03L, 0xB1F740B4L
+};
+
+/* crc32_slices[k][i] is the crc of byte i followed by k zero
+ * bytes, so 8 bytes can be looked up at once */
+static uint32_t crc32_slices[8][256];
+
+static uint32_t crc32_bytewise(uint32_t crc, const uint8_t* b, size_t len) {
+    const uint8_t* e = b + len;
+
+    while(b < e) {
+        crc = (crc << 8) ^ crc32_table[( (crc >> 24) & 0xff) ^ (*b++)];
+    }
+
+    return crc;
+}
+
+static uint32_t crc32_slice8(uint32_t crc, const uint8_t* b, size_t len) {
+    uint32_t hi;
+    uint32_t lo;
+
+    while(len >= 8) {
+        hi = crc ^ (((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | (uint32_t)b[3]);
+        lo = ((uint32_t)b[4] << 24) | ((uint32_t)b[5] << 16) | ((uint32_t)b[6] << 8) | (uint32_t)b[7];
+
+        crc = crc32_slices[7][hi >> 24]
+            ^ crc32_slices[6][(hi >> 16) & 0xff]
+            ^ crc32_slices[5][(hi >> 8) & 0xff]
+            ^ crc32_slices[4][hi & 0xff]
+            ^ crc32_slices[3][lo >> 24]
+            ^ crc32_slices[2][(lo >> 16) & 0xff]
+            ^ crc32_slices[1][(lo >> 8) & 0xff]
+            ^ crc32_slices[0][lo & 0xff];
+
+        b += 8;
+        len -= 8;
+    }
+
+    return crc32_bytewise(crc, b, len);
+}
+
+#ifdef CRC32_ENABLE_PCLMUL
+
+/* x^n mod P, the folding constants */
+static uint32_t crc32_xpow(unsigned int n) {
+    uint64_t r = 1;
+    while(n--) {
+        r <<= 1;
+        if(r & 0x100000000ULL) r ^= CRC32_POLY;
+    }
+    return (uint32_t)r;
+}
+
+/* multipliers for folding 128 bits forward by 512 bits (four
+ * blocks at a time) and by 128 bits (one block at a time) */
+static uint64_t crc32_k512_hi;
+static uint64_t crc32_k512_lo;
+static uint64_t crc32_k128_hi;
+static uint64_t crc32_k128_lo;
+
+CRC32_TARGET_PCLMUL
+static inline __m128i crc32_fold(__m128i x, __m128i k) {
+    return _mm_xor_si128(
+      _mm_clmulepi64_si128(x, k, 0x11),
+      _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+/* the crc is MSB-first, so blocks get byte-reversed into one
+ * big 128-bit polynomial and folded down with carry-less
+ * multiplies. What's left is 16 bytes that have the same crc
+ * as everything folded so far, which goes through the tables
+ * along with the tail. */
+CRC32_TARGET_PCLMUL
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t* b, size_t len) {
+    const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i k;
+    __m128i x0, x1, x2, x3;
+    uint8_t rem[16];
+
+    if(len < 64) return crc32_slice8(crc, b, len);
+
+    x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&b[0]), swap);
+    x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&b[16]), swap);
+    x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&b[32]), swap);
+    x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&b[48]), swap);
+    x0 = _mm_xor_si128(x0, _mm_set_epi32((int)crc, 0, 0, 0));
+    b += 64;
+    len -= 64;
+
+    k = _mm_set_epi64x((long long)crc32_k512_hi, (long long)crc32_k512_lo);
+    while(len >= 64) {
+        x0 = _mm_xor_si128(crc32_fold(x0, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&b[0]), swap));
+        x1 = _mm_xor_si128(crc32_fold(x1, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&b[16]), swap));
+        x2 = _mm_xor_si128(crc32_fold(x2, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&b[32]), swap));
+        x3 = _mm_xor_si128(crc32_fold(x3, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&b[48]), swap));
+        b += 64;
+        len -= 64;
+    }
+
+    k = _mm_set_epi64x((long long)crc32_k128_hi, (long long)crc32_k128_lo);
+    x0 = _mm_xor_si128(crc32_fold(x0, k), x1);
+    x0 = _mm_xor_si128(crc32_fold(x0, k), x2);
+    x0 = _mm_xor_si128(crc32_fold(x0, k), x3);
+
+    while(len >= 16) {
+        x0 = _mm_xor_si128(crc32_fold(x0, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)b), swap));
+        b += 16;
+        len -= 16;
+    }
+
+    _mm_storeu_si128((__m128i*)rem, _mm_shuffle_epi8(x0, swap));
+    crc = crc32_slice8(0, rem, 16);
+    return crc32_slice8(crc, b, len);
+}
+
+static int cpu_has_pclmul(void) {
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+#else
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 1)) && (info[2] & (1 << 9));
+#endif
+}
+
+#endif
+
+static uint32_t (*crc32_impl)(uint32_t crc, const uint8_t* b, size_t len) = crc32_bytewise;
+static const char* crc32_name = "bytewise";
+
+int crc32_global_init(void) {
+    unsigned int i;
+    unsigned int k;
+
+    for(i = 0; i < 256; i++) {
+        crc32_slices[0][i] = crc32_table[i];
+    }
+    for(k = 1; k < 8; k++) {
+        for(i = 0; i < 256; i++) {
+            crc32_slices[k][i] = (crc32_slices[k-1][i] << 8) ^ crc32_table[crc32_slices[k-1][i] >> 24];
+        }
+    }
+
+    crc32_impl = crc32_slice8;
+    crc32_name = "slice8";
+
+#ifdef CRC32_ENABLE_PCLMUL
+    if(cpu_has_pclmul()) {
+        crc32_k512_hi = crc32_xpow(512 + 64);
+        crc32_k512_lo = crc32_xpow(512);
+        crc32_k128_hi = crc32_xpow(128 + 64);
+        crc32_k128_lo = crc32_xpow(128);
+        crc32_impl = crc32_pclmul;
+        crc32_name = "pclmul";
+    }
+#endif
+
+    return 0;
+}
+
+uint32_t crc32_update(uint32_t crc, const void* buf, size_t len) {
+    return crc32_impl(crc, (const uint8_t*)buf, len);
+}
+
+const char* crc32_impl_str(void) {
+    return crc32_name;
+}
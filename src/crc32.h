@@ -0,0 +1,30 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+/* the CRC-32 used by MPEG-TS sections and Ogg pages - polynomial
+ * 0x04C11DB7, MSB-first, no reflection and no final xor. TS
+ * starts from 0xFFFFFFFF, Ogg starts from 0.
+ *
+ * crc32_global_init() builds the slicing-by-8 tables and picks
+ * a carry-less multiply version when the CPU has one. Before
+ * it's called crc32_update still works, one byte at a time. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int crc32_global_init(void);
+
+uint32_t crc32_update(uint32_t crc, const void* buf, size_t len);
+
+/* name of the implementation in use, for logging */
+const char* crc32_impl_str(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
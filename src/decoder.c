@@ -1,5 +1,6 @@
 #include "decoder.h"
 #include "decoder_plugin.h"
+#include "memacct.h"
 
 #include <stddef.h>
 #include <stdlib.h>
@@ -16,6 +17,7 @@ void decoder_init(decoder* dec) {
     frame_init(&dec->frame);
     frame_source_init(&dec->frame_source);
     dec->pts = 0;
+    dec->coalesce_ms = 0;
 }
 
 void decoder_free(decoder* dec) {
@@ -30,6 +32,7 @@ void decoder_free(decoder* dec) {
 }
 
 int decoder_create(decoder* dec, const strbuf* name) {
+    int r;
     const decoder_plugin* plug;
     void* userdata;
 
@@ -52,7 +55,28 @@ int decoder_create(decoder* dec, const strbuf* name) {
     dec->userdata = userdata;
     dec->plugin = plug;
 
-    return dec->plugin->create(dec->userdata);
+    MEMACCT_CALL(MEMACCT_DECODER, r, dec->plugin->create(dec->userdata));
+    return r;
+}
+
+/* hands dec->frame to the receiver, dec->frame.duration is
+ * left at zero so we know nothing is pending */
+static int decoder_submit(decoder* dec) {
+    int r;
+
+    dec->frame.pts = dec->pts;
+
+    if( (r = dec->frame_receiver.submit_frame(dec->frame_receiver.handle, &dec->frame)) != 0) return r;
+
+    dec->pts += dec->frame.duration;
+    dec->frame.duration = 0;
+    return 0;
+}
+
+/* submits any frame being grouped by coalesce */
+static int decoder_submit_pending(decoder* dec) {
+    if(dec->frame.duration == 0) return 0;
+    return decoder_submit(dec);
 }
 
 static int decoder_open_wrapper(void* ud, const frame_source* source) {
@@ -85,6 +109,7 @@ static int decoder_open_wrapper(void* ud, const frame_source* source) {
         /* fall-through */
         case SAMPLEFMT_BINARY: {
             logs_info("change detected, flushing and resetting frame receiver");
+            if( (r = decoder_submit_pending(dec)) != 0) return r;
             if( (r = dec->frame_receiver.flush(dec->frame_receiver.handle)) != 0) return r;
             if( (r = dec->frame_receiver.reset(dec->frame_receiver.handle)) != 0) return r;
             dec->pts = 0;
@@ -106,17 +131,35 @@ static int decoder_submit_frame_wrapper(void* ud, const frame* frame) {
     decoder* dec = (decoder *)ud;
     int r;
 
-    if( (r = frame_copy(&dec->frame,frame)) != 0) return r;
+    if(dec->coalesce_ms == 0 || frame->format == SAMPLEFMT_BINARY) {
+        if( (r = decoder_submit_pending(dec)) != 0) return r;
+        if( (r = frame_copy(&dec->frame,frame)) != 0) return r;
+        return decoder_submit(dec);
+    }
 
-    dec->frame.pts = dec->pts;
+    /* every frame gets copied anyway, so appending them into one
+     * larger frame costs the same - and everything downstream (filter,
+     * sync, encoders) runs once per group instead of once per frame */
+    if(dec->frame.duration != 0 &&
+      (dec->frame.format != frame->format ||
+       dec->frame.channels != frame->channels ||
+       dec->frame.sample_rate != frame->sample_rate)) {
+        if( (r = decoder_submit(dec)) != 0) return r;
+    }
 
-    if( (r = dec->frame_receiver.submit_frame(dec->frame_receiver.handle, &dec->frame)) != 0) return r;
+    if(dec->frame.duration == 0) {
+        r = frame_copy(&dec->frame,frame);
+    } else {
+        r = frame_append(&dec->frame,frame);
+    }
+    if(r != 0) return r;
 
-    dec->pts += dec->frame.duration;
-    return r;
+    if((uint64_t)dec->frame.duration * 1000 < (uint64_t)dec->coalesce_ms * dec->frame.sample_rate) return 0;
+    return decoder_submit(dec);
 }
 
 int decoder_open(decoder* dec, const packet_source *src) {
+    int r;
     frame_receiver receiver = FRAME_RECEIVER_ZERO;
 
     if(dec->plugin == NULL || dec->userdata == NULL) {
@@ -134,10 +177,35 @@ int decoder_open(decoder* dec, const packet_source *src) {
       (int)dec->plugin->name->len,
       (const char *)dec->plugin->name->x);
 
-    return dec->plugin->open(dec->userdata, src, &receiver);
+    MEMACCT_CALL(MEMACCT_DECODER, r, dec->plugin->open(dec->userdata, src, &receiver));
+    return r;
 }
 
-int decoder_config(const decoder* dec, const strbuf* name, const strbuf* value) {
+int decoder_config(decoder* dec, const strbuf* name, const strbuf* value) {
+    int r;
+    unsigned long ms;
+
+    /* handled here rather than by the plugin, so it works with any of them */
+    if(strbuf_equals_cstr(name,"coalesce")) {
+        if(strbuf_falsey(value)) {
+            dec->coalesce_ms = 0;
+            return 0;
+        }
+        ms = strbuf_strtoul(value,10);
+        if(ms == 0) {
+            log_error("unknown value for key %.*s: %.*s",
+              (int)name->len,(const char *)name->x,(int)value->len,(const char *)value->x);
+            return -1;
+        }
+        if(ms > 10000) {
+            log_error("value for key %.*s is too large: %.*s",
+              (int)name->len,(const char *)name->x,(int)value->len,(const char *)value->x);
+            return -1;
+        }
+        dec->coalesce_ms = (unsigned int)ms;
+        return 0;
+    }
+
     log_debug("configuring plugin %.*s %.*s=%.*s",
       (int)dec->plugin->name->len,
       (const char *)dec->plugin->name->x,
@@ -145,7 +213,8 @@ int decoder_config(const decoder* dec, const strbuf* name, const strbuf* value)
       (const char *)name->x,
       (int)value->len,
       (const char *)value->x);
-    return dec->plugin->config(dec->userdata,name,value);
+    MEMACCT_CALL(MEMACCT_DECODER, r, dec->plugin->config(dec->userdata,name,value));
+    return r;
 }
 
 int decoder_global_init(void) {
@@ -163,7 +232,7 @@ int decoder_submit_packet(decoder* dec, const packet* p) {
     receiver.handle = dec;
     receiver.submit_frame = decoder_submit_frame_wrapper;
 
-    r = dec->plugin->decode(dec->userdata, p, &receiver);
+    MEMACCT_CALL(MEMACCT_DECODER, r, dec->plugin->decode(dec->userdata, p, &receiver));
     if(r == 0) {
         ich_time_now(&dec->ts);
         dec->counter++;
@@ -173,7 +242,15 @@ int decoder_submit_packet(decoder* dec, const packet* p) {
 
 int decoder_flush(decoder* dec) {
     int r;
-    r = dec->plugin->flush(dec->userdata, &dec->frame_receiver);
+    frame_receiver receiver = FRAME_RECEIVER_ZERO;
+
+    /* frames coming out of a flush get the same pts/coalesce
+     * handling as any other */
+    receiver.handle = dec;
+    receiver.submit_frame = decoder_submit_frame_wrapper;
+
+    MEMACCT_CALL(MEMACCT_DECODER, r, dec->plugin->flush(dec->userdata, &receiver));
+    if(r == 0) r = decoder_submit_pending(dec);
     if(r == 0) {
         ich_time_now(&dec->ts);
         dec->counter++;
@@ -181,8 +258,24 @@ int decoder_flush(decoder* dec) {
     return r;
 }
 
+int decoder_drain(decoder* dec) {
+    int r;
+    frame_receiver receiver = FRAME_RECEIVER_ZERO;
+
+    if(dec->plugin->drain != NULL) {
+        receiver.handle = dec;
+        receiver.submit_frame = decoder_submit_frame_wrapper;
+
+        MEMACCT_CALL(MEMACCT_DECODER, r, dec->plugin->drain(dec->userdata, &receiver));
+        if(r != 0) return r;
+    }
+    return decoder_submit_pending(dec);
+}
+
 int decoder_reset(const decoder* dec) {
-    return dec->plugin->reset(dec->userdata);
+    int r;
+    MEMACCT_CALL(MEMACCT_DECODER, r, dec->plugin->reset(dec->userdata));
+    return r;
 }
 
 void decoder_dump_counters(const decoder* in, const strbuf* prefix) {
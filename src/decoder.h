@@ -13,6 +13,7 @@ struct decoder {
     ich_time ts;
     frame frame;
     uint64_t pts;
+    unsigned int coalesce_ms; /* if non-zero, group decoded frames up to this long */
 };
 
 typedef struct decoder decoder;
@@ -33,7 +34,7 @@ void decoder_free(decoder* dec);
 
 int decoder_create(decoder *dec, const strbuf* plugin_name);
 
-int decoder_config(const decoder* dec, const strbuf* name, const strbuf* value);
+int decoder_config(decoder* dec, const strbuf* name, const strbuf* value);
 
 /* try to open the decoder */
 int decoder_open(decoder* dec, const packet_source* src);
@@ -43,6 +44,11 @@ int decoder_submit_packet(decoder* dec, const packet* p);
 /* flush out any remaining frames */
 int decoder_flush(decoder* dec);
 
+/* submits any frames being grouped by coalesce, and anything the
+ * plugin can hand over without ending the stream (see the plugin's
+ * drain) - used at tag boundaries and EOF */
+int decoder_drain(decoder* dec);
+
 /* reset the state to start decoding a new stream */
 int decoder_reset(const decoder* dec);
 
@@ -24,6 +24,11 @@ typedef int (*decoder_plugin_decode)(void* userdata, const packet* p, const fram
 /* flush any remaining frames of audio out, MUST NOT call frame_receiver flush() */
 typedef int (*decoder_plugin_flush)(void* userdata, const frame_receiver* frame_dest);
 
+/* optional - hand over any decoded audio the plugin is holding
+ * without ending the stream, used at tag boundaries and end of
+ * input. MUST NOT call frame_receiver flush() */
+typedef int (*decoder_plugin_drain)(void* userdata, const frame_receiver* frame_dest);
+
 /* reset the decoder state for another call to open() */
 typedef int (*decoder_plugin_reset)(void* userdata);
 
@@ -41,6 +46,7 @@ struct decoder_plugin {
     decoder_plugin_decode decode;
     decoder_plugin_flush flush;
     decoder_plugin_reset reset;
+    decoder_plugin_drain drain;
 };
 
 typedef struct decoder_plugin decoder_plugin;
@@ -97,6 +97,14 @@ static int plugin_flush(void* ud, const frame_receiver* dest) {
     return userdata->plugin->flush(userdata->handle,dest);
 }
 
+static int plugin_drain(void* ud, const frame_receiver* dest) {
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    /* tags can show up before we've picked a plugin */
+    if(userdata->plugin == NULL || userdata->plugin->drain == NULL) return 0;
+    return userdata->plugin->drain(userdata->handle,dest);
+}
+
 static int plugin_reset(void* ud) {
     plugin_userdata* userdata = (plugin_userdata*)ud;
     logs_info("resetting");
@@ -132,5 +140,6 @@ const decoder_plugin decoder_plugin_auto = {
     plugin_decode,
     plugin_flush,
     plugin_reset,
+    plugin_drain,
 };
 
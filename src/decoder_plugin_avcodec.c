@@ -487,4 +487,5 @@ const decoder_plugin decoder_plugin_avcodec = {
     decoder_plugin_avcodec_decode,
     decoder_plugin_avcodec_flush,
     decoder_plugin_avcodec_reset,
+    NULL,
 };
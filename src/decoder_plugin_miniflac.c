@@ -2,21 +2,84 @@
 #include "miniflac.h"
 #include "bitreader.h"
 
+#include "affinity.h"
+#include "ich_time.h"
+#include "membuf.h"
+#include "memacct.h"
 #include "strbuf.h"
+#include "thread.h"
 
 #include <stdlib.h>
 #include <inttypes.h>
 
 #define MAX_FLAC_CHANNELS 8
 
+#define MAX_DECODE_JOBS 64
+
+/* how much audio a decode job is handed at once, in milliseconds */
+#define DECODE_JOB_LENGTH 250
+
+/* how much input we time before deciding if it's ahead of realtime,
+ * long enough to ride out a network read or two */
+#define DECODE_WINDOW_LENGTH 1000
+
 #define LOG_PREFIX "[decoder:miniflac]"
 #include "logger.h"
 
 static STRBUF_CONST(plugin_name, "miniflac");
 
+struct plugin_userdata;
+
+/* with threads = N, packets are gathered into runs of about
+ * DECODE_JOB_LENGTH and each run is decoded on one of N threads.
+ * The demuxer hands us whole frames, and FLAC frames don't depend
+ * on each other, so every job just needs its own miniflac state.
+ * Runs are handed out and collected round-robin, so the decoded
+ * audio goes out in its original order.
+ *
+ * Jobs hold audio back until they're collected, so they're only
+ * used while input arrives well ahead of realtime - for a live
+ * input at its normal rate we decode inline. */
+struct decode_job {
+    struct plugin_userdata* userdata;
+    miniflac_t m;
+    thread_ptr_t thread;
+    thread_signal_t start;
+    thread_signal_t done;
+    membuf data;           /* packet data, back to back */
+    membuf packets;        /* a decode_packet for each packet in data */
+    unsigned int duration; /* total duration of the packets */
+    frame frame;           /* the decoded run */
+    unsigned int dropped;  /* bad frames replaced with silence */
+    MINIFLAC_RESULT error; /* the last bad frame's error, for logging */
+    int status;
+    uint8_t busy;          /* only touched by the source thread */
+    uint8_t quit;
+    unsigned int memacct;  /* memory accounting owner, see memacct.h */
+};
+
+typedef struct decode_job decode_job;
+
+struct decode_packet {
+    uint32_t len;
+    unsigned int duration;
+};
+
+typedef struct decode_packet decode_packet;
+
 struct plugin_userdata {
     miniflac_t m;
     frame frame;
+    MINIFLAC_VERIFY verify;
+    unsigned int bps;
+    size_t threads;        /* number of decode jobs, 0 to decode inline */
+    decode_job* jobs;
+    size_t cur;            /* the job being filled */
+    unsigned int chunk;    /* run length in samples */
+    unsigned int window_len; /* DECODE_WINDOW_LENGTH in samples */
+    uint8_t ahead;         /* non-zero if input is arriving faster than realtime */
+    ich_time window;       /* when we started timing the input */
+    unsigned int window_samples; /* samples received since then */
 };
 
 typedef struct plugin_userdata plugin_userdata;
@@ -31,12 +94,315 @@ static int plugin_create(void *ud) {
 
     miniflac_init(&userdata->m, MINIFLAC_CONTAINER_NATIVE);
     frame_init(&userdata->frame);
+    userdata->verify = MINIFLAC_VERIFY_FULL;
+    userdata->bps = 0;
+    userdata->threads = 0;
+    userdata->jobs = NULL;
+    userdata->cur = 0;
+    userdata->chunk = 0;
+    userdata->window_len = 0;
+    userdata->ahead = 0;
+    userdata->window.seconds = 0;
+    userdata->window.nanoseconds = 0;
+    userdata->window_samples = 0;
+
+    return 0;
+}
+
+/* puts a miniflac instance back into a state where it expects the
+ * start of a frame, either on open or after a bad frame */
+static void plugin_reinit(const plugin_userdata* userdata, miniflac_t* m) {
+    miniflac_init(m, MINIFLAC_CONTAINER_NATIVE);
+    miniflac_set_verify(m, userdata->verify);
+    m->state = MINIFLAC_FRAME; /* we'll only ever feed frames */
+    /* manually fill in data we've gotten from the STREAMINFO block */
+    m->metadata.streaminfo.sample_rate = userdata->frame.sample_rate;
+    m->metadata.streaminfo.bps = userdata->bps;
+}
+
+/* decodes one packet and appends the audio to f. The demuxer hands
+ * us whole frames, so the next packet is always the next frame
+ * boundary. A bad frame gets replaced with silence to keep the
+ * timing intact, and m gets reset to pick up with the next packet.
+ *
+ * Returns 0 when the packet decoded, 1 if it was dropped (with the
+ * reason in res), and -1 if we couldn't buffer samples */
+static int plugin_decode_packet(const plugin_userdata* userdata, miniflac_t* m, frame* f, const uint8_t* data, uint32_t len, unsigned int duration, MINIFLAC_RESULT* res) {
+    unsigned int i;
+    unsigned int start;
+    unsigned int offset;
+    uint32_t shift;
+    uint32_t used;
+    uint32_t pos;
+    int32_t* ptrs[MAX_FLAC_CHANNELS];
+
+    start = f->duration;
+    used = 0;
+    pos = 0;
+
+    /* decode in a loop, just in case the demuxer
+     * accidentally sent two packets */
+    while( (*res = miniflac_sync(m, &data[pos], len, &used)) == MINIFLAC_OK) {
+        len -= used;
+        pos += used;
+
+        /* size the frame using the parsed block size, rather than the packet duration */
+        offset = f->duration;
+        f->duration += m->frame.header.block_size;
+        if(frame_buffer(f) != 0) return -1;
+
+        for(i=0;i<f->channels;i++) {
+            ptrs[i] = (int32_t*)frame_get_channel_samples(f,i) + offset;
+        }
+
+        if( (*res = miniflac_decode(m, &data[pos], len, &used, ptrs)) != MINIFLAC_OK) {
+            f->duration = offset;
+            goto drop;
+        }
+        len -= used;
+        pos += used;
+
+        /* the block was just decoded and is still in cache,
+         * scale it up to 32 bits with the vector kernels */
+        shift = 32 - m->frame.header.bps;
+        for(i=0;i<m->frame.header.channels;i++) {
+            samplefmt_s32_shl(ptrs[i], m->frame.header.block_size, shift);
+        }
+    }
+
+    if(*res == MINIFLAC_CONTINUE) return 0;
+
+    drop:
+    plugin_reinit(userdata, m);
+    if(frame_fill(f, start + duration) != 0) return -1;
+    return 1;
+}
+
+static void decode_job_reset(decode_job* job) {
+    job->data.len = 0;
+    job->packets.len = 0;
+    job->duration = 0;
+    job->frame.duration = 0;
+    job->dropped = 0;
+}
+
+static int decode_job_decode(decode_job* job) {
+    int r;
+    size_t i;
+    uint32_t pos;
+    MINIFLAC_RESULT res;
+    const decode_packet* packets = (const decode_packet*)job->packets.x;
+
+    pos = 0;
+    for(i=0;i<job->packets.len / sizeof(decode_packet);i++) {
+        if( (r = plugin_decode_packet(job->userdata, &job->m, &job->frame, &job->data.x[pos], packets[i].len, packets[i].duration, &res)) < 0) return r;
+        if(r == 1) {
+            job->dropped++;
+            job->error = res;
+        }
+        pos += packets[i].len;
+    }
+
+    return 0;
+}
+
+static int decode_job_run(void* ud) {
+    decode_job* job = (decode_job*)ud;
+
+    memacct_set_owner(job->memacct);
+
+    for(;;) {
+        thread_signal_wait(&job->start, THREAD_SIGNAL_WAIT_INFINITE);
+        if(job->quit) break;
+        MEMACCT_CALL(MEMACCT_DECODER, job->status, decode_job_decode(job));
+        thread_signal_raise(&job->done);
+    }
+
+    logger_thread_cleanup();
+    thread_exit(0);
+    return 0;
+}
+
+static void decode_job_free(decode_job* job) {
+    if(job->thread != NULL) {
+        job->quit = 1;
+        thread_signal_raise(&job->start);
+        thread_join(job->thread);
+        job->thread = NULL;
+    }
+
+    membuf_free(&job->data);
+    membuf_free(&job->packets);
+    frame_free(&job->frame);
+    thread_signal_term(&job->start);
+    thread_signal_term(&job->done);
+}
+
+static int decode_job_create(plugin_userdata* userdata, decode_job* job) {
+    job->userdata = userdata;
+    job->thread = NULL;
+    thread_signal_init(&job->start);
+    thread_signal_init(&job->done);
+    membuf_init(&job->data);
+    membuf_init(&job->packets);
+    frame_init(&job->frame);
+    job->error = MINIFLAC_OK;
+    job->status = 0;
+    job->busy = 0;
+    job->quit = 0;
+    job->memacct = memacct_get_owner();
+    decode_job_reset(job);
+
+    job->thread = thread_create(decode_job_run, job, THREAD_STACK_SIZE_DEFAULT);
+    if(job->thread == NULL) {
+        logs_error("unable to create decoder thread");
+        return -1;
+    }
 
     return 0;
 }
 
+static int decode_jobs_create(plugin_userdata* userdata) {
+    int r;
+    size_t i;
+
+    userdata->jobs = (decode_job*)malloc(sizeof(decode_job) * userdata->threads);
+    if(userdata->jobs == NULL) {
+        logs_fatal("unable to allocate decode jobs");
+        return -1;
+    }
+
+    for(i=0;i<userdata->threads;i++) {
+        if( (r = decode_job_create(userdata, &userdata->jobs[i])) != 0) {
+            /* so plugin_close only cleans up what we made */
+            userdata->threads = i + 1;
+            return r;
+        }
+    }
+
+    log_debug("using %zu decode threads", userdata->threads);
+    return 0;
+}
+
+/* waits for a job to finish and sends its audio along, if dest is
+ * NULL the audio is thrown away */
+static int decode_job_collect(plugin_userdata* userdata, decode_job* job, const frame_receiver* dest) {
+    int r;
+
+    thread_signal_wait(&job->done, THREAD_SIGNAL_WAIT_INFINITE);
+    job->busy = 0;
+
+    if(job->status != 0) {
+        logs_fatal("unable to buffer decoded samples");
+        return job->status;
+    }
+
+    if(job->dropped == 1) {
+        log_warn("dropping bad frame: %d", job->error);
+    } else if(job->dropped > 1) {
+        log_warn("dropping %u bad frames, last error: %d", job->dropped, job->error);
+    }
+
+    if(dest != NULL && job->frame.duration > 0) {
+        job->frame.pts = userdata->frame.pts;
+        if( (r = dest->submit_frame(dest->handle, &job->frame)) != 0) return r;
+        userdata->frame.pts += job->frame.duration;
+    }
+
+    decode_job_reset(job);
+    return 0;
+}
+
+/* collects every outstanding job, oldest first */
+static int decode_jobs_collect_all(plugin_userdata* userdata, const frame_receiver* dest) {
+    int r;
+    size_t i;
+    decode_job* job;
+
+    for(i=0;i<userdata->threads;i++) {
+        job = &userdata->jobs[(userdata->cur + i) % userdata->threads];
+        if(!job->busy) continue;
+        if( (r = decode_job_collect(userdata, job, dest)) != 0) return r;
+    }
+    return 0;
+}
+
+/* starts decoding the job being filled and moves on to the next one */
+static void decode_jobs_dispatch(plugin_userdata* userdata) {
+    decode_job* job = &userdata->jobs[userdata->cur];
+
+    job->busy = 1;
+    thread_signal_raise(&job->start);
+    userdata->cur = (userdata->cur + 1) % userdata->threads;
+}
+
+/* sends along everything handed to the jobs so far. The job being
+ * filled may still be out with an older run, in which case nothing
+ * new went into it and we just wait for it */
+static int decode_jobs_flush(plugin_userdata* userdata, const frame_receiver* dest) {
+    decode_job* job = &userdata->jobs[userdata->cur];
+
+    if(!job->busy && job->packets.len > 0) decode_jobs_dispatch(userdata);
+    return decode_jobs_collect_all(userdata, dest);
+}
+
+/* times the input in DECODE_WINDOW_LENGTH steps, it counts as
+ * ahead if it came in at least twice as fast as realtime */
+static void decode_jobs_time(plugin_userdata* userdata, unsigned int duration) {
+    ich_time now;
+    ich_time elapsed;
+    int64_t ms;
+    uint8_t ahead;
+
+    if(userdata->window_samples == 0) ich_time_now(&userdata->window);
+    userdata->window_samples += duration;
+    if(userdata->window_samples < userdata->window_len) return;
+
+    ich_time_now(&now);
+    ich_time_sub(&elapsed, &now, &userdata->window);
+    ms = elapsed.seconds * 1000 + elapsed.nanoseconds / 1000000;
+
+    ahead = userdata->frame.sample_rate != 0 &&
+      ms * 2 < (int64_t)userdata->window_samples * 1000 / userdata->frame.sample_rate;
+    if(ahead != userdata->ahead) {
+        log_debug("input is %s, decoding %s", ahead ? "ahead of realtime" : "near realtime",
+          ahead ? "on threads" : "inline");
+    }
+    userdata->ahead = ahead;
+    userdata->window_samples = 0;
+}
+
+static int decode_jobs_submit(plugin_userdata* userdata, const packet* src, const frame_receiver* dest) {
+    int r;
+    decode_packet p;
+    decode_job* job = &userdata->jobs[userdata->cur];
+
+    /* this is the oldest job still out, it has to go first anyway */
+    if(job->busy) {
+        if( (r = decode_job_collect(userdata, job, dest)) != 0) return r;
+    }
+
+    p.len = src->data.len;
+    p.duration = src->duration;
+    if( (r = membuf_append(&job->data, src->data.x, src->data.len)) != 0) return r;
+    if( (r = membuf_append(&job->packets, &p, sizeof(decode_packet))) != 0) return r;
+    job->duration += src->duration;
+
+    if(job->duration >= userdata->chunk) decode_jobs_dispatch(userdata);
+    return 0;
+}
+
 static void plugin_close(void* ud) {
     plugin_userdata* userdata = (plugin_userdata*)ud;
+    size_t i;
+
+    if(userdata->jobs != NULL) {
+        for(i=0;i<userdata->threads;i++) {
+            decode_job_free(&userdata->jobs[i]);
+        }
+        free(userdata->jobs);
+        userdata->jobs = NULL;
+    }
 
     frame_free(&userdata->frame);
 }
@@ -61,12 +427,6 @@ static int plugin_open(void* ud, const packet_source* src, const frame_receiver*
     br.buffer = src->dsi.x;
     br.len    = src->dsi.len;
 
-    /* we'll re-init on each open */
-    miniflac_init(&userdata->m, MINIFLAC_CONTAINER_NATIVE);
-    userdata->m.state = MINIFLAC_FRAME; /* we'll only ever feed frames */
-    /* manually fill in data we've gotten from the STREAMINFO block */
-    userdata->m.metadata.streaminfo.sample_rate = src->sample_rate;
-
     min_block_size = bitreader_read(&br,16);
     max_block_size = bitreader_read(&br,16);
     min_frame_size = bitreader_read(&br,24);
@@ -98,7 +458,7 @@ static int plugin_open(void* ud, const packet_source* src, const frame_receiver*
                                md5[12],  md5[13] , md5[14] , md5[15]);
     log_debug("  channel_layout=0x%" PRIx64, src->channel_layout);
 
-    userdata->m.metadata.streaminfo.bps = bps;
+    userdata->bps = bps;
 
     me.handle = userdata;
     me.format = SAMPLEFMT_S32P;
@@ -111,87 +471,140 @@ static int plugin_open(void* ud, const packet_source* src, const frame_receiver*
     userdata->frame.sample_rate = src->sample_rate;
     userdata->frame.pts = 0;
 
+    /* we'll re-init on each open */
+    plugin_reinit(userdata, &userdata->m);
+
     if(frame_ready(&userdata->frame) != 0) {
         logs_fatal("unable to prepare frame");
         return -1;
     }
 
+    if(userdata->threads != 0) {
+        if(userdata->jobs == NULL) {
+            if(decode_jobs_create(userdata) != 0) return -1;
+        }
+
+        /* the previous stream was flushed and reset before we got
+         * here, so every job is idle */
+        for(i=0;i<userdata->threads;i++) {
+            plugin_reinit(userdata, &userdata->jobs[i].m);
+            userdata->jobs[i].frame.channels = channels;
+            userdata->jobs[i].frame.format = SAMPLEFMT_S32P;
+            userdata->jobs[i].frame.sample_rate = src->sample_rate;
+            if(frame_ready(&userdata->jobs[i].frame) != 0) {
+                logs_fatal("unable to prepare frame");
+                return -1;
+            }
+        }
+
+        userdata->chunk = (unsigned int)((uint64_t)src->sample_rate * DECODE_JOB_LENGTH / 1000);
+        if(userdata->chunk == 0) userdata->chunk = 1;
+        userdata->window_len = (unsigned int)((uint64_t)src->sample_rate * DECODE_WINDOW_LENGTH / 1000);
+        if(userdata->window_len == 0) userdata->window_len = 1;
+        userdata->ahead = 0;
+        userdata->window_samples = 0;
+    }
+
     return dest->open(dest->handle,&me);
 }
 
 static int plugin_decode(void* ud, const packet* src, const frame_receiver* dest) {
     plugin_userdata* userdata = (plugin_userdata*)ud;
-
     int r;
-    unsigned int i, j;
-    uint32_t shift;
-    uint32_t len;
-    uint32_t used;
-    uint32_t pos;
-    int32_t* channel;
-    int32_t* ptrs[MAX_FLAC_CHANNELS];
     MINIFLAC_RESULT res;
 
-    len = src->data.len;
-    used = 0;
-    pos = 0;
-
-    /* decode in a loop, just in case the demuxer
-     * accidentally sent two packets */
-    while( (res = miniflac_sync(&userdata->m, &src->data.x[pos], len, &used)) == MINIFLAC_OK) {
-        len -= used;
-        pos += used;
-
-        /* set the frame duration using the parsed block size, rathern than src->duration */
-        userdata->frame.duration = userdata->m.frame.header.block_size;
-        if( (r = frame_buffer(&userdata->frame)) != 0) return r;
-
-        for(i=0;i<userdata->frame.channels;i++) {
-            ptrs[i] = (int32_t*)frame_get_channel_samples(&userdata->frame,i);
-        }
-
-        if( (res = miniflac_decode(&userdata->m, &src->data.x[pos], len, &used, ptrs)) != MINIFLAC_OK) {
-            log_error("error decoding: %d",res);
-            return -1;
-        }
-        len -= used;
-        pos += used;
-
-        shift = 32 - userdata->m.frame.header.bps;
-        for(i=0;i<userdata->m.frame.header.channels;i++) {
-            channel = (int32_t *)frame_get_channel_samples(&userdata->frame,i);
-            for(j=0;j<userdata->m.frame.header.block_size;j++) {
-                channel[j] *= (1 << shift);
-            }
-        }
+    if(userdata->jobs != NULL) {
+        decode_jobs_time(userdata, src->duration);
+        if(userdata->ahead) return decode_jobs_submit(userdata, src, dest);
+        /* back to realtime, anything in the jobs goes first */
+        if( (r = decode_jobs_flush(userdata, dest)) != 0) return r;
+    }
 
-        if( (r = dest->submit_frame(dest->handle, &userdata->frame)) != 0) {
-            return r;
-        }
-        userdata->frame.pts += userdata->m.frame.header.block_size;
+    userdata->frame.duration = 0;
+    if( (r = plugin_decode_packet(userdata, &userdata->m, &userdata->frame, src->data.x, src->data.len, src->duration, &res)) < 0) {
+        logs_fatal("unable to buffer decoded samples");
+        return r;
     }
+    if(r == 1) log_warn("dropping bad frame: %d", res);
 
-    if(res == MINIFLAC_CONTINUE) return 0;
+    if(userdata->frame.duration == 0) return 0;
 
-    log_error("miniflac_sync returned an error: %d",res);
-    return -1;
+    if( (r = dest->submit_frame(dest->handle, &userdata->frame)) != 0) return r;
+    userdata->frame.pts += userdata->frame.duration;
+    return 0;
 }
 
 static int plugin_flush(void* ud, const frame_receiver* dest) {
-    (void)ud;
-    (void)dest;
-    return 0;
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    if(userdata->jobs == NULL) return 0;
+    return decode_jobs_flush(userdata, dest);
 }
 
 static int plugin_reset(void* ud) {
-    (void)ud;
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+    int r;
+
+    if(userdata->jobs == NULL) return 0;
+
+    /* anything still out gets thrown away, the workers have
+     * to be done with a job before we can clear it */
+    if( (r = decode_jobs_collect_all(userdata, NULL)) != 0) return r;
+    decode_job_reset(&userdata->jobs[userdata->cur]);
+    userdata->ahead = 0;
+    userdata->window_samples = 0;
     return 0;
 }
 
 static int plugin_config(void* ud, const strbuf* key, const strbuf* val) {
-    (void)ud;
-    (void)key;
-    (void)val;
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+    unsigned long threads;
+
+    if(strbuf_equals_cstr(key,"verify")) {
+        if(strbuf_truthy(val) || strbuf_caseequals_cstr(val,"full")) {
+            userdata->verify = MINIFLAC_VERIFY_FULL;
+            return 0;
+        }
+        if(strbuf_caseequals_cstr(val,"headers")) {
+            userdata->verify = MINIFLAC_VERIFY_HEADERS;
+            return 0;
+        }
+        if(strbuf_falsey(val) || strbuf_caseequals_cstr(val,"none")) {
+            userdata->verify = MINIFLAC_VERIFY_NONE;
+            return 0;
+        }
+        log_error("unknown value for key %.*s: %.*s",
+          (int)key->len,(char *)key->x,(int)val->len,(char *)val->x);
+        return -1;
+    }
+
+    /* decode on several threads at once, for inputs that can be read
+     * faster than realtime (files, or a backlog after reconnecting).
+     * Either a number of threads, or "auto" for one per CPU. While
+     * threaded this holds back up to threads * DECODE_JOB_LENGTH of
+     * audio, so it only kicks in while input is arriving at twice
+     * realtime or better - a live input at its normal rate is
+     * decoded inline with no added latency */
+    if(strbuf_equals_cstr(key,"threads")) {
+        threads = strbuf_strtoul(val,10);
+        if(threads > 0 && threads <= MAX_DECODE_JOBS) {
+            userdata->threads = (size_t)threads;
+            return 0;
+        }
+        if(strbuf_caseequals_cstr(val,"auto")) {
+            userdata->threads = affinity_cpu_count();
+            if(userdata->threads > MAX_DECODE_JOBS) userdata->threads = MAX_DECODE_JOBS;
+            return 0;
+        }
+        if(threads == 0 && strbuf_falsey(val)) {
+            userdata->threads = 0;
+            return 0;
+        }
+        log_error("unknown value for key %.*s: %.*s",
+          (int)key->len,(char *)key->x,(int)val->len,(char *)val->x);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -208,5 +621,6 @@ const decoder_plugin decoder_plugin_miniflac = {
     plugin_decode,
     plugin_flush,
     plugin_reset,
+    plugin_flush, /* frames don't depend on each other, so a flush is a drain */
 };
 
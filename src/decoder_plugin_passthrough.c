@@ -93,4 +93,5 @@ const decoder_plugin decoder_plugin_passthrough = {
     plugin_decode,
     plugin_flush,
     plugin_reset,
+    NULL,
 };
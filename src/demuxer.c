@@ -1,5 +1,6 @@
 #include "demuxer.h"
 #include "demuxer_plugin.h"
+#include "memacct.h"
 
 #include <stddef.h>
 #include <stdlib.h>
@@ -35,6 +36,7 @@ void demuxer_free(demuxer* dem) {
 }
 
 int demuxer_create(demuxer* dem, const strbuf* name) {
+    int r;
     const demuxer_plugin* plug;
     void* userdata;
 
@@ -57,11 +59,14 @@ int demuxer_create(demuxer* dem, const strbuf* name) {
     dem->userdata = userdata;
     dem->plugin = plug;
 
-    return dem->plugin->create(dem->userdata);
+    MEMACCT_CALL(MEMACCT_DEMUXER, r, dem->plugin->create(dem->userdata));
+    return r;
 }
 
 
 int demuxer_open(demuxer* dem, input* in) {
+    int r;
+
     if(dem->plugin == NULL || dem->userdata == NULL) {
         logs_error("plugin not selected");
         return -1;
@@ -73,10 +78,13 @@ int demuxer_open(demuxer* dem, input* in) {
     log_debug("opening %.*s plugin",
       (int)dem->plugin->name->len,
       (const char *)dem->plugin->name->x);
-    return dem->plugin->open(dem->userdata, in);
+    MEMACCT_CALL(MEMACCT_DEMUXER, r, dem->plugin->open(dem->userdata, in));
+    return r;
 }
 
 int demuxer_config(const demuxer* dem, const strbuf* name, const strbuf* value) {
+    int r;
+
     log_debug("configuring plugin %.*s %.*s=%.*s",
       (int)dem->plugin->name->len,
       (const char *)dem->plugin->name->x,
@@ -84,7 +92,8 @@ int demuxer_config(const demuxer* dem, const strbuf* name, const strbuf* value)
       (const char *)name->x,
       (int)value->len,
       (const char *)value->x);
-    return dem->plugin->config(dem->userdata,name,value);
+    MEMACCT_CALL(MEMACCT_DEMUXER, r, dem->plugin->config(dem->userdata,name,value));
+    return r;
 }
 
 int demuxer_global_init(void) {
@@ -96,7 +105,9 @@ void demuxer_global_deinit(void) {
 }
 
 int demuxer_run(demuxer* dem) {
-    int r = dem->plugin->run(dem->userdata, &dem->tag_handler, &dem->packet_receiver);
+    int r;
+
+    MEMACCT_CALL(MEMACCT_DEMUXER, r, dem->plugin->run(dem->userdata, &dem->tag_handler, &dem->packet_receiver));
     if(r == 0) {
         ich_time_now(&dem->ts);
         dem->counter++;
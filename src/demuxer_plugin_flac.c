@@ -3,6 +3,8 @@
 #include "unpack_u16be.h"
 #include "unpack_u32le.h"
 #include "base64decode.h"
+#include "bytequeue.h"
+#include "miniflac.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -25,15 +27,31 @@ static STRBUF_CONST(plugin_name, "flac");
 
 #define HEADER_MASK 0xFFFF0F0F
 
+/* FLAC frames don't have a length, the only way to find the end of
+ * one is to find the start of the next. Anything matching the fixed
+ * part of the header is a candidate, verify decides how hard we check
+ * before believing it. The decoder checks each frame's CRC-16 anyway,
+ * so by default we only check the header's CRC-8. */
+enum VERIFY {
+    VERIFY_FULL,    /* header CRC-8, and CRC-16 of the frame before it */
+    VERIFY_HEADERS, /* header CRC-8 (default) */
+    VERIFY_NONE,    /* just the fixed header bits */
+};
+
+typedef enum VERIFY VERIFY;
+
 struct plugin_userdata {
     input* input;
-    membuf buffer;
+    bytequeue buffer;
     taglist tags;
     strbuf scratch;
     packet packet;
     uint32_t header_fixed;
+    uint32_t min_frame_size;
+    uint32_t max_frame_size;
     uint8_t empty_tags;
     uint8_t ignore_tags;
+    VERIFY verify;
     size_t packetno;
     packet_source me;
 };
@@ -55,14 +73,17 @@ static size_t plugin_size(void) {
 static int plugin_create(void* ud) {
     plugin_userdata* userdata = (plugin_userdata*)ud;
 
-    membuf_init(&userdata->buffer);
+    bytequeue_init(&userdata->buffer);
     taglist_init(&userdata->tags);
     strbuf_init(&userdata->scratch);
     packet_init(&userdata->packet);
 
     userdata->header_fixed = 0;
+    userdata->min_frame_size = 0;
+    userdata->max_frame_size = 0;
     userdata->empty_tags = 0;
     userdata->ignore_tags = 0;
+    userdata->verify = VERIFY_HEADERS;
     userdata->packetno = 0;
 
     userdata->input = NULL;
@@ -75,7 +96,7 @@ static int plugin_create(void* ud) {
 static void plugin_close(void* ud) {
     plugin_userdata* userdata = (plugin_userdata*)ud;
 
-    membuf_free(&userdata->buffer);
+    bytequeue_free(&userdata->buffer);
     taglist_free(&userdata->tags);
     strbuf_free(&userdata->scratch);
     packet_free(&userdata->packet);
@@ -122,6 +143,24 @@ static int plugin_config(void* ud, const strbuf* key, const strbuf* value) {
         return -1;
     }
 
+    if(strbuf_equals_cstr(key,"verify")) {
+        if(strbuf_truthy(value) || strbuf_caseequals_cstr(value,"full")) {
+            userdata->verify = VERIFY_FULL;
+            return 0;
+        }
+        if(strbuf_caseequals_cstr(value,"headers")) {
+            userdata->verify = VERIFY_HEADERS;
+            return 0;
+        }
+        if(strbuf_falsey(value) || strbuf_caseequals_cstr(value,"none")) {
+            userdata->verify = VERIFY_NONE;
+            return 0;
+        }
+        log_error("unknown value for key %.*s: %.*s",
+          (int)key->len,(char *)key->x,(int)value->len,(char *)value->x);
+        return -1;
+    }
+
     log_error("unknown key %.*s",
       (int)key->len,(char *)key->x);
     return -1;
@@ -130,12 +169,128 @@ static int plugin_config(void* ud, const strbuf* key, const strbuf* value) {
 static size_t buffer_read(plugin_userdata* userdata, size_t len) {
     size_t r;
 
-    if(membuf_readyplus(&userdata->buffer,len) != 0) return 0;
+    if(bytequeue_readyplus(&userdata->buffer,len) != 0) return 0;
     r = input_read(userdata->input,&userdata->buffer.x[userdata->buffer.len],len);
     userdata->buffer.len += r;
     return r;
 }
 
+/* length of the UTF-8 style frame/sample number starting with c,
+ * or 0 if c can't start one */
+static size_t frame_number_len(uint8_t c) {
+    if( (c & 0x80) == 0x00) return 1;
+    if( (c & 0xE0) == 0xC0) return 2;
+    if( (c & 0xF0) == 0xE0) return 3;
+    if( (c & 0xF8) == 0xF0) return 4;
+    if( (c & 0xFC) == 0xF8) return 5;
+    if( (c & 0xFE) == 0xFC) return 6;
+    if( c == 0xFE) return 7;
+    return 0;
+}
+
+/* running CRC-16 of the frame in front of a candidate, candidates
+ * are checked in order so each byte only gets hashed once */
+struct frame_crc {
+    size_t pos;
+    uint16_t crc16;
+};
+
+typedef struct frame_crc frame_crc;
+
+/* checks a candidate frame header at pos, and with crc set the CRC-16
+ * at the end of the frame in front of it (which starts at 0). Returns
+ * 1 if it's good, 0 if it's not a frame header, 2 if the header is good
+ * but the previous frame isn't, or -1 if the header isn't all buffered */
+static int check_frame(const plugin_userdata* userdata, size_t pos, frame_crc* crc) {
+    const uint8_t* x = &userdata->buffer.x[pos];
+    size_t len = userdata->buffer.len - pos;
+    size_t hlen;
+
+    if(userdata->verify == VERIFY_NONE) return 1;
+
+    if(len < 5) return -1;
+    if( (hlen = frame_number_len(x[4])) == 0) return 0;
+    hlen += 4;
+    switch(x[2] >> 4) {
+        case 6: hlen += 1; break;
+        case 7: hlen += 2; break;
+        default: break;
+    }
+    switch(x[2] & 0x0F) {
+        case 12: hlen += 1; break;
+        case 13: /* fall-through */
+        case 14: hlen += 2; break;
+        default: break;
+    }
+    if(len <= hlen) return -1;
+
+    if(miniflac_crc8_update(0, x, hlen) != x[hlen]) return 0;
+
+    if(userdata->verify != VERIFY_FULL || crc == NULL) return 1;
+
+    /* the CRC-16 over a frame and its footer comes out to 0 */
+    crc->crc16 = miniflac_crc16_update(crc->crc16, &userdata->buffer.x[crc->pos], pos - crc->pos);
+    crc->pos = pos;
+    return pos >= 2 && crc->crc16 == 0 ? 1 : 2;
+}
+
+/* finds the start of the next frame at or after *pos, reading more
+ * input as needed. Returns 0 with *pos set to the frame, or 1 at
+ * end-of-file with *pos at the end of the buffer.
+ *
+ * With verify = full, if a header checks out but the CRC-16 of the
+ * frame in front of it doesn't, either the header's a fake or the
+ * frame is damaged. We keep looking for a better one up to the largest
+ * frame size in the stream, then settle for the first one - the decoder
+ * can deal with a bad frame, but merging it into everything after it
+ * would be worse. */
+static int find_frame(plugin_userdata* userdata, size_t* pos, uint8_t prev) {
+    const uint8_t* p;
+    size_t i = *pos;
+    size_t fallback = 0;
+    size_t limit = 0;
+    int r;
+    frame_crc crc;
+
+    crc.pos = 0;
+    crc.crc16 = 0;
+
+    for(;;) {
+        while(i + 4 <= userdata->buffer.len) {
+            if(fallback != 0 && i >= limit) {
+                *pos = fallback;
+                return 0;
+            }
+            if( (p = memchr(&userdata->buffer.x[i], 0xFF, userdata->buffer.len - 3 - i)) == NULL) {
+                i = userdata->buffer.len - 3;
+                break;
+            }
+            i = p - userdata->buffer.x;
+            if( (unpack_u32be(p) & HEADER_MASK) == userdata->header_fixed) {
+                r = check_frame(userdata, i, prev ? &crc : NULL);
+                if(r == 1) {
+                    *pos = i;
+                    return 0;
+                }
+                if(r == -1) break;
+                if(r == 2 && fallback == 0) {
+                    fallback = i;
+                    limit = userdata->max_frame_size != 0 ? userdata->max_frame_size : i + 65536;
+                }
+            }
+            i++;
+        }
+        if(buffer_read(userdata,1<<17) == 0) {
+            if(fallback != 0) {
+                *pos = fallback;
+                return 0;
+            }
+            *pos = userdata->buffer.len;
+            return 1;
+        }
+    }
+}
+
 static int handle_picture_block(plugin_userdata* userdata, uint32_t len) {
     strbuf key = STRBUF_ZERO;
     strbuf val = STRBUF_ZERO;
@@ -237,7 +392,7 @@ static int plugin_open(void* ud, input* in) {
         return -1;
     }
 
-    membuf_trim(&userdata->buffer,4);
+    bytequeue_consume(&userdata->buffer,4);
     return 0;
 }
 
@@ -250,11 +405,9 @@ static int plugin_run(void* ud, const tag_handler* thandler, const packet_receiv
     uint16_t min_block_size;
     uint16_t max_block_size;
     uint8_t channels;
-    uint32_t t;
     size_t i;
     size_t j;
     size_t got;
-    uint8_t have_data = 1;
     plugin_userdata* userdata = (plugin_userdata*)ud;
 
     if(userdata->header_fixed == 0) {
@@ -304,7 +457,7 @@ static int plugin_run(void* ud, const tag_handler* thandler, const packet_receiv
                 default: break;
             }
 
-            membuf_trim(&userdata->buffer,4 + len);
+            bytequeue_consume(&userdata->buffer,4 + len);
         } while(userdata->header_fixed == 0);
 
         if(userdata->me.dsi.len == 0) {
@@ -316,6 +469,9 @@ static int plugin_run(void* ud, const tag_handler* thandler, const packet_receiv
         max_block_size = unpack_u16be(&userdata->me.dsi.x[2]);
         channels       = ((userdata->me.dsi.x[12] >> 1) & 0x07) + 1;
 
+        userdata->min_frame_size = unpack_u32be(&userdata->me.dsi.x[3]) & 0x00FFFFFF;
+        userdata->max_frame_size = unpack_u32be(&userdata->me.dsi.x[6]) & 0x00FFFFFF;
+
         if(min_block_size == max_block_size) userdata->me.frame_len = min_block_size;
 
         userdata->me.name = &plugin_name;
@@ -350,26 +506,20 @@ static int plugin_run(void* ud, const tag_handler* thandler, const packet_receiv
     if(userdata->buffer.len == 0 &&
        buffer_read(userdata,1<<17) == 0) return 1;
 
-    t = unpack_u32be(&userdata->buffer.x[0])  & HEADER_MASK;
-    if(t != userdata->header_fixed) {
-        logs_error("had some kind of sync issue");
-        return -1;
+    /* we should be sitting on a frame, if not skip ahead to the next one */
+    i = 0;
+    r = find_frame(userdata, &i, 0);
+    if(i != 0) {
+        log_warn("lost sync, skipped %zu bytes", i);
+        bytequeue_consume(&userdata->buffer, i);
     }
+    if(r != 0) return 1;
 
-    i = 6; /* minimum heade size is 6 bytes */
-    while(have_data) {
-        while(i < userdata->buffer.len) {
-            t = unpack_u32be(&userdata->buffer.x[i]) & HEADER_MASK;
-            if(t == userdata->header_fixed) {
-                goto done;
-            }
-            i++;
-        }
-        have_data = buffer_read(userdata,1<<17) != 0;
-    }
-    done:
-
-    /* if we hit EOF we just assume this is the last frame */
+    /* the next frame can't start any sooner than the smallest frame in
+     * the stream, or the minimum header size of 6 bytes. If we hit EOF
+     * we just assume this is the last frame */
+    i = userdata->min_frame_size > 6 ? userdata->min_frame_size : 6;
+    find_frame(userdata, &i, 1);
 
     userdata->packet.data.len = 0;
     if( (r = membuf_append(&userdata->packet.data, &userdata->buffer.x[0], i)) != 0) return r;
@@ -397,42 +547,12 @@ static int plugin_run(void* ud, const tag_handler* thandler, const packet_receiv
             break;
         }
         case 6: {
-            j = 4;
-            if( (userdata->buffer.x[4] & 0x80) == 0x00) {
-                j += 1;
-            } else if( (userdata->buffer.x[4] & 0xE0) == 0xC0) {
-                j += 2;
-            } else if( (userdata->buffer.x[4] & 0xF0) == 0xE0) {
-                j += 3;
-            } else if( (userdata->buffer.x[4] & 0xF8) == 0xF0) {
-                j += 4;
-            } else if( (userdata->buffer.x[4] & 0xFC) == 0xF8) {
-                j += 5;
-            } else if( (userdata->buffer.x[4] & 0xFE) == 0xFC) {
-                j += 6;
-            } else if( (userdata->buffer.x[4] & 0xFF) == 0xFE) {
-                j += 7;
-            }
+            j = 4 + frame_number_len(userdata->buffer.x[4]);
             userdata->packet.duration = userdata->buffer.x[j] + 1;
             break;
         }
         case 7: {
-            j = 4;
-            if( (userdata->buffer.x[4] & 0x80) == 0x00) {
-                j += 1;
-            } else if( (userdata->buffer.x[4] & 0xE0) == 0xC0) {
-                j += 2;
-            } else if( (userdata->buffer.x[4] & 0xF0) == 0xE0) {
-                j += 3;
-            } else if( (userdata->buffer.x[4] & 0xF8) == 0xF0) {
-                j += 4;
-            } else if( (userdata->buffer.x[4] & 0xFC) == 0xF8) {
-                j += 5;
-            } else if( (userdata->buffer.x[4] & 0xFE) == 0xFC) {
-                j += 6;
-            } else if( (userdata->buffer.x[4] & 0xFF) == 0xFE) {
-                j += 7;
-            }
+            j = 4 + frame_number_len(userdata->buffer.x[4]);
             userdata->packet.duration = unpack_u16be(&userdata->buffer.x[j]) + 1;
             break;
         }
@@ -474,7 +594,7 @@ static int plugin_run(void* ud, const tag_handler* thandler, const packet_receiv
     r = receiver->submit_packet(receiver->handle, &userdata->packet);
 
     userdata->packet.pts += (uint64_t)userdata->packet.duration;
-    membuf_trim(&userdata->buffer,i);
+    bytequeue_consume(&userdata->buffer,i);
 
     return r;
 }
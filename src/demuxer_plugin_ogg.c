@@ -8,6 +8,8 @@
 
 #define MINIOGG_API static
 #include "miniogg.h"
+#include "crc32.h"
+#include "bytequeue.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -64,14 +66,15 @@ struct plugin_userdata {
     input* input;
     uint32_t serialno;
     membuf scratch;
-    membuf buffer;
+    bytequeue buffer;
     miniogg ogg;
+    membuf pktbuf; /* only used for packets continued across pages */
     packet packet;
-    size_t bufpos;
     OGG_TYPE oggtype;
     taglist tags;
     uint8_t ignore_tags;
     uint8_t empty_tags;
+    uint8_t resync; /* set after skipping data, until we're on a packet boundary again */
     uint64_t granulepos;
     uint64_t granuleoffset;
     packet_source me;
@@ -87,7 +90,7 @@ static size_t buffer_read(plugin_userdata* userdata, size_t len) {
     size_t r;
     int t;
 
-    if( (t = membuf_readyplus(&userdata->buffer,len)) != 0) {
+    if( (t = bytequeue_readyplus(&userdata->buffer,len)) != 0) {
         logs_fatal("error allocating buffer");
         return 0;
     }
@@ -121,10 +124,40 @@ static unsigned int opus_get_duration(const uint8_t* packet, size_t packetlen) {
     return duration;
 }
 
+/* reads until at least len bytes are buffered, returns 1 at end-of-file */
+static int buffer_fill(plugin_userdata* userdata, size_t len) {
+    while(userdata->buffer.len < len) {
+        if(buffer_read(userdata,4096) == 0) return 1;
+    }
+    return 0;
+}
+
+/* drops the first byte of the buffer, then everything up to the next
+ * capture pattern (or what could be the start of one) */
+static void buffer_resync(plugin_userdata* userdata) {
+    const uint8_t* x;
+    const uint8_t* e;
+    const uint8_t* p;
+
+    bytequeue_consume(&userdata->buffer, 1);
+
+    x = userdata->buffer.x;
+    e = userdata->buffer.x + userdata->buffer.len;
+    while( (p = memchr(x, 'O', e - x)) != NULL) {
+        if(e - p < 4 || memcmp(p, "OggS", 4) == 0) break;
+        x = p + 1;
+    }
+    if(p == NULL) p = e;
+
+    bytequeue_consume(&userdata->buffer, p - userdata->buffer.x);
+    userdata->resync = 1;
+}
+
 static int loadpage(plugin_userdata* userdata) {
     int r = 0;
     size_t used = 0;
-    size_t re = 0;
+    size_t pagelen = 0;
+    size_t skipped = 0;
     size_t firstpacket = 0;
     size_t i = 0;
     const uint8_t* packet = NULL;
@@ -133,13 +166,27 @@ static int loadpage(plugin_userdata* userdata) {
     uint8_t cont = 0;
     uint64_t offset = 0;
 
-    while( (r = miniogg_add_page(&userdata->ogg, &userdata->buffer.x[userdata->bufpos],userdata->buffer.len - userdata->bufpos, &used)) == 1) {
-        userdata->bufpos = 0;
-        userdata->buffer.len = 0;
-        if( (re = buffer_read(userdata,4096)) == 0) {
-            break; /* will return 1 == end-of-file */
+    /* the header says exactly how long the page is, so we buffer the
+     * whole thing before handing it to miniogg. If it turns out to be
+     * bad it's still in the buffer, and we can skip ahead to the next
+     * capture pattern instead of giving up */
+    for(;;) {
+        if( (r = buffer_fill(userdata, MINIOGG_HEADER_SIZE)) != 0) break;
+        if(memcmp(userdata->buffer.x, "OggS", 4) == 0) {
+            pagelen = MINIOGG_HEADER_SIZE + (size_t)userdata->buffer.x[26];
+            if( (r = buffer_fill(userdata, pagelen)) != 0) break;
+            for(i = MINIOGG_HEADER_SIZE; i < MINIOGG_HEADER_SIZE + (size_t)userdata->buffer.x[26]; i++) {
+                pagelen += userdata->buffer.x[i];
+            }
+            if( (r = buffer_fill(userdata, pagelen)) != 0) break;
+            if( (r = miniogg_add_page(&userdata->ogg, userdata->buffer.x, pagelen, &used)) == 0) break;
         }
+
+        i = userdata->buffer.len;
+        buffer_resync(userdata);
+        skipped += i - userdata->buffer.len;
     }
+    if(skipped) log_warn("lost sync, skipped %zu bytes", skipped);
     if(r != 0) return r;
 
     if(userdata->granuleoffset == ~0ULL && userdata->ogg.granulepos != ~0ULL && userdata->ogg.granulepos > 0) {
@@ -172,10 +219,21 @@ static int loadpage(plugin_userdata* userdata) {
         }
     }
 
-    userdata->bufpos += used;
+    bytequeue_consume(&userdata->buffer, used);
     return 0;
 }
 
+/* packets that fit on a single page are handed out as a view
+ * into the page body, which stays put until the next loadpage().
+ * That only happens in getpacket(), after the receiver has
+ * returned. Packets continued across pages get copied together
+ * in pktbuf. Either way packet.data never owns its memory. */
+static void setpacket(plugin_userdata* userdata, const uint8_t* data, size_t datalen) {
+    userdata->packet.data.x = (uint8_t*)data;
+    userdata->packet.data.len = datalen;
+    userdata->packet.data.a = 0;
+}
+
 static int getpacket(plugin_userdata* userdata) {
     int r;
 
@@ -183,7 +241,7 @@ static int getpacket(plugin_userdata* userdata) {
     size_t datalen;
     uint8_t cont = 1;
 
-    membuf_reset(&userdata->packet.data);
+    membuf_reset(&userdata->pktbuf);
 
     while(cont) {
         while( (data = miniogg_iter_packet(&userdata->ogg, &datalen, &userdata->granulepos, &cont)) == NULL) {
@@ -202,14 +260,30 @@ static int getpacket(plugin_userdata* userdata) {
             while(userdata->ogg.serialno != userdata->serialno) {
                 if( (r = loadpage(userdata)) != 0) return r;
             }
+
+            if(userdata->resync) {
+                /* whatever we had of a packet is gone, and if this page
+                 * starts with the rest of one we can't use it either */
+                membuf_reset(&userdata->pktbuf);
+                if(userdata->ogg.continuation) {
+                    if(miniogg_iter_packet(&userdata->ogg, &datalen, &userdata->granulepos, &cont) != NULL && cont) continue;
+                }
+                userdata->resync = 0;
+            }
+        }
+
+        if(cont == 0 && userdata->pktbuf.len == 0) {
+            setpacket(userdata, data, datalen);
+            return 0;
         }
 
-        if( (r = membuf_append(&userdata->packet.data, data, datalen)) != 0) {
+        if( (r = membuf_append(&userdata->pktbuf, data, datalen)) != 0) {
             logs_fatal("error appending packet to buffer");
             return r;
         }
     }
 
+    setpacket(userdata, userdata->pktbuf.x, userdata->pktbuf.len);
     return 0;
 }
 
@@ -226,16 +300,17 @@ static int plugin_create(void* ud) {
 
     miniogg_init(&userdata->ogg,0);
 
-    userdata->bufpos = 0;
     userdata->oggtype = OGG_TYPE_UNKNOWN;
 
-    membuf_init(&userdata->buffer);
+    bytequeue_init(&userdata->buffer);
     membuf_init(&userdata->scratch);
+    membuf_init(&userdata->pktbuf);
     packet_init(&userdata->packet);
     taglist_init(&userdata->tags);
 
     userdata->ignore_tags = 0;
     userdata->empty_tags = 0;
+    userdata->resync = 0;
     userdata->granuleoffset = ~0ULL;
     userdata->me = packet_source_zero;
 
@@ -245,8 +320,9 @@ static int plugin_create(void* ud) {
 static void plugin_close(void* ud) {
     plugin_userdata* userdata = (plugin_userdata*)ud;
 
-    membuf_free(&userdata->buffer);
+    bytequeue_free(&userdata->buffer);
     membuf_free(&userdata->scratch);
+    membuf_free(&userdata->pktbuf);
     packet_free(&userdata->packet);
     taglist_free(&userdata->tags);
     packet_source_free(&userdata->me);
@@ -292,6 +368,24 @@ static int plugin_config(void* ud, const strbuf* key, const strbuf* value) {
         return -1;
     }
 
+    if(strbuf_equals_cstr(key,"verify")) {
+        if(strbuf_truthy(value) || strbuf_caseequals_cstr(value,"full")) {
+            userdata->ogg.verify = MINIOGG_VERIFY_FULL;
+            return 0;
+        }
+        if(strbuf_caseequals_cstr(value,"headers")) {
+            userdata->ogg.verify = MINIOGG_VERIFY_HEADERS;
+            return 0;
+        }
+        if(strbuf_falsey(value) || strbuf_caseequals_cstr(value,"none")) {
+            userdata->ogg.verify = MINIOGG_VERIFY_NONE;
+            return 0;
+        }
+        log_error("unknown value for key %.*s: %.*s",
+          (int)key->len,(char *)key->x,(int)value->len,(char *)value->x);
+        return -1;
+    }
+
     log_error("unknown key %.*s",
       (int)key->len,(char *)key->x);
     return -1;
@@ -800,5 +894,6 @@ const demuxer_plugin demuxer_plugin_ogg = {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-function"
 #define MINIOGG_IMPLEMENTATION
+#define MINIOGG_CRC32 crc32_update
 #include "miniogg.h"
 #pragma GCC diagnostic pop
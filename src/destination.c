@@ -1,4 +1,5 @@
 #include "destination.h"
+#include "affinity.h"
 
 #define CONFIGURING_UNKNOWN 0
 #define CONFIGURING_FILTER 1
@@ -32,6 +33,7 @@ void destination_init(destination* dest) {
     strbuf_init(&dest->tagmap_id);
     filter_init(&dest->filter);
     encoder_init(&dest->encoder);
+    encoder_batch_init(&dest->batch);
     muxer_init(&dest->muxer);
     output_init(&dest->output);
     dest->source = NULL;
@@ -42,14 +44,23 @@ void destination_init(destination* dest) {
     dest->map_flags.passthrough = 0;
     dest->image_mode = 0;
     dest->samplefmt = SAMPLEFMT_UNKNOWN;
+    strbuf_init(&dest->chain);
+    dest->share_encoder = 0;
+    membuf_init(&dest->followers);
+    dest->leader = NULL;
+    output_sync_init(&dest->output_sync);
 }
 
 void destination_free(destination* dest) {
     strbuf_free(&dest->source_id);
     filter_free(&dest->filter);
+    encoder_batch_free(&dest->batch);
     encoder_free(&dest->encoder);
     muxer_free(&dest->muxer);
     output_free(&dest->output);
+    strbuf_free(&dest->chain);
+    membuf_free(&dest->followers);
+    output_sync_free(&dest->output_sync);
     return;
 }
 
@@ -74,19 +85,216 @@ int destination_reset(const destination* dest) {
     return filter_reset(&dest->filter);
 }
 
-int destination_close(const destination* dest) {
+/* with an output thread, waits for the flush to be written out */
+static int destination_output_flush(destination* dest) {
     int r;
+    if(dest->output_sync.depth == 0) return output_flush(&dest->output);
+    if( (r = output_sync_flush(&dest->output_sync)) != 0) return r;
+    return output_sync_drain(&dest->output_sync);
+}
+
+int destination_close(destination* dest) {
+    int r;
+    size_t i;
+    size_t len;
+    destination** followers;
 
     if( (r = filter_flush(&dest->filter)) != 0) return r;
-    if( (r = encoder_flush(&dest->encoder)) != 0) return r;
+    if(dest->batch.jobs != NULL) {
+        if( (r = encoder_batch_flush(&dest->batch)) != 0) return r;
+    } else {
+        if( (r = encoder_flush(&dest->encoder)) != 0) return r;
+    }
     if( (r = muxer_flush(&dest->muxer)) != 0) return r;
-    return output_flush(&dest->output);
+    if( (r = destination_output_flush(dest)) != 0) return r;
+
+    len = dest->followers.len / sizeof(destination*);
+    followers = (destination**)dest->followers.x;
+    for(i=0;i<len;i++) {
+        if( (r = muxer_flush(&followers[i]->muxer)) != 0) return r;
+        if( (r = destination_output_flush(followers[i])) != 0) return r;
+    }
+    return 0;
 }
 
 int destination_submit_tags(destination* dest, const taglist* tags) {
+    if(dest->batch.jobs != NULL) return encoder_batch_submit_tags(&dest->batch, tags);
     return encoder_submit_tags(&dest->encoder, tags);
 }
 
+/* when other destinations share our encoder, the encoder's packets
+ * go through these functions and are handed to every muxer */
+static int destination_packets_open(void* handle, const packet_source* source) {
+    int r;
+    size_t i;
+    size_t len;
+    uint32_t caps;
+    destination* dest = (destination*)handle;
+    destination** followers = (destination**)dest->followers.x;
+
+    len = dest->followers.len / sizeof(destination*);
+    caps = muxer_get_caps(&dest->muxer);
+
+    for(i=0;i<len;i++) {
+        if(muxer_get_caps(&followers[i]->muxer) != caps) {
+            fprintf(stderr,"[destination] muxers sharing an encoder have different capabilities, set share-encoder = false on one of them\n");
+            return -1;
+        }
+    }
+
+    if( (r = muxer_open(&dest->muxer, source)) != 0) return r;
+    for(i=0;i<len;i++) {
+        if( (r = muxer_open(&followers[i]->muxer, source)) != 0) return r;
+    }
+    return 0;
+}
+
+static int destination_packets_submit_packet(void* handle, const packet* packet) {
+    int r;
+    size_t i;
+    size_t len;
+    destination* dest = (destination*)handle;
+    destination** followers = (destination**)dest->followers.x;
+
+    len = dest->followers.len / sizeof(destination*);
+
+    if( (r = muxer_submit_packet(&dest->muxer, packet)) != 0) return r;
+    for(i=0;i<len;i++) {
+        if( (r = muxer_submit_packet(&followers[i]->muxer, packet)) != 0) return r;
+    }
+    return 0;
+}
+
+static int destination_packets_submit_tags(void* handle, const taglist* tags) {
+    int r;
+    size_t i;
+    size_t len;
+    destination* dest = (destination*)handle;
+    destination** followers = (destination**)dest->followers.x;
+
+    len = dest->followers.len / sizeof(destination*);
+
+    if( (r = muxer_submit_tags(&dest->muxer, tags)) != 0) return r;
+    for(i=0;i<len;i++) {
+        if( (r = muxer_submit_tags(&followers[i]->muxer, tags)) != 0) return r;
+    }
+    return 0;
+}
+
+static int destination_packets_flush(void* handle) {
+    int r;
+    size_t i;
+    size_t len;
+    destination* dest = (destination*)handle;
+    destination** followers = (destination**)dest->followers.x;
+
+    len = dest->followers.len / sizeof(destination*);
+
+    if( (r = muxer_flush(&dest->muxer)) != 0) return r;
+    for(i=0;i<len;i++) {
+        if( (r = muxer_flush(&followers[i]->muxer)) != 0) return r;
+    }
+    return 0;
+}
+
+static int destination_packets_reset(void* handle) {
+    int r;
+    size_t i;
+    size_t len;
+    destination* dest = (destination*)handle;
+    destination** followers = (destination**)dest->followers.x;
+
+    len = dest->followers.len / sizeof(destination*);
+
+    if( (r = muxer_reset(&dest->muxer)) != 0) return r;
+    for(i=0;i<len;i++) {
+        if( (r = muxer_reset(&followers[i]->muxer)) != 0) return r;
+    }
+    return 0;
+}
+
+static uint32_t destination_packets_get_caps(void* handle) {
+    destination* dest = (destination*)handle;
+    return muxer_get_caps(&dest->muxer);
+}
+
+static int destination_packets_get_segment_info(const void* handle, const packet_source_info* info, packet_source_params* params) {
+    int r;
+    size_t i;
+    size_t len;
+    packet_source_params p;
+    const destination* dest = (const destination*)handle;
+    destination** followers = (destination**)dest->followers.x;
+
+    len = dest->followers.len / sizeof(destination*);
+
+    if( (r = muxer_get_segment_info(&dest->muxer, info, params)) != 0) return r;
+
+    /* the encoder can only be set up for one segmenting scheme */
+    for(i=0;i<len;i++) {
+        p = *params;
+        if( (r = muxer_get_segment_info(&followers[i]->muxer, info, &p)) != 0) return r;
+        if(p.segment_length != params->segment_length ||
+           p.packets_per_segment != params->packets_per_segment ||
+           p.subsegment_length != params->subsegment_length ||
+           p.packets_per_subsegment != params->packets_per_subsegment) {
+            fprintf(stderr,"[destination] muxers sharing an encoder have different segment settings, set share-encoder = false on one of them\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int destination_can_share(const destination* leader, const destination* follower) {
+    if(!leader->share_encoder || !follower->share_encoder) return 0;
+    if(leader->leader != NULL || follower->leader != NULL) return 0;
+    if(follower->followers.len != 0) return 0;
+    if(!strbuf_equals(&leader->source_id, &follower->source_id)) return 0;
+    if(!strbuf_equals(&leader->tagmap_id, &follower->tagmap_id)) return 0;
+    if(leader->map_flags.mergemode != follower->map_flags.mergemode) return 0;
+    if(leader->map_flags.unknownmode != follower->map_flags.unknownmode) return 0;
+    if(leader->map_flags.passthrough != follower->map_flags.passthrough) return 0;
+    if(leader->batch.len != follower->batch.len) return 0;
+    if(!strbuf_equals(&leader->chain, &follower->chain)) return 0;
+
+    /* the muxers aren't opened yet so we can't ask them for caps, but
+     * different muxer plugins (fmp4 vs adts, etc) will want different
+     * things from the encoder - the segment settings still have to
+     * match, that's checked when the encoder opens */
+    if(leader->muxer.plugin != follower->muxer.plugin) {
+        fprintf(stderr,"[destination] not sharing an encoder between different muxers\n");
+        return 0;
+    }
+    return 1;
+}
+
+int destination_add_follower(destination* leader, destination* follower) {
+    int r;
+    if( (r = membuf_append(&leader->followers, &follower, sizeof(destination*))) != 0) return r;
+    follower->leader = leader;
+    return 0;
+}
+
+/* records a filter/encoder setting so we can compare chains later */
+static int destination_chain_append(destination* dest, const char* stage, const strbuf* key, const strbuf* val) {
+    int r;
+    if( (r = strbuf_append_cstr(&dest->chain, stage)) != 0) return r;
+    if( (r = strbuf_append(&dest->chain, "\0", 1)) != 0) return r;
+    if(key != NULL) {
+        if( (r = strbuf_cat(&dest->chain, key)) != 0) return r;
+    }
+    if( (r = strbuf_append(&dest->chain, "\0", 1)) != 0) return r;
+    if( (r = strbuf_cat(&dest->chain, val)) != 0) return r;
+    return strbuf_append(&dest->chain, "\n", 1);
+}
+
+static int destination_encoder_config(destination* dest, const strbuf* key, const strbuf* val) {
+    int r;
+    if( (r = destination_chain_append(dest,"encoder",key,val)) != 0) return r;
+    if( (r = encoder_batch_config(&dest->batch,key,val)) != 0) return r;
+    return encoder_config(&dest->encoder,key,val);
+}
+
 int destination_create(destination* dest, const ich_time* now) {
     int r;
 
@@ -96,15 +304,16 @@ int destination_create(destination* dest, const ich_time* now) {
         return -1;
     }
 
-    /* for everything else, create a default if not given */
-    if(dest->filter.plugin == NULL) {
+    /* for everything else, create a default if not given - if we're
+     * sharing another destination's encoder we don't need our own */
+    if(dest->leader == NULL && dest->filter.plugin == NULL) {
         if( (r = filter_create(&dest->filter, &DEFAULT_FILTER)) != 0) {
             fprintf(stderr,"[destination] unable to create filter plugin\n");
             return r;
         }
     }
 
-    if(dest->encoder.plugin == NULL) {
+    if(dest->leader == NULL && dest->encoder.plugin == NULL) {
         if( (r = encoder_create(&dest->encoder, &DEFAULT_ENCODER)) != 0) {
             fprintf(stderr,"[destination] unable to create encoder plugin\n");
             return r;
@@ -139,6 +348,30 @@ int destination_create(destination* dest, const ich_time* now) {
     dest->encoder.packet_receiver.get_segment_info      = (packet_receiver_get_segment_info_cb)muxer_get_segment_info;
     dest->encoder.packet_receiver.handle        = &dest->muxer;
 
+    if(dest->followers.len != 0) {
+        dest->encoder.packet_receiver.open          = destination_packets_open;
+        dest->encoder.packet_receiver.submit_packet = destination_packets_submit_packet;
+        dest->encoder.packet_receiver.submit_tags   = destination_packets_submit_tags;
+        dest->encoder.packet_receiver.flush         = destination_packets_flush;
+        dest->encoder.packet_receiver.reset         = destination_packets_reset;
+        dest->encoder.packet_receiver.get_caps      = destination_packets_get_caps;
+        dest->encoder.packet_receiver.get_segment_info = destination_packets_get_segment_info;
+        dest->encoder.packet_receiver.handle        = dest;
+    }
+
+    if(dest->leader == NULL && dest->batch.len != 0) {
+        if( (r = encoder_batch_create(&dest->batch, &dest->encoder)) != 0) {
+            fprintf(stderr,"[destination] unable to set up batch encoding\n");
+            return r;
+        }
+
+        dest->filter.frame_receiver.open          = (frame_receiver_open_cb)encoder_batch_open;
+        dest->filter.frame_receiver.submit_frame  = (frame_receiver_submit_frame_cb)encoder_batch_submit_frame;
+        dest->filter.frame_receiver.flush         = (frame_receiver_flush_cb)encoder_batch_flush;
+        dest->filter.frame_receiver.reset         = (frame_receiver_reset_cb)encoder_batch_reset;
+        dest->filter.frame_receiver.handle        = &dest->batch;
+    }
+
     dest->muxer.segment_receiver.open                = (segment_receiver_open_cb)output_open;
     dest->muxer.segment_receiver.submit_segment      = (segment_receiver_submit_segment_cb)output_submit_segment;
     dest->muxer.segment_receiver.submit_tags      = (segment_receiver_submit_tags_cb)output_submit_tags;
@@ -152,6 +385,24 @@ int destination_create(destination* dest, const ich_time* now) {
     dest->muxer.picture_handler.cb       = (picture_handler_callback)output_submit_picture;
     dest->muxer.picture_handler.userdata = &dest->output;
 
+    if(dest->output_sync.depth != 0) {
+        if( (r = output_sync_create(&dest->output_sync, &dest->output)) != 0) {
+            fprintf(stderr,"[destination] unable to allocate output queue\n");
+            return r;
+        }
+
+        dest->muxer.segment_receiver.open             = (segment_receiver_open_cb)output_sync_open;
+        dest->muxer.segment_receiver.submit_segment   = (segment_receiver_submit_segment_cb)output_sync_submit_segment;
+        dest->muxer.segment_receiver.submit_tags      = (segment_receiver_submit_tags_cb)output_sync_submit_tags;
+        dest->muxer.segment_receiver.flush            = (segment_receiver_flush_cb)output_sync_flush;
+        dest->muxer.segment_receiver.reset            = (segment_receiver_reset_cb)output_sync_reset;
+        dest->muxer.segment_receiver.get_segment_info = (segment_receiver_get_segment_info_cb)output_sync_get_segment_info;
+        dest->muxer.segment_receiver.handle           = &dest->output_sync;
+
+        dest->muxer.picture_handler.cb       = (picture_handler_callback)output_sync_submit_picture;
+        dest->muxer.picture_handler.userdata = &dest->output_sync;
+    }
+
     return 0;
 }
 
@@ -159,6 +410,7 @@ int destination_config(destination* dest, const strbuf* key, const strbuf* val)
     strbuf t = STRBUF_ZERO;
     int r = -1;
     int f;
+    unsigned long depth;
 
     if(strbuf_equals_cstr(key,"source")) {
         if( (r = strbuf_copy(&dest->source_id,val)) != 0) return r;
@@ -257,13 +509,77 @@ int destination_config(destination* dest, const strbuf* key, const strbuf* val)
         return -1;
     }
 
+    if(strbuf_equals_cstr(key,"share-encoder") || strbuf_equals_cstr(key,"share encoder")) {
+        if(strbuf_truthy(val)) {
+            dest->share_encoder = 1;
+            return 0;
+        }
+        if(strbuf_falsey(val)) {
+            dest->share_encoder = 0;
+            return 0;
+        }
+        fprintf(stderr,"[destination] unknown configuration value %.*s for option %.*s\n",
+          (int)val->len,(const char *)val->x,
+          (int)key->len,(const char *)key->x);
+        return -1;
+    }
+
+    /* hand segments to the output on a separate thread, so a slow
+     * upload doesn't hold up encoding. Either true/false, or the
+     * number of segments to queue */
+    if(strbuf_equals_cstr(key,"async-output") || strbuf_equals_cstr(key,"async output")) {
+        depth = strbuf_strtoul(val,10);
+        if(depth > 0 && depth <= OUTPUT_SYNC_MAX_DEPTH) {
+            dest->output_sync.depth = (size_t)depth;
+            return 0;
+        }
+        if(depth == 0 && strbuf_truthy(val)) {
+            dest->output_sync.depth = OUTPUT_SYNC_DEFAULT_DEPTH;
+            return 0;
+        }
+        if(depth == 0 && strbuf_falsey(val)) {
+            dest->output_sync.depth = 0;
+            return 0;
+        }
+        fprintf(stderr,"[destination] unknown configuration value %.*s for option %.*s\n",
+          (int)val->len,(const char *)val->x,
+          (int)key->len,(const char *)key->x);
+        return -1;
+    }
+
+    /* encode with several encoder instances at once, for inputs
+     * that can be read faster than realtime. Either a number of
+     * encoders, or "auto" for one per CPU */
+    if(strbuf_equals_cstr(key,"batch")) {
+        depth = strbuf_strtoul(val,10);
+        if(depth > 0 && depth <= ENCODER_BATCH_MAX_JOBS) {
+            dest->batch.len = (size_t)depth;
+            return 0;
+        }
+        if(strbuf_caseequals_cstr(val,"auto")) {
+            dest->batch.len = affinity_cpu_count();
+            if(dest->batch.len > ENCODER_BATCH_MAX_JOBS) dest->batch.len = ENCODER_BATCH_MAX_JOBS;
+            return 0;
+        }
+        if(depth == 0 && strbuf_falsey(val)) {
+            dest->batch.len = 0;
+            return 0;
+        }
+        fprintf(stderr,"[destination] unknown configuration value %.*s for option %.*s\n",
+          (int)val->len,(const char *)val->x,
+          (int)key->len,(const char *)key->x);
+        return -1;
+    }
+
     if(strbuf_equals_cstr(key,"filter")) {
+        if( (r = destination_chain_append(dest,"filter",NULL,val)) != 0) return r;
         if( (r = filter_create(&dest->filter,val)) != 0) return r;
         dest->configuring = CONFIGURING_FILTER;
         return 0;
     }
 
     if(strbuf_equals_cstr(key,"encoder")) {
+        if( (r = destination_chain_append(dest,"encoder",NULL,val)) != 0) return r;
         if( (r = encoder_create(&dest->encoder,val)) != 0) return r;
         dest->configuring = CONFIGURING_ENCODER;
         return 0;
@@ -284,12 +600,13 @@ int destination_config(destination* dest, const strbuf* key, const strbuf* val)
     if(strbuf_begins_cstr(key,"filter-")) {
         t.x = &key->x[7];
         t.len = key->len - 7;
+        if( (r = destination_chain_append(dest,"filter",&t,val)) != 0) return r;
         return filter_config(&dest->filter,&t,val);
     }
     if(strbuf_begins_cstr(key,"encoder-")) {
         t.x = &key->x[8];
         t.len = key->len - 8;
-        return encoder_config(&dest->encoder,&t,val);
+        return destination_encoder_config(dest,&t,val);
     }
     if(strbuf_begins_cstr(key,"muxer-")) {
         t.x = &key->x[6];
@@ -303,8 +620,13 @@ int destination_config(destination* dest, const strbuf* key, const strbuf* val)
     }
 
     switch(dest->configuring) {
-        case CONFIGURING_FILTER: return filter_config(&dest->filter,key,val);
-        case CONFIGURING_ENCODER: return encoder_config(&dest->encoder,key,val);
+        case CONFIGURING_FILTER: {
+            if( (r = destination_chain_append(dest,"filter",key,val)) != 0) return r;
+            return filter_config(&dest->filter,key,val);
+        }
+        case CONFIGURING_ENCODER: {
+            return destination_encoder_config(dest,key,val);
+        }
         case CONFIGURING_MUXER: return muxer_config(&dest->muxer,key,val);
         case CONFIGURING_OUTPUT: return output_config(&dest->output,key,val);
         case CONFIGURING_UNKNOWN: /* fall-through */
@@ -317,8 +639,16 @@ int destination_config(destination* dest, const strbuf* key, const strbuf* val)
 }
 
 void destination_dump_counters(const destination* dest, const strbuf* prefix) {
-    filter_dump_counters(&dest->filter,prefix);
-    encoder_dump_counters(&dest->encoder,prefix);
+    if(dest->leader == NULL) {
+        filter_dump_counters(&dest->filter,prefix);
+        encoder_dump_counters(&dest->encoder,prefix);
+        if(dest->batch.jobs != NULL) {
+            encoder_batch_dump_counters(&dest->batch,prefix);
+        }
+    }
     muxer_dump_counters(&dest->muxer,prefix);
     output_dump_counters(&dest->output,prefix);
+    if(dest->output_sync.depth != 0) {
+        output_sync_dump_counters(&dest->output_sync,prefix);
+    }
 }
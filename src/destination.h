@@ -23,8 +23,10 @@
 #include "thread.h"
 #include "filter.h"
 #include "encoder.h"
+#include "encoder_batch.h"
 #include "muxer.h"
 #include "output.h"
+#include "output_sync.h"
 #include "tagmap.h"
 #include "imagemode.h"
 #include "ich_time.h"
@@ -39,6 +41,8 @@ struct destination {
                       minimum, it will be allocated to handle format
                       conversions and buffering, if nothing else */
     encoder encoder;
+    encoder_batch batch; /* if its length is set, frames are encoded
+                            in parallel chunks */
     muxer muxer;
     output output;
     uint8_t configuring;
@@ -46,6 +50,16 @@ struct destination {
     image_mode image_mode;
     samplefmt samplefmt; /* cached samplefmt, used to drive how we handle
                   open and flush calls */
+    strbuf chain; /* filter and encoder settings, used to find destinations
+                     that would produce identical packets */
+    uint8_t share_encoder; /* if set, we can share our filter/encoder with
+                              (or use the filter/encoder of) other destinations,
+                              off by default since the muxers also need the
+                              same segment settings */
+    membuf followers; /* destinations receiving packets from our encoder */
+    struct destination* leader; /* if set, the destination whose encoder feeds our muxer */
+    output_sync output_sync; /* if its depth is set, segments are handed to
+                                the output on a separate thread */
 };
 
 typedef struct destination destination;
@@ -66,12 +80,20 @@ int destination_config(destination*, const strbuf* key, const strbuf* val);
 
 int destination_create(destination*, const ich_time* now);
 
+/* returns 1 if the two destinations have the same source, filter,
+ * encoder, and tag settings, meaning one encoder can feed both */
+int destination_can_share(const destination* leader, const destination* follower);
+
+/* makes the follower's muxer receive packets from the leader's encoder,
+ * the follower no longer receives frames on its own */
+int destination_add_follower(destination* leader, destination* follower);
+
 int destination_open(destination*, const frame_source* source);
 
 int destination_submit_frame(destination*, const frame* frame);
 int destination_flush(const destination*);
 int destination_reset(const destination*);
-int destination_close(const destination*);
+int destination_close(destination*);
 int destination_submit_tags(destination*, const taglist* tags);
 
 void destination_run(void*);
@@ -1,155 +1,219 @@
 #include "destination_sync.h"
 
 #include <stddef.h>
+#include <stdlib.h>
+
+#define LOG_PREFIX "[queue]"
+#include "logger.h"
 
 void destination_sync_init(destination_sync* sync) {
-    thread_atomic_int_store(&sync->type, DESTINATION_SYNC_UNKNOWN);
     thread_atomic_int_store(&sync->status, 0);
-    thread_atomic_ptr_store(&sync->data, NULL);
+    thread_atomic_int_store(&sync->quit, 0);
+    thread_atomic_int_store(&sync->count, 0);
+    thread_atomic_int_store(&sync->queued, 0);
+    thread_atomic_int_store(&sync->producer_waiting, 0);
+    thread_atomic_int_store(&sync->consumer_waiting, 0);
+    sync->wakeup = NULL;
+    sync->msgs = NULL;
+    sync->depth = DESTINATION_SYNC_DEFAULT_DEPTH;
+    sync->depth_ms = 0;
+    sync->head = 0;
+    sync->tail = 0;
     sync->on_tags.cb = NULL;
     sync->on_tags.userdata = NULL;
     sync->frame_receiver = frame_receiver_zero;
     sync->tagmap = NULL;
     sync->map_flags = NULL;
+    sync->task = NULL;
+    sync->pool = NULL;
+    sync->lag_policy = DESTINATION_SYNC_LAG_BLOCK;
+    sync->lagging = 0;
+    sync->has_pending_tags = 0;
+    sync->dropped = 0;
+    sync->lag_events = 0;
+    sync->max_lag = 0;
+    taglist_init(&sync->id3_tags);
+    taglist_init(&sync->pending_tags);
 
     thread_signal_init(&sync->ready);
     thread_signal_init(&sync->consumed);
 }
 
 void destination_sync_free(destination_sync* sync) {
+    size_t i;
+
+    if(sync->msgs != NULL) {
+        for(i=0;i<sync->depth;i++) {
+            /* any frame references left in the ring belong to
+             * the source's pool, which frees them */
+            frame_source_free(&sync->msgs[i].source);
+            taglist_free(&sync->msgs[i].tags);
+        }
+        free(sync->msgs);
+        sync->msgs = NULL;
+    }
+
+    taglist_free(&sync->id3_tags);
+    taglist_free(&sync->pending_tags);
+
     thread_signal_term(&sync->ready);
     thread_signal_term(&sync->consumed);
 }
 
-int destination_sync_run(destination_sync *sync) {
-    int ret = -1;
+int destination_sync_create(destination_sync* sync) {
+    size_t i;
+
+    /* the source may have already pointed us at its own signal */
+    if(sync->wakeup == NULL) sync->wakeup = &sync->consumed;
+
+    if(sync->depth_ms != 0) sync->depth = DESTINATION_SYNC_MAX_DEPTH;
+
+    sync->msgs = (destination_sync_msg*)malloc(sizeof(destination_sync_msg) * sync->depth);
+    if(sync->msgs == NULL) return -1;
+
+    for(i=0;i<sync->depth;i++) {
+        sync->msgs[i].type = DESTINATION_SYNC_UNKNOWN;
+        frame_source_init(&sync->msgs[i].source);
+        sync->msgs[i].frame = NULL;
+        taglist_init(&sync->msgs[i].tags);
+        sync->msgs[i].duration = 0;
+    }
+
+    return 0;
+}
+
+/* releases the slot at the head of the ring back to the source thread */
+static void destination_sync_release(destination_sync* sync, destination_sync_msg* msg) {
+    sync->head = (sync->head + 1) % sync->depth;
+    thread_atomic_int_sub(&sync->queued, msg->duration);
+    thread_atomic_int_dec(&sync->count);
+    if(thread_atomic_int_load(&sync->producer_waiting)) {
+        thread_signal_raise(sync->wakeup);
+    }
+}
+
+/* records the final status, in case the source thread
+ * is still trying to push to us */
+static worker_task_state destination_sync_finish(destination_sync* sync, int ret) {
+    thread_atomic_int_store(&sync->status,ret);
+    thread_signal_raise(sync->wakeup);
+    return WORKER_TASK_DONE;
+}
 
-    frame_source src;
-    frame f;
-    taglist tags;
-    taglist id3_tags;
+worker_task_state destination_sync_step(destination_sync *sync, size_t budget) {
+    destination_sync_msg* msg;
     taglist* cur_tags;
-    destination_sync_type type;
 
-    type = DESTINATION_SYNC_UNKNOWN;
-    taglist_init(&tags);
-    taglist_init(&id3_tags);
-    frame_init(&f);
-    frame_source_init(&src);
+    while(budget--) {
+        /* a quit skips whatever is still queued, a normal
+         * shutdown is an EOF message at the end of the ring */
+        if(thread_atomic_int_load(&sync->quit)) {
+            return destination_sync_finish(sync,-2);
+        }
 
-    for(;;) {
-        thread_signal_wait(&sync->ready, THREAD_SIGNAL_WAIT_INFINITE);
-        type = (destination_sync_type)thread_atomic_int_load(&sync->type);
-        switch(type) {
+        if(thread_atomic_int_load(&sync->count) == 0) {
+            return WORKER_TASK_IDLE;
+        }
+
+        msg = &sync->msgs[sync->head];
+
+        switch(msg->type) {
             case DESTINATION_SYNC_QUIT: {
-                ret = -2;
-                goto cleanup;
+                return destination_sync_finish(sync,-2);
             }
             case DESTINATION_SYNC_UNKNOWN: {
-                ret = -1;
-                goto cleanup;
+                return destination_sync_finish(sync,-1);
             }
             case DESTINATION_SYNC_OPEN: {
-                if(frame_source_copy(&src,thread_atomic_ptr_load(&sync->data)) < 0) {
-                    ret = -1;
-                    goto cleanup;
-                }
-
-                thread_atomic_int_store(&sync->status,0);
-                thread_signal_raise(&sync->consumed);
-
-                if(sync->frame_receiver.open(sync->frame_receiver.handle,&src) < 0) {
-                    ret = -1;
-                    goto cleanup;
+                if(sync->frame_receiver.open(sync->frame_receiver.handle,&msg->source) < 0) {
+                    return destination_sync_finish(sync,-1);
                 }
                 break;
             }
             case DESTINATION_SYNC_FRAME: {
-                /* TODO is making a deep copy needed? */
-                if(frame_copy(&f,thread_atomic_ptr_load(&sync->data)) < 0) {
-                    ret = -1;
-                    goto cleanup;
-                }
-
-                thread_atomic_int_store(&sync->status,0);
-                thread_signal_raise(&sync->consumed);
-
-                if(sync->frame_receiver.submit_frame(sync->frame_receiver.handle,&f) < 0) {
-                    ret = -1;
-                    goto cleanup;
+                if(sync->frame_receiver.submit_frame(sync->frame_receiver.handle,&msg->frame->frame) < 0) {
+                    return destination_sync_finish(sync,-1);
                 }
+                frame_ref_release(msg->frame);
+                msg->frame = NULL;
                 break;
             }
             case DESTINATION_SYNC_TAGS: {
-                if(taglist_deep_copy(&tags,thread_atomic_ptr_load(&sync->data)) < 0) {
-                    ret = -1;
-                    goto cleanup;
-                }
-
-                thread_atomic_int_store(&sync->status,0);
-                thread_signal_raise(&sync->consumed);
-
                 if(sync->map_flags->passthrough) {
-                    cur_tags = &tags;
+                    cur_tags = &msg->tags;
                 } else {
-                    if(taglist_map(sync->tagmap,&tags,sync->map_flags,&id3_tags) < 0) {
-                        ret = -1;
-                        goto cleanup;
+                    if(taglist_map(sync->tagmap,&msg->tags,sync->map_flags,&sync->id3_tags) < 0) {
+                        return destination_sync_finish(sync,-1);
                     }
-                    cur_tags = &id3_tags;
+                    cur_tags = &sync->id3_tags;
                 }
 
                 if(sync->on_tags.cb(sync->on_tags.userdata,cur_tags) < 0) {
-                    ret = -1;
-                    goto cleanup;
+                    return destination_sync_finish(sync,-1);
                 }
 
                 break;
             }
 
             case DESTINATION_SYNC_FLUSH: {
-                thread_atomic_int_store(&sync->status,0);
-                thread_signal_raise(&sync->consumed);
-
                 if(sync->frame_receiver.flush(sync->frame_receiver.handle) < 0) {
-                    ret = -1;
-                    goto cleanup;
+                    return destination_sync_finish(sync,-1);
                 }
                 break;
             }
 
             case DESTINATION_SYNC_RESET: {
-                thread_atomic_int_store(&sync->status,0);
-                thread_signal_raise(&sync->consumed);
-
                 if(sync->frame_receiver.reset(sync->frame_receiver.handle) < 0) {
-                    ret = -1;
-                    goto cleanup;
+                    return destination_sync_finish(sync,-1);
                 }
                 break;
             }
 
             case DESTINATION_SYNC_EOF: {
-                thread_atomic_int_store(&sync->status,0);
-                thread_signal_raise(&sync->consumed);
-
-                ret = sync->frame_receiver.close(sync->frame_receiver.handle);
-                goto cleanup;
+                return destination_sync_finish(sync,sync->frame_receiver.close(sync->frame_receiver.handle));
             }
         }
+
+        destination_sync_release(sync, msg);
     }
 
-    cleanup:
+    return WORKER_TASK_BUSY;
+}
 
-    /* store our final status in case the source thread
-     * is still trying to push to us */
-    thread_atomic_int_store(&sync->status,ret);
-    thread_signal_raise(&sync->consumed);
+int destination_sync_park(destination_sync* sync) {
+    thread_atomic_int_store(&sync->consumer_waiting, 1);
+    if(thread_atomic_int_load(&sync->count) == 0 &&
+       thread_atomic_int_load(&sync->quit) == 0) return 1;
 
-    frame_free(&f);
-    taglist_free(&tags);
-    taglist_free(&id3_tags);
+    /* the source queued something as we were parking, if it
+     * saw us waiting then it's already scheduled us */
+    return thread_atomic_int_compare_and_swap(&sync->consumer_waiting, 1, 0) != 1;
+}
 
-    return ret;
+int destination_sync_run(destination_sync *sync) {
+    for(;;) {
+        switch(destination_sync_step(sync, (size_t)-1)) {
+            case WORKER_TASK_DONE: return thread_atomic_int_load(&sync->status);
+            case WORKER_TASK_BUSY: break;
+            case WORKER_TASK_IDLE: {
+                thread_atomic_int_store(&sync->consumer_waiting, 1);
+                if(thread_atomic_int_load(&sync->count) == 0 &&
+                   thread_atomic_int_load(&sync->quit) == 0) {
+                    thread_signal_wait(&sync->ready, THREAD_SIGNAL_WAIT_INFINITE);
+                }
+                thread_atomic_int_store(&sync->consumer_waiting, 0);
+                break;
+            }
+        }
+    }
 }
 
+void destination_sync_dump_counters(const destination_sync* sync, const strbuf* prefix) {
+    log_info("%.*s queue: queued=%d lag=%dms max_lag=%dms dropped=%zu lag_events=%zu",
+      (int)prefix->len,(const char*)prefix->x,
+      thread_atomic_int_load((thread_atomic_int_t*)&sync->count),
+      thread_atomic_int_load((thread_atomic_int_t*)&sync->queued) / 1000,
+      sync->max_lag / 1000,
+      sync->dropped,
+      sync->lag_events);
+}
@@ -4,33 +4,67 @@
 /* this is the core meeting-point between a source
  * thread and a destination thread.
  *
- * A destination thread will (roughly):
- *   * wait on a ready signal
- *   * check the incoming datatype, which can be:
+ * Each destination has a bounded, single-producer/single-consumer
+ * ring of messages. Every message is one of:
  *     an "open" command
- *     a frame reference
- *     a taglist reference
+ *     a frame
+ *     a taglist
  *     a "flush" command
+ *     a "reset" command
  *     an EOF marker
- *   * immediately copy the data into local memory
- *   * set the "everything-is-ok" flag
- *   * raise the consumed signal
  *
- * A source thread will (roughly)
- *   * set the incoming data type
- *   * add a reference to the appropriate datatype
- *   * raise the ready signal
- *   * wait on the consumed signal
- *   * check the "everythng is OK" flag
+ * A source thread will (roughly):
+ *   * check the "everything is OK" flag
+ *   * wait for a free slot if the ring is full
+ *   * copy the data into the slot, frames aren't copied, the
+ *     slot takes a reference to a shared, read-only frame
+ *   * publish the slot, raising the ready signal if the
+ *     destination thread is asleep
+ *
+ * A destination thread (or a worker pool task, see worker_pool.h)
+ * will (roughly):
+ *   * wait on the ready signal if the ring is empty
+ *   * handle the message at the head of the ring, releasing
+ *     its frame reference (if any) when done
+ *   * release the slot, raising the wakeup signal if the
+ *     source thread is waiting for space. The wakeup signal
+ *     is shared by all of a source's destinations so the
+ *     source thread can wait on several rings at once
+ *
+ * Messages are handled in the order they were queued, so the
+ * open/tags/frame/flush/reset/eof ordering is the same as it
+ * was when the two threads ran in lockstep.
+ *
+ * By default a full ring makes the source thread wait, so one slow
+ * destination holds up every other destination of the source. The
+ * lag policy lets a destination fall behind instead:
+ *   block:  the source waits (the default)
+ *   drop:   frames are dropped while the ring is full, once there's
+ *           room again a reset marks the discontinuity. The lag is
+ *           bounded by the queue depth
+ *   detach: once the ring fills up the destination is cut off until
+ *           it has handled everything queued, then it rejoins with a
+ *           reset, starting over on a new segment
+ * Tags that show up while a destination is behind are held and
+ * queued after the reset. Open, flush, reset and EOF always wait.
  *
  * It's imperative that the destination thread set the status
- * flag and raise the consumed signal to keep the source thread
- * from waiting forever.
+ * flag and raise the wakeup signal when it exits, to keep the
+ * source thread from waiting forever on a full ring.
  */
 
 #include "thread.h"
 #include "frame.h"
+#include "frame_ref.h"
 #include "tag.h"
+#include "worker_pool.h"
+
+/* default ring depth, in frames */
+#define DESTINATION_SYNC_DEFAULT_DEPTH 16
+
+/* number of slots allocated when the depth is given in milliseconds,
+ * the duration limit is what bounds the ring in that case */
+#define DESTINATION_SYNC_MAX_DEPTH 1024
 
 enum destination_sync_type {
     DESTINATION_SYNC_QUIT    = -2,
@@ -45,16 +79,54 @@ enum destination_sync_type {
 
 typedef enum destination_sync_type destination_sync_type;
 
+enum destination_sync_lag_policy {
+    DESTINATION_SYNC_LAG_BLOCK  = 0,
+    DESTINATION_SYNC_LAG_DROP   = 1,
+    DESTINATION_SYNC_LAG_DETACH = 2,
+};
+
+typedef enum destination_sync_lag_policy destination_sync_lag_policy;
+
+struct destination_sync_msg {
+    destination_sync_type type;
+    frame_source source;
+    frame_ref* frame; /* shared with the source's other destinations */
+    taglist tags;
+    int duration; /* frame duration in microseconds, used for ms-based depth */
+};
+
+typedef struct destination_sync_msg destination_sync_msg;
+
 struct destination_sync {
-    thread_atomic_int_t type;
     thread_atomic_int_t status;
+    thread_atomic_int_t quit;
+    thread_atomic_int_t count;    /* number of queued messages */
+    thread_atomic_int_t queued;   /* queued audio, in microseconds */
+    thread_atomic_int_t producer_waiting;
+    thread_atomic_int_t consumer_waiting;
     thread_signal_t ready;
     thread_signal_t consumed;
-    thread_atomic_ptr_t data;
+    thread_signal_t* wakeup; /* raised when a slot frees up, shared by a source's destinations */
+    destination_sync_msg* msgs;
+    size_t depth;    /* number of slots in the ring */
+    size_t depth_ms; /* if non-zero, limit queued audio to this many ms */
+    size_t head;     /* only touched by the destination thread */
+    size_t tail;     /* only touched by the source thread */
     tag_handler on_tags;
     frame_receiver frame_receiver;
     const taglist* tagmap;
     const taglist_map_flags* map_flags;
+    taglist id3_tags; /* scratch space for mapped tags */
+    worker_task* task; /* set when running on a worker pool instead of a thread */
+    worker_pool* pool;
+    destination_sync_lag_policy lag_policy;
+    /* lag handling, only touched by the source thread */
+    uint8_t lagging;
+    uint8_t has_pending_tags;
+    taglist pending_tags; /* latest tags seen while lagging */
+    size_t dropped;    /* frames dropped */
+    size_t lag_events; /* number of times we fell behind */
+    int max_lag;       /* most queued audio seen, in microseconds */
 };
 
 typedef struct destination_sync destination_sync;
@@ -66,9 +138,26 @@ extern "C" {
 void destination_sync_init(destination_sync*);
 void destination_sync_free(destination_sync*);
 
+/* allocates the ring, call after configuration and before
+ * either thread starts */
+int destination_sync_create(destination_sync*);
+
 /* the thread's main function */
 int destination_sync_run(destination_sync*);
 
+/* handles up to budget queued messages, returns WORKER_TASK_IDLE
+ * once the ring is empty and WORKER_TASK_DONE once the destination
+ * has finished (the final status is in the status flag) */
+worker_task_state destination_sync_step(destination_sync*, size_t budget);
+
+/* used with a worker pool after a step returns WORKER_TASK_IDLE.
+ * Returns 1 if the destination is parked, the source thread will
+ * schedule it when it queues something. Returns 0 if messages
+ * arrived in the meantime and the caller should keep going */
+int destination_sync_park(destination_sync*);
+
+void destination_sync_dump_counters(const destination_sync*, const strbuf* prefix);
+
 #ifdef __cplusplus
 }
 #endif
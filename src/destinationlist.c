@@ -1,4 +1,5 @@
 #include "destinationlist.h"
+#include "memacct.h"
 #include <stdlib.h>
 
 #include "logger.h"
@@ -21,6 +22,7 @@ void destinationlist_free(destinationlist* dlist) {
     for(i=0;i<len;i++) {
         logger_set_prefix("destination.",12);
         logger_append_prefix((const char *)entry[i].id.x, entry[i].id.len);
+        memacct_set_owner(entry[i].memacct);
         logger_set_level((enum LOG_LEVEL) (entry[i].loglevel == -1 ? 
           logger_get_default_level() : (enum LOG_LEVEL)entry[i].loglevel));
         destinationlist_entry_free(&entry[i]);
@@ -34,6 +36,8 @@ void destinationlist_entry_init(destinationlist_entry* entry) {
     destination_sync_init(&entry->sync);
     destination_init(&entry->destination);
     entry->loglevel = -1;
+    affinity_init(&entry->affinity);
+    entry->memacct = 0;
 }
 
 void destinationlist_entry_free(destinationlist_entry* entry) {
@@ -47,7 +51,9 @@ void destinationlist_entry_dump_counters(const destinationlist_entry* entry) {
     if(strbuf_append_cstr(&tmp,"[destination.")) abort();
     if(strbuf_cat(&tmp,&entry->id)) abort();
     if(strbuf_append_cstr(&tmp,"]")) abort();
+    destination_sync_dump_counters(&entry->sync, &tmp);
     destination_dump_counters(&entry->destination, &tmp);
+    memacct_dump_counters(entry->memacct, &tmp);
     strbuf_free(&tmp);
 }
 
@@ -74,11 +80,13 @@ destinationlist_entry* destinationlist_get(const destinationlist* list, size_t i
 
 int destinationlist_configure(const strbuf* id, const strbuf* key, const strbuf* value, destinationlist* list) {
     int r;
+    unsigned long depth;
     destinationlist_entry empty;
     destinationlist_entry* entry = destinationlist_find(list,id);
 
     if(entry == NULL)  {
         destinationlist_entry_init(&empty);
+        empty.memacct = memacct_owner();
         if( (r = strbuf_copy(&empty.id,id)) != 0 ) {
             fprintf(stderr,"[destinationlist:configure] error allocating id string\n");
             return r;
@@ -93,6 +101,7 @@ int destinationlist_configure(const strbuf* id, const strbuf* key, const strbuf*
 
     logger_set_prefix("destination.",12);
     logger_append_prefix((const char *)entry->id.x, entry->id.len);
+    memacct_set_owner(entry->memacct);
 
     if(strbuf_equals_cstr(key,"loglevel") ||
        strbuf_equals_cstr(key,"log-level") ||
@@ -127,12 +136,130 @@ int destinationlist_configure(const strbuf* id, const strbuf* key, const strbuf*
         return 1;
     }
 
+    /* "auto" uses the same CPUs as our source */
+    if(strbuf_equals_cstr(key,"cpu") ||
+       strbuf_equals_cstr(key,"cpus") ||
+       strbuf_equals_cstr(key,"numa-node") ||
+       strbuf_equals_cstr(key,"numa node")) {
+        if(strbuf_caseequals_cstr(value,"auto")) {
+            entry->affinity.mode = AFFINITY_AUTO;
+            return 0;
+        }
+        if(strbuf_begins_cstr(key,"cpu")) {
+            r = affinity_parse_cpus(&entry->affinity,value);
+        } else {
+            r = affinity_parse_node(&entry->affinity,value);
+        }
+        if(r != 0) {
+            fprintf(stderr,"unknown value %.*s for option %.*s\n",(int)value->len,value->x,
+              (int)key->len,key->x);
+            return 1;
+        }
+        return 0;
+    }
+
+    /* how far the source is allowed to run ahead of this destination,
+     * either a number of frames or a duration like "500ms" */
+    if(strbuf_equals_cstr(key,"queue-depth") ||
+       strbuf_equals_cstr(key,"queue depth")) {
+        depth = strbuf_strtoul(value,10);
+        if(depth == 0) {
+            fprintf(stderr,"unknown value %.*s for option %.*s\n",(int)value->len,value->x,
+              (int)key->len,key->x);
+            return 1;
+        }
+        if(strbuf_caseends_cstr(value,"ms")) {
+            if(depth > 60000) {
+                fprintf(stderr,"value %.*s for option %.*s is too large\n",(int)value->len,value->x,
+                  (int)key->len,key->x);
+                return 1;
+            }
+            entry->sync.depth_ms = depth;
+        } else {
+            if(depth > DESTINATION_SYNC_MAX_DEPTH) {
+                fprintf(stderr,"value %.*s for option %.*s is too large\n",(int)value->len,value->x,
+                  (int)key->len,key->x);
+                return 1;
+            }
+            entry->sync.depth = depth;
+            entry->sync.depth_ms = 0;
+        }
+        return 0;
+    }
+
+    /* what to do when this destination can't keep up with its source,
+     * see destination_sync.h */
+    if(strbuf_equals_cstr(key,"lag-policy") ||
+       strbuf_equals_cstr(key,"lag policy")) {
+        if(strbuf_caseequals_cstr(value,"block")) {
+            entry->sync.lag_policy = DESTINATION_SYNC_LAG_BLOCK;
+            return 0;
+        }
+        if(strbuf_caseequals_cstr(value,"drop")) {
+            entry->sync.lag_policy = DESTINATION_SYNC_LAG_DROP;
+            return 0;
+        }
+        if(strbuf_caseequals_cstr(value,"detach")) {
+            entry->sync.lag_policy = DESTINATION_SYNC_LAG_DETACH;
+            return 0;
+        }
+        fprintf(stderr,"unknown value %.*s for option %.*s\n",(int)value->len,value->x,
+          (int)key->len,key->x);
+        return 1;
+    }
+
     logger_set_level((enum LOG_LEVEL) (entry->loglevel == -1 ? 
       logger_get_default_level() : (enum LOG_LEVEL)entry->loglevel));
 
     return destination_config(&entry->destination,key,value);
 }
 
+int destinationlist_share_encoders(const destinationlist* list) {
+    int r;
+    size_t i;
+    size_t j;
+    size_t len;
+
+    destinationlist_entry* entry = (destinationlist_entry *)list->x;
+    len = list->len / sizeof(destinationlist_entry);
+
+    for(i=1;i<len;i++) {
+        /* a follower runs on its leader's thread, so a destination
+         * that's allowed to fall behind has to have its own */
+        if(entry[i].sync.lag_policy != DESTINATION_SYNC_LAG_BLOCK) continue;
+        for(j=0;j<i;j++) {
+            if(entry[j].sync.lag_policy != DESTINATION_SYNC_LAG_BLOCK) continue;
+            if(!destination_can_share(&entry[j].destination, &entry[i].destination)) continue;
+
+            if( (r = destination_add_follower(&entry[j].destination, &entry[i].destination)) != 0) {
+                fprintf(stderr,"[destinationlist] error allocating follower list\n");
+                return r;
+            }
+            fprintf(stderr,"[destinationlist] destination %.*s using encoder from destination %.*s\n",
+              (int)entry[i].id.len, (char *)entry[i].id.x,
+              (int)entry[j].id.len, (char *)entry[j].id.x);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+void destinationlist_use_workers(const destinationlist* list) {
+    size_t i;
+    size_t len;
+
+    destinationlist_entry* entry = (destinationlist_entry *)list->x;
+    len = list->len / sizeof(destinationlist_entry);
+
+    for(i=0;i<len;i++) {
+        if(entry[i].destination.output_sync.depth != 0) continue;
+        entry[i].destination.output_sync.depth = OUTPUT_SYNC_DEFAULT_DEPTH;
+        fprintf(stderr,"[destinationlist] destination %.*s: using async-output since destinations run on workers\n",
+          (int)entry[i].id.len, (char *)entry[i].id.x);
+    }
+}
+
 int destinationlist_open(const destinationlist* list, const ich_time* now) {
     int r;
     size_t i;
@@ -144,6 +271,7 @@ int destinationlist_open(const destinationlist* list, const ich_time* now) {
     for(i=0;i<len;i++) {
         logger_set_prefix("destination.",12);
         logger_append_prefix((const char *)entry[i].id.x, entry[i].id.len);
+        memacct_set_owner(entry[i].memacct);
         logger_set_level((enum LOG_LEVEL) (entry[i].loglevel == -1 ? 
           logger_get_default_level() : (enum LOG_LEVEL)entry[i].loglevel));
 
@@ -152,20 +280,30 @@ int destinationlist_open(const destinationlist* list, const ich_time* now) {
               (int)entry[i].id.len, (char *)entry[i].id.x);
             return r;
         }
+
+        if( (r = destination_sync_create(&entry[i].sync)) != 0) {
+            fprintf(stderr,"[destinationlist] error allocating queue for destination %.*s\n",
+              (int)entry[i].id.len, (char *)entry[i].id.x);
+            return r;
+        }
     }
 
     return 0;
 }
 
-static int destinationlist_entry_run(void *userdata) {
-    int r;
-    destinationlist_entry* entry = (destinationlist_entry*)userdata;
+/* number of messages a destination handles before it
+ * lets other destinations on the same worker run */
+#define DESTINATIONLIST_STEP_BUDGET 32
 
+static void destinationlist_entry_set_logger(const destinationlist_entry* entry) {
     logger_set_prefix("destination.",12);
     logger_append_prefix((const char *)entry->id.x,entry->id.len);
+    memacct_set_owner(entry->memacct);
     logger_set_level((enum LOG_LEVEL) (entry->loglevel == -1 ?
       logger_get_default_level() : (enum LOG_LEVEL)entry->loglevel));
+}
 
+static void destinationlist_entry_prepare(destinationlist_entry* entry) {
     entry->sync.frame_receiver.open         = (frame_receiver_open_cb)destination_open;
     entry->sync.frame_receiver.submit_frame = (frame_receiver_submit_frame_cb)destination_submit_frame;
     entry->sync.frame_receiver.flush        = (frame_receiver_flush_cb)destination_flush;
@@ -176,6 +314,14 @@ static int destinationlist_entry_run(void *userdata) {
     entry->sync.on_tags.userdata  = &entry->destination;
     entry->sync.tagmap            = entry->destination.tagmap;
     entry->sync.map_flags         = &entry->destination.map_flags;
+}
+
+static int destinationlist_entry_run(void *userdata) {
+    int r;
+    destinationlist_entry* entry = (destinationlist_entry*)userdata;
+
+    destinationlist_entry_set_logger(entry);
+    affinity_apply(&entry->affinity);
 
     r = destination_sync_run(&entry->sync);
 
@@ -184,7 +330,34 @@ static int destinationlist_entry_run(void *userdata) {
     return r;
 }
 
-int destinationlist_start(const destinationlist* list) {
+static worker_task_state destinationlist_entry_step(void* userdata) {
+    worker_task_state r;
+    destinationlist_entry* entry = (destinationlist_entry*)userdata;
+
+    destinationlist_entry_set_logger(entry);
+
+    r = destination_sync_step(&entry->sync, DESTINATIONLIST_STEP_BUDGET);
+    if(r != WORKER_TASK_IDLE) return r;
+
+    return destination_sync_park(&entry->sync) ? WORKER_TASK_IDLE : WORKER_TASK_BUSY;
+}
+
+static int destinationlist_entry_output_run(void *userdata) {
+    int r;
+    destinationlist_entry* entry = (destinationlist_entry*)userdata;
+
+    destinationlist_entry_set_logger(entry);
+    affinity_apply(&entry->affinity);
+
+    r = output_sync_run(&entry->destination.output_sync);
+
+    logger_thread_cleanup();
+    thread_exit(r);
+    return r;
+}
+
+int destinationlist_start(const destinationlist* list, worker_pool* pool) {
+    int r;
     size_t i;
     size_t len;
 
@@ -192,21 +365,66 @@ int destinationlist_start(const destinationlist* list) {
     len = list->len / sizeof(destinationlist_entry);
 
     for(i=0;i<len;i++) {
-        entry[i].thread = thread_create(destinationlist_entry_run, &entry[i], THREAD_STACK_SIZE_DEFAULT);
+        if(entry[i].destination.output_sync.depth == 0) continue;
+        entry[i].output_thread = thread_create(destinationlist_entry_output_run, &entry[i], THREAD_STACK_SIZE_DEFAULT);
+    }
+
+    for(i=0;i<len;i++) {
+        if(entry[i].destination.leader != NULL) continue;
+        destinationlist_entry_prepare(&entry[i]);
+        if(pool != NULL && entry[i].affinity.mode != AFFINITY_NONE) {
+            fprintf(stderr,"[destinationlist] destination %.*s: CPU affinity is ignored when using workers\n",
+              (int)entry[i].id.len, (char *)entry[i].id.x);
+        }
+        if(pool == NULL) {
+            entry[i].thread = thread_create(destinationlist_entry_run, &entry[i], THREAD_STACK_SIZE_DEFAULT);
+            continue;
+        }
+        entry[i].task.step = destinationlist_entry_step;
+        entry[i].task.userdata = &entry[i];
+        entry[i].sync.task = &entry[i].task;
+        entry[i].sync.pool = pool;
+        worker_pool_add(pool, &entry[i].task);
+    }
+
+    if(pool == NULL) return 0;
+
+    if( (r = worker_pool_start(pool)) != 0) {
+        fprintf(stderr,"[destinationlist] error starting worker pool\n");
+        return r;
+    }
+
+    /* each destination runs once to park itself */
+    for(i=0;i<len;i++) {
+        if(entry[i].destination.leader != NULL) continue;
+        worker_pool_schedule(pool, &entry[i].task);
     }
 
     return 0;
 }
 
-int destinationlist_wait(const destinationlist* list) {
+int destinationlist_wait(const destinationlist* list, worker_pool* pool) {
     size_t i;
     size_t len;
 
     destinationlist_entry* entry = (destinationlist_entry *)list->x;
     len = list->len / sizeof(destinationlist_entry);
 
+    if(pool != NULL) {
+        worker_pool_wait(pool);
+    } else {
+        for(i=0;i<len;i++) {
+            if(entry[i].destination.leader != NULL) continue;
+            thread_join(entry[i].thread);
+        }
+    }
+
+    /* nothing else will be queued, output threads
+     * exit once they've caught up */
     for(i=0;i<len;i++) {
-        thread_join(entry[i].thread);
+        if(entry[i].destination.output_sync.depth == 0) continue;
+        output_sync_quit(&entry[i].destination.output_sync);
+        thread_join(entry[i].output_thread);
     }
 
     return 0;
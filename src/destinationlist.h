@@ -5,14 +5,20 @@
 #include "destination.h"
 #include "destination_sync.h"
 #include "thread.h"
+#include "worker_pool.h"
+#include "affinity.h"
 #include "tag.h"
 
 struct destinationlist_entry {
     strbuf id;
     thread_ptr_t thread;
+    thread_ptr_t output_thread; /* only used with async-output */
+    worker_task task; /* only used with a worker pool */
+    affinity affinity; /* CPUs to run the destination (and output) thread on */
     destination_sync sync;
     destination destination;
     int loglevel;
+    unsigned int memacct; /* memory accounting owner id */
 };
 
 typedef struct destinationlist_entry destinationlist_entry;
@@ -37,13 +43,28 @@ size_t destinationlist_length(const destinationlist* list);
 
 int destinationlist_configure(const strbuf* id, const strbuf* key, const strbuf* value, destinationlist* list);
 
+/* finds destinations with identical filter/encoder chains
+ * and has them share a single encoder */
+int destinationlist_share_encoders(const destinationlist* list);
+
+/* call before destinationlist_open when destinations will run on a
+ * worker pool - output writes block, so any destination without
+ * async-output gets one, otherwise a slow output would stall every
+ * destination on the same worker */
+void destinationlist_use_workers(const destinationlist* list);
+
 int destinationlist_open(const destinationlist* list, const ich_time* now);
 
-/* spawns threads for each destination in the list */
-int destinationlist_start(const destinationlist* list);
+/* spawns threads for each destination in the list, destinations
+ * sharing another destination's encoder run in that destination's thread.
+ * Destinations with async-output get a second thread for their output.
+ * If pool is non-NULL, destinations run as tasks on the pool's
+ * workers instead of their own threads (see destinationlist_use_workers,
+ * outputs keep their own threads since they block) */
+int destinationlist_start(const destinationlist* list, worker_pool* pool);
 
 /* waits for all threads to complete */
-int destinationlist_wait(const destinationlist* list);
+int destinationlist_wait(const destinationlist* list, worker_pool* pool);
 
 void destinationlist_dump_counters(const destinationlist* list);
 
@@ -1,4 +1,5 @@
 #include "encoder.h"
+#include "memacct.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -28,6 +29,7 @@ void encoder_free(encoder* e) {
 }
 
 int encoder_create(encoder* e, const strbuf* name) {
+    int r;
     const encoder_plugin* plug;
     void* userdata;
 
@@ -50,7 +52,8 @@ int encoder_create(encoder* e, const strbuf* name) {
     e->userdata = userdata;
     e->plugin = plug;
 
-    return e->plugin->create(e->userdata);
+    MEMACCT_CALL(MEMACCT_ENCODER, r, e->plugin->create(e->userdata));
+    return r;
 }
 
 static uint32_t encoder_get_caps_wrapper(void* ud) {
@@ -106,10 +109,13 @@ int encoder_open(encoder* e, const frame_source* source) {
       (int)e->plugin->name->len,
       (const char *)e->plugin->name->x);
 
-    return e->plugin->open(e->userdata, source, &receiver);
+    MEMACCT_CALL(MEMACCT_ENCODER, r, e->plugin->open(e->userdata, source, &receiver));
+    return r;
 }
 
 int encoder_config(const encoder* e, const strbuf* name, const strbuf* value) {
+    int r;
+
     log_debug("configuring plugin %.*s %.*s=%.*s",
       (int)e->plugin->name->len,
       (const char *)e->plugin->name->x,
@@ -117,12 +123,13 @@ int encoder_config(const encoder* e, const strbuf* name, const strbuf* value) {
       (const char *)name->x,
       (int)value->len,
       (const char *)value->x);
-    return e->plugin->config(e->userdata,name,value);
+    MEMACCT_CALL(MEMACCT_ENCODER, r, e->plugin->config(e->userdata,name,value));
+    return r;
 }
 
 int encoder_submit_frame(encoder* e, const frame* frame) {
     int r;
-    r = e->plugin->submit_frame(e->userdata, frame, &e->packet_receiver);
+    MEMACCT_CALL(MEMACCT_ENCODER, r, e->plugin->submit_frame(e->userdata, frame, &e->packet_receiver));
 
     if(r == 0) {
         ich_time_now(&e->ts);
@@ -146,11 +153,15 @@ int encoder_submit_tags(encoder* e, const taglist* tags) {
 }
 
 int encoder_flush(const encoder* e) {
-    return e->plugin->flush(e->userdata, &e->packet_receiver);
+    int r;
+    MEMACCT_CALL(MEMACCT_ENCODER, r, e->plugin->flush(e->userdata, &e->packet_receiver));
+    return r;
 }
 
 int encoder_reset(const encoder* e) {
-    return e->plugin->reset(e->userdata);
+    int r;
+    MEMACCT_CALL(MEMACCT_ENCODER, r, e->plugin->reset(e->userdata));
+    return r;
 }
 
 int encoder_global_init(void) {
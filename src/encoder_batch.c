@@ -0,0 +1,388 @@
+#include "encoder_batch.h"
+#include "muxer_caps.h"
+#include "memacct.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_PREFIX "[encoder:batch]"
+#include "logger.h"
+
+void encoder_batch_init(encoder_batch* batch) {
+    batch->len = 0;
+    batch->encoder = NULL;
+    strbuf_init(&batch->config);
+    batch->jobs = NULL;
+    batch->cur = 0;
+    frame_init(&batch->pending);
+    batch->frame_len = 0;
+    batch->chunk = 0;
+    batch->pts = 0;
+    batch->caps = 0;
+    batch->params = packet_source_params_zero;
+    batch->chunks = 0;
+}
+
+static void encoder_batch_job_free(encoder_batch_job* job) {
+    size_t i;
+    packet* packets = (packet*)job->packets.x;
+
+    if(job->thread != NULL) {
+        job->quit = 1;
+        thread_signal_raise(&job->start);
+        thread_join(job->thread);
+        job->thread = NULL;
+    }
+
+    for(i=0;i<job->packets.len / sizeof(packet);i++) {
+        packet_free(&packets[i]);
+    }
+    membuf_free(&job->packets);
+    frame_free(&job->frame);
+    encoder_free(&job->encoder);
+    thread_signal_term(&job->start);
+    thread_signal_term(&job->done);
+}
+
+void encoder_batch_free(encoder_batch* batch) {
+    size_t i;
+
+    if(batch->jobs != NULL) {
+        for(i=0;i<batch->len;i++) {
+            encoder_batch_job_free(&batch->jobs[i]);
+        }
+        free(batch->jobs);
+        batch->jobs = NULL;
+    }
+    strbuf_free(&batch->config);
+    frame_free(&batch->pending);
+}
+
+int encoder_batch_config(encoder_batch* batch, const strbuf* key, const strbuf* value) {
+    int r;
+    if( (r = strbuf_cat(&batch->config, key)) != 0) return r;
+    if( (r = strbuf_append(&batch->config, "\0", 1)) != 0) return r;
+    if( (r = strbuf_cat(&batch->config, value)) != 0) return r;
+    return strbuf_append(&batch->config, "\0", 1);
+}
+
+/* the callbacks a job's encoder sends packets to, everything
+ * that would reach the muxer is either collected or answered
+ * from what the real muxer told us when we opened */
+static int encoder_batch_job_open(void* handle, const packet_source* source) {
+    (void)handle;
+    (void)source;
+    return 0;
+}
+
+static int encoder_batch_job_submit_packet(void* handle, const packet* p) {
+    int r;
+    packet tmp;
+    encoder_batch_job* job = (encoder_batch_job*)handle;
+
+    if(job->npackets == job->packets.len / sizeof(packet)) {
+        packet_init(&tmp);
+        if( (r = membuf_append(&job->packets, &tmp, sizeof(packet))) != 0) return r;
+    }
+
+    return packet_copy(&((packet*)job->packets.x)[job->npackets++], p);
+}
+
+static uint32_t encoder_batch_job_get_caps(void* handle) {
+    encoder_batch_job* job = (encoder_batch_job*)handle;
+    return job->batch->caps;
+}
+
+static int encoder_batch_job_get_segment_info(const void* handle, const packet_source_info* info, packet_source_params* params) {
+    const encoder_batch_job* job = (const encoder_batch_job*)handle;
+    (void)info;
+    *params = job->batch->params;
+    return 0;
+}
+
+static int encoder_batch_job_encode(encoder_batch_job* job) {
+    int r;
+    unsigned int frame_len;
+    encoder* e = &job->encoder;
+
+    job->npackets = 0;
+
+    if( (r = e->plugin->split(e->userdata, job->pts, &frame_len)) != 0) return r;
+    if( (r = e->plugin->submit_frame(e->userdata, &job->frame, &e->packet_receiver)) != 0) return r;
+    /* chunks end on a frame boundary so this only produces a
+     * packet for the very last (short) chunk */
+    return e->plugin->flush(e->userdata, &e->packet_receiver);
+}
+
+static int encoder_batch_job_run(void* userdata) {
+    encoder_batch_job* job = (encoder_batch_job*)userdata;
+
+    memacct_set_owner(job->memacct);
+
+    for(;;) {
+        thread_signal_wait(&job->start, THREAD_SIGNAL_WAIT_INFINITE);
+        if(job->quit) break;
+        MEMACCT_CALL(MEMACCT_ENCODER, job->status, encoder_batch_job_encode(job));
+        thread_signal_raise(&job->done);
+    }
+
+    logger_thread_cleanup();
+    thread_exit(0);
+    return 0;
+}
+
+static int encoder_batch_job_create(encoder_batch* batch, encoder_batch_job* job) {
+    int r;
+    size_t i;
+    strbuf key;
+    strbuf val;
+    const strbuf* config = &batch->config;
+
+    job->batch = batch;
+    encoder_init(&job->encoder);
+    job->thread = NULL;
+    thread_signal_init(&job->start);
+    thread_signal_init(&job->done);
+    frame_init(&job->frame);
+    job->pts = 0;
+    membuf_init(&job->packets);
+    job->npackets = 0;
+    job->status = 0;
+    job->busy = 0;
+    job->opened = 0;
+    job->quit = 0;
+    job->memacct = memacct_get_owner();
+
+    if( (r = encoder_create(&job->encoder, batch->encoder->plugin->name)) != 0) return r;
+
+    i = 0;
+    while(i < config->len) {
+        key.x = &config->x[i];
+        key.len = strlen((const char*)key.x);
+        key.a = 0;
+        i += key.len + 1;
+        val.x = &config->x[i];
+        val.len = strlen((const char*)val.x);
+        val.a = 0;
+        i += val.len + 1;
+        if( (r = encoder_config(&job->encoder, &key, &val)) != 0) return r;
+    }
+
+    job->encoder.packet_receiver.handle           = job;
+    job->encoder.packet_receiver.open             = encoder_batch_job_open;
+    job->encoder.packet_receiver.submit_packet    = encoder_batch_job_submit_packet;
+    job->encoder.packet_receiver.get_caps         = encoder_batch_job_get_caps;
+    job->encoder.packet_receiver.get_segment_info = encoder_batch_job_get_segment_info;
+
+    job->thread = thread_create(encoder_batch_job_run, job, THREAD_STACK_SIZE_DEFAULT);
+    if(job->thread == NULL) {
+        logs_error("unable to create encoder thread");
+        return -1;
+    }
+
+    return 0;
+}
+
+int encoder_batch_create(encoder_batch* batch, encoder* e) {
+    int r;
+    size_t i;
+
+    if(e->plugin->split == NULL) {
+        log_error("the %.*s encoder doesn't support batch encoding",
+          (int)e->plugin->name->len, (const char*)e->plugin->name->x);
+        return -1;
+    }
+
+    batch->encoder = e;
+    batch->jobs = (encoder_batch_job*)malloc(sizeof(encoder_batch_job) * batch->len);
+    if(batch->jobs == NULL) {
+        logs_fatal("unable to allocate jobs");
+        return -1;
+    }
+
+    for(i=0;i<batch->len;i++) {
+        if( (r = encoder_batch_job_create(batch, &batch->jobs[i])) != 0) {
+            /* so encoder_batch_free only cleans up what we made */
+            batch->len = i + 1;
+            return r;
+        }
+    }
+
+    return 0;
+}
+
+/* waits for a job to finish and sends its packets along */
+static int encoder_batch_collect(encoder_batch* batch, encoder_batch_job* job) {
+    int r;
+    size_t i;
+    encoder* e = batch->encoder;
+    const packet* packets;
+
+    thread_signal_wait(&job->done, THREAD_SIGNAL_WAIT_INFINITE);
+    job->busy = 0;
+    packets = (const packet*)job->packets.x;
+
+    if(job->status != 0) {
+        logs_error("error encoding chunk");
+        return job->status;
+    }
+
+    for(i=0;i<job->npackets;i++) {
+        if( (r = e->packet_receiver.submit_packet(e->packet_receiver.handle, &packets[i])) != 0) return r;
+    }
+
+    e->counter++;
+    ich_time_now(&e->ts);
+    return 0;
+}
+
+/* collects every outstanding job, oldest first */
+static int encoder_batch_collect_all(encoder_batch* batch) {
+    int r;
+    size_t i;
+    encoder_batch_job* job;
+
+    for(i=0;i<batch->len;i++) {
+        job = &batch->jobs[(batch->cur + i) % batch->len];
+        if(!job->busy) continue;
+        if( (r = encoder_batch_collect(batch, job)) != 0) return r;
+    }
+    return 0;
+}
+
+/* hands the first len samples of pending audio to the next job */
+static int encoder_batch_dispatch(encoder_batch* batch, unsigned int len) {
+    int r;
+    encoder_batch_job* job = &batch->jobs[batch->cur];
+
+    if(job->busy) {
+        if( (r = encoder_batch_collect(batch, job)) != 0) return r;
+    }
+
+    job->frame.format      = batch->pending.format;
+    job->frame.channels    = batch->pending.channels;
+    job->frame.sample_rate = batch->pending.sample_rate;
+    if( (r = frame_move(&job->frame, &batch->pending, len)) != 0) {
+        logs_error("error moving samples");
+        return r;
+    }
+
+    job->pts = batch->pts;
+    batch->pts += len;
+    batch->chunks++;
+
+    job->busy = 1;
+    thread_signal_raise(&job->start);
+    batch->cur = (batch->cur + 1) % batch->len;
+    return 0;
+}
+
+int encoder_batch_open(encoder_batch* batch, const frame_source* source) {
+    int r;
+    size_t i;
+    encoder* e = batch->encoder;
+    encoder_batch_job* job;
+    packet_source_info info = PACKET_SOURCE_INFO_ZERO;
+
+    /* anything from the previous source goes out first */
+    if( (r = encoder_batch_flush(batch)) != 0) return r;
+
+    if( (r = encoder_open(e, source)) != 0) return r;
+
+    /* the main encoder never sees any audio, but it knows its frame length */
+    if( (r = e->plugin->split(e->userdata, batch->pts, &batch->frame_len)) != 0) return r;
+    if(batch->frame_len == 0) {
+        logs_error("encoder reported a frame length of 0");
+        return -1;
+    }
+
+    batch->caps = e->packet_receiver.get_caps(e->packet_receiver.handle);
+    batch->params = packet_source_params_zero;
+    info.time_base = source->sample_rate;
+    info.frame_len = batch->frame_len;
+    if( (r = e->packet_receiver.get_segment_info(e->packet_receiver.handle, &info, &batch->params)) != 0) return r;
+
+    batch->chunk = (unsigned int)((uint64_t)(batch->params.segment_length ? batch->params.segment_length : ENCODER_BATCH_DEFAULT_LENGTH)
+      * source->sample_rate / 1000 / batch->frame_len * batch->frame_len);
+    if(batch->chunk == 0) batch->chunk = batch->frame_len;
+
+    log_debug("using %zu encoders, %u samples per chunk", batch->len, batch->chunk);
+
+    for(i=0;i<batch->len;i++) {
+        job = &batch->jobs[i];
+        if(job->opened) {
+            if( (r = job->encoder.plugin->reset(job->encoder.userdata)) != 0) return r;
+        }
+        if( (r = job->encoder.plugin->open(job->encoder.userdata, source, &job->encoder.packet_receiver)) != 0) return r;
+        job->opened = 1;
+    }
+
+    batch->pending.format = SAMPLEFMT_UNKNOWN;
+    batch->pending.sample_rate = source->sample_rate;
+    batch->pending.duration = 0;
+    return 0;
+}
+
+int encoder_batch_submit_frame(encoder_batch* batch, const frame* frame) {
+    int r;
+
+    if( (r = frame_append(&batch->pending, frame)) != 0) {
+        logs_error("error buffering samples");
+        return r;
+    }
+
+    while(batch->pending.duration >= batch->chunk) {
+        if( (r = encoder_batch_dispatch(batch, batch->chunk)) != 0) return r;
+    }
+
+    return 0;
+}
+
+int encoder_batch_flush(encoder_batch* batch) {
+    int r;
+
+    if(batch->pending.duration > 0) {
+        if( (r = encoder_batch_dispatch(batch, batch->pending.duration)) != 0) return r;
+    }
+
+    return encoder_batch_collect_all(batch);
+}
+
+int encoder_batch_reset(encoder_batch* batch) {
+    int r;
+
+    /* whatever was already handed out was encoded before the
+     * reset came in, anything still pending is thrown away */
+    batch->pending.duration = 0;
+    if( (r = encoder_batch_collect_all(batch)) != 0) return r;
+
+    return encoder_reset(batch->encoder);
+}
+
+int encoder_batch_submit_tags(encoder_batch* batch, const taglist* tags) {
+    int r;
+    unsigned int len;
+
+    if(batch->caps & MUXER_CAP_TAGS_RESET) {
+        /* the encoder is about to be flushed and re-opened */
+        if( (r = encoder_batch_flush(batch)) != 0) return r;
+    } else {
+        /* encode up to the last full frame, same as a single
+         * encoder would have, and hold on to the rest */
+        len = batch->pending.duration / batch->frame_len * batch->frame_len;
+        if(len > 0) {
+            if( (r = encoder_batch_dispatch(batch, len)) != 0) return r;
+        }
+        if( (r = encoder_batch_collect_all(batch)) != 0) return r;
+    }
+
+    return encoder_submit_tags(batch->encoder, tags);
+}
+
+void encoder_batch_dump_counters(const encoder_batch* batch, const strbuf* prefix) {
+    log_info("%.*s batch: encoders=%zu chunk=%u chunks=%zu",
+      (int)prefix->len,(const char*)prefix->x,
+      batch->len,
+      batch->chunk,
+      batch->chunks);
+}
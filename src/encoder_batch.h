@@ -0,0 +1,103 @@
+#ifndef ENCODER_BATCH_H
+#define ENCODER_BATCH_H
+
+/* batch encoding, for destinations fed faster than realtime
+ * (like re-encoding an archive from a file input).
+ *
+ * Normally one encoder handles every frame, so a destination
+ * can't go any faster than one core. In batch mode the incoming
+ * audio is cut into segment-length chunks, each chunk is handed
+ * to one of several encoder instances (each with its own thread),
+ * and the packets are handed to the muxer in their original order.
+ * The muxer sees the exact same packet stream it would have gotten
+ * from a single encoder.
+ *
+ * Chunks are cut on the encoder's frame boundaries, and each
+ * instance is told where its chunk starts, so this only works with
+ * encoders that implement the split call (see encoder_plugin.h).
+ *
+ * Tags, flushes and resets wait for every outstanding chunk, so
+ * they land in the same place they would have without batching.
+ */
+
+#include "encoder.h"
+#include "frame.h"
+#include "packet.h"
+#include "thread.h"
+#include "strbuf.h"
+#include "membuf.h"
+
+#include <stdint.h>
+
+#define ENCODER_BATCH_MAX_JOBS 256
+
+/* chunk length used when the muxer doesn't ask for a segment length */
+#define ENCODER_BATCH_DEFAULT_LENGTH 1000
+
+struct encoder_batch;
+
+struct encoder_batch_job {
+    struct encoder_batch* batch;
+    encoder encoder;      /* this job's own encoder instance */
+    thread_ptr_t thread;
+    thread_signal_t start;
+    thread_signal_t done;
+    frame frame;          /* the chunk to encode */
+    uint64_t pts;         /* timestamp of the chunk's first sample */
+    membuf packets;       /* encoded packets, in order */
+    size_t npackets;
+    int status;
+    uint8_t busy;         /* only touched by the destination thread */
+    uint8_t opened;
+    uint8_t quit;
+    unsigned int memacct; /* memory accounting owner, see memacct.h */
+};
+
+typedef struct encoder_batch_job encoder_batch_job;
+
+struct encoder_batch {
+    size_t len;           /* number of encoder instances, 0 if batch mode is off */
+    encoder* encoder;     /* the destination's encoder, opens the muxer and handles tags */
+    strbuf config;        /* encoder settings, as key\0value\0 pairs */
+    encoder_batch_job* jobs;
+    size_t cur;           /* the next job to fill */
+    frame pending;        /* audio waiting for a full chunk */
+    unsigned int frame_len;
+    unsigned int chunk;   /* chunk length in samples, a multiple of frame_len */
+    uint64_t pts;         /* timestamp of the next chunk */
+    uint32_t caps;
+    packet_source_params params;
+    size_t chunks;
+};
+
+typedef struct encoder_batch encoder_batch;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void encoder_batch_init(encoder_batch*);
+void encoder_batch_free(encoder_batch*);
+
+/* records an encoder setting, to be replayed on every instance */
+int encoder_batch_config(encoder_batch*, const strbuf* key, const strbuf* value);
+
+/* creates the encoder instances and their threads, call after
+ * the destination's encoder has been created and configured */
+int encoder_batch_create(encoder_batch*, encoder* e);
+
+/* these all match the frame receiver callbacks */
+int encoder_batch_open(encoder_batch*, const frame_source* source);
+int encoder_batch_submit_frame(encoder_batch*, const frame*);
+int encoder_batch_flush(encoder_batch*);
+int encoder_batch_reset(encoder_batch*);
+
+int encoder_batch_submit_tags(encoder_batch*, const taglist* tags);
+
+void encoder_batch_dump_counters(const encoder_batch*, const strbuf* prefix);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,6 +26,14 @@ typedef int (*encoder_plugin_flush)(void* userdata, const packet_receiver* dest)
 
 typedef int (*encoder_plugin_reset)(void* userdata);
 
+/* optional, only for encoders that don't carry any state from one
+ * frame to the next, which means a stream can be cut into pieces
+ * and encoded by separate instances (see encoder_batch.h). Called
+ * after open, tells the encoder the timestamp of the next sample
+ * it'll receive and asks for its frame length, pieces are always
+ * cut on frame boundaries */
+typedef int (*encoder_plugin_split)(void* userdata, uint64_t pts, unsigned int* frame_len);
+
 struct encoder_plugin {
     const strbuf* name;
     encoder_plugin_size size;
@@ -38,6 +46,7 @@ struct encoder_plugin {
     encoder_plugin_submit_frame submit_frame;
     encoder_plugin_flush flush;
     encoder_plugin_reset reset;
+    encoder_plugin_split split;
 };
 
 typedef struct encoder_plugin encoder_plugin;
@@ -3,6 +3,7 @@
 
 #include "avframe_utils.h"
 #include "avpacket_utils.h"
+#include "audio_fifo.h"
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/frame.h>
@@ -244,7 +245,7 @@ struct plugin_userdata {
     AVFrame* avframe;
     AVPacket* avpacket;
     packet packet;
-    frame buffer;
+    audio_fifo buffer;
 
     unsigned int sample_rate;
     uint64_t channel_layout;
@@ -406,8 +407,7 @@ static int plugin_create(void* ud) {
     userdata->avframe = NULL;
     userdata->avpacket = NULL;
     userdata->codec_config = NULL;
-    frame_init(&userdata->buffer);
-    frame_init(&userdata->buffer);
+    audio_fifo_init(&userdata->buffer);
     packet_init(&userdata->packet);
     userdata->me = packet_source_zero;
 
@@ -422,7 +422,7 @@ static void plugin_close(void* ud) {
     }
     if(userdata->ctx != NULL) avcodec_free_context(&userdata->ctx);
     if(userdata->codec_config != NULL) av_dict_free(&userdata->codec_config);
-    frame_free(&userdata->buffer);
+    audio_fifo_free(&userdata->buffer);
     packet_free(&userdata->packet);
     strbuf_free(&userdata->me.dsi);
 
@@ -492,12 +492,8 @@ static int plugin_open(void* ud, const frame_source* source, const packet_receiv
         logs_fatal("out of memory"));
     }
 
-    userdata->buffer.format = avsampleformat_to_samplefmt(userdata->sample_fmt);
-    userdata->buffer.channels = channel_count(userdata->channel_layout);
-    userdata->buffer.duration = 0;
-    userdata->buffer.sample_rate = source->sample_rate;
-
-    if( (r = frame_ready(&userdata->buffer)) != 0) return r;
+    if( (r = audio_fifo_open(&userdata->buffer, avsampleformat_to_samplefmt(userdata->sample_fmt),
+      channel_count(userdata->channel_layout), source->sample_rate)) != 0) return r;
 
     userdata->me.handle = userdata;
     userdata->me.channel_layout = source->channel_layout;
@@ -572,12 +568,15 @@ static int plugin_drain(plugin_userdata* userdata, const packet_receiver* dest,
     int r;
     int av;
     char averrbuf[128];
+    const frame* buffered;
 
     r = 0;
     while(userdata->buffer.duration >= (unsigned int)duration) {
-        TRY0(frame_to_avframe(userdata->avframe,&userdata->buffer,duration,userdata->channel_layout),
+        TRY( (buffered = audio_fifo_peek(&userdata->buffer,duration)) != NULL,
+          logs_fatal("unable to read buffered samples"));
+        TRY0(frame_to_avframe(userdata->avframe,buffered,duration,userdata->channel_layout),
           logs_fatal("unable to convert frame"));
-        frame_trim(&userdata->buffer,duration);
+        audio_fifo_consume(&userdata->buffer,duration);
 
         TRY( (av = avcodec_send_frame(userdata->ctx,userdata->avframe)) >= 0,
           av_strerror(av, averrbuf, sizeof(averrbuf));
@@ -598,7 +597,7 @@ static int plugin_submit_frame(void* ud, const frame* frame, const packet_receiv
     int r;
     plugin_userdata* userdata = (plugin_userdata*)ud;
 
-    if( (r = frame_append(&userdata->buffer,frame)) != 0) {
+    if( (r = audio_fifo_write(&userdata->buffer,frame)) != 0) {
         log_error("error appending frame to internal buffer: %d",r);
         return r;
     }
@@ -650,5 +649,6 @@ const encoder_plugin encoder_plugin_avcodec = {
     plugin_submit_frame,
     plugin_flush,
     plugin_reset,
+    NULL,
 };
 
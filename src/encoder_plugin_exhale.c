@@ -9,6 +9,7 @@
 #include <inttypes.h>
 
 #include "mpeg_mappings.h"
+#include "audio_fifo.h"
 
 #define KEY(v,t) static STRBUF_CONST(KEY_##v,#t)
 
@@ -47,7 +48,7 @@ struct plugin_userdata {
     ExhaleEncAPI *exhale;
     packet packet;
 
-    frame buffer;
+    audio_fifo buffer;
     frame samples;
 
     unsigned int frame_len;
@@ -129,7 +130,7 @@ static int plugin_create(void* ud) {
 
     userdata->exhale = NULL;
     packet_init(&userdata->packet);
-    frame_init(&userdata->buffer);
+    audio_fifo_init(&userdata->buffer);
     frame_init(&userdata->samples);
     userdata->vbr = 3;
     userdata->frame_len = 1024;
@@ -146,7 +147,7 @@ static void plugin_close(void* ud) {
 
     if(userdata->exhale != NULL) exhaleDelete(userdata->exhale);
     packet_free(&userdata->packet);
-    frame_free(&userdata->buffer);
+    audio_fifo_free(&userdata->buffer);
     frame_free(&userdata->samples);
     packet_source_free(&userdata->me);
 }
@@ -215,11 +216,6 @@ static int plugin_open(void* ud, const frame_source* source, const packet_receiv
     if(!userdata->tune_in_period) userdata->tune_in_period = 1;
     log_debug("  tune_in_period = %u", userdata->tune_in_period);
 
-    userdata->buffer.format = SAMPLEFMT_S32P;
-    userdata->buffer.channels = channel_count(source->channel_layout);
-    userdata->buffer.duration = 0;
-    userdata->buffer.sample_rate = source->sample_rate;
-
     userdata->samples.format = SAMPLEFMT_S32;
     userdata->samples.channels = channel_count(source->channel_layout);
     userdata->samples.duration = userdata->frame_len;
@@ -227,7 +223,7 @@ static int plugin_open(void* ud, const frame_source* source, const packet_receiv
 
     userdata->packet.sample_rate = source->sample_rate;
 
-    if( (r = frame_ready(&userdata->buffer)) != 0) return r;
+    if( (r = audio_fifo_open(&userdata->buffer, SAMPLEFMT_S32P, channel_count(source->channel_layout), source->sample_rate)) != 0) return r;
     if( (r = frame_buffer(&userdata->samples)) != 0) return r;
 
     userdata->me.codec       = CODEC_TYPE_AAC;
@@ -257,7 +253,7 @@ static int plugin_open(void* ud, const frame_source* source, const packet_receiv
      */
     padding = (userdata->frame_len == 1024 ? 448 : 1982);
 
-    if( (r = frame_fill(&userdata->buffer,padding)) != 0) return r;
+    if( (r = audio_fifo_fill(&userdata->buffer,padding)) != 0) return r;
 
     if(userdata->tune_in_period == 0) {
         /* default to a 1-second tune in period */
@@ -298,19 +294,22 @@ static int plugin_encode_frame(plugin_userdata *userdata, const packet_receiver*
     size_t len;
     int32_t *samples;
     int32_t *src;
+    const frame* buffered;
+
+    if( (buffered = audio_fifo_peek(&userdata->buffer, userdata->frame_len)) == NULL) return -1;
 
     samples = (int32_t*)frame_get_channel_samples(&userdata->samples,0);
 
     for(i=0;i<userdata->buffer.channels;i++) {
         c = (size_t)mpeg_channel_layout[userdata->buffer.channels][i];
 
-        src = frame_get_channel_samples(&userdata->buffer,i);
+        src = frame_get_channel_samples(buffered,i);
         for(j=0;j<userdata->frame_len;j++) {
             samples[(j * ((size_t)userdata->buffer.channels)) + c] = src[j] / (1 << 8);
         }
     }
 
-    frame_trim(&userdata->buffer, userdata->frame_len);
+    audio_fifo_consume(&userdata->buffer, userdata->frame_len);
 
     switch(userdata->discard_packets) {
         case 2: len = exhaleEncodeLookahead(userdata->exhale); break;
@@ -352,7 +351,7 @@ static int plugin_submit_frame(void* ud, const frame* frame, const packet_receiv
     int r;
     plugin_userdata* userdata = (plugin_userdata*)ud;
 
-    if( (r = frame_append(&userdata->buffer,frame)) != 0) {
+    if( (r = audio_fifo_write(&userdata->buffer,frame)) != 0) {
         log_error("error appending frame to buffer: %d",r);
         return r;
     }
@@ -375,17 +374,17 @@ static int plugin_flush(void* ud, const packet_receiver* dest) {
     /* record the final partial duration */
     if(userdata->buffer.duration > 0) {
         duration = userdata->buffer.duration;
-        if( (r = frame_fill(&userdata->buffer,userdata->frame_len)) != 0) {
+        if( (r = audio_fifo_fill(&userdata->buffer,userdata->frame_len)) != 0) {
             return r;
         }
         if( (r = plugin_drain(userdata, dest)) != 0) return r;
     }
 
     /* finally encode two final empty frames */
-    if( (r = frame_fill(&userdata->buffer,userdata->frame_len)) != 0) return r;
+    if( (r = audio_fifo_fill(&userdata->buffer,userdata->frame_len)) != 0) return r;
     if( (r = plugin_encode_frame(userdata, dest, userdata->frame_len)) != 0) return r;
 
-    if( (r = frame_fill(&userdata->buffer,userdata->frame_len)) != 0) return r;
+    if( (r = audio_fifo_fill(&userdata->buffer,userdata->frame_len)) != 0) return r;
     if( (r = plugin_encode_frame(userdata, dest, duration)) != 0) return r;
 
     return 0;
@@ -410,4 +409,5 @@ const encoder_plugin encoder_plugin_exhale = {
     plugin_submit_frame,
     plugin_flush,
     plugin_reset,
+    NULL,
 };
@@ -3,6 +3,7 @@
 
 #include <fdk-aac/aacenc_lib.h>
 #include "packet.h"
+#include "audio_fifo.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -46,7 +47,7 @@ struct plugin_userdata {
     HANDLE_AACENCODER aacEncoder;
     packet packet;
     packet packet2;
-    frame buffer;
+    audio_fifo buffer;
     AUDIO_OBJECT_TYPE aot;
     unsigned int vbr;
     unsigned int bitrate;
@@ -71,7 +72,7 @@ static int plugin_create(void* ud) {
     userdata->afterburner = 1;
     packet_init(&userdata->packet);
     packet_init(&userdata->packet2);
-    frame_init(&userdata->buffer);
+    audio_fifo_init(&userdata->buffer);
     userdata->me = packet_source_zero;
 
     return 0;
@@ -185,11 +186,6 @@ static int plugin_open(void *ud, const frame_source* source, const packet_receiv
     userdata->packet.sample_group = 1;
     userdata->packet2.sample_group = 1;
 
-    userdata->buffer.format = SAMPLEFMT_S16;
-    userdata->buffer.channels = channel_count(source->channel_layout);
-    userdata->buffer.sample_rate = source->sample_rate;
-    userdata->buffer.duration = 0;
-
     switch(source->channel_layout) {
         case LAYOUT_MONO: channel_mode = 1; break;
         case LAYOUT_STEREO: channel_mode = 2; break;
@@ -219,7 +215,7 @@ static int plugin_open(void *ud, const frame_source* source, const packet_receiv
         return r;
     }
 
-    if( (r = frame_ready(&userdata->buffer)) != 0) {
+    if( (r = audio_fifo_open(&userdata->buffer, SAMPLEFMT_S16, channel_count(source->channel_layout), source->sample_rate)) != 0) {
         LOGERRNO("error allocating buffer frame");
         return r;
     }
@@ -365,6 +361,7 @@ static int plugin_encode_frame(plugin_userdata* userdata, const packet_receiver*
 
     AACENC_ERROR e = AACENC_OK;
     int16_t* sample_ptr = NULL;
+    const frame* buffered = NULL;
     int r = 0;
 
     AACENC_BufDesc inBufDesc = { 0 };
@@ -381,7 +378,12 @@ static int plugin_encode_frame(plugin_userdata* userdata, const packet_receiver*
     INT outBufSize = sizeof(uint8_t) * MAX_CHANNELS * (6144/8);
     INT outBufElSize = sizeof(uint8_t);
 
-    sample_ptr = (int16_t*)frame_get_channel_samples(&userdata->buffer,0);
+    if( (buffered = audio_fifo_peek(&userdata->buffer, userdata->frame_len)) == NULL) {
+        logs_error("error reading buffer frame");
+        return -1;
+    }
+
+    sample_ptr = (int16_t*)frame_get_channel_samples(buffered,0);
 
     inBufDesc.numBufs = 1;
     inBufDesc.bufs = (void **)&sample_ptr;
@@ -421,7 +423,7 @@ static int plugin_drain(plugin_userdata*  userdata, const packet_receiver* dest)
 
     while(userdata->buffer.duration >= userdata->frame_len) {
         if( (r = plugin_encode_frame(userdata,dest)) != 0) return r;
-        frame_trim(&userdata->buffer,userdata->frame_len);
+        audio_fifo_consume(&userdata->buffer,userdata->frame_len);
     }
     return 0;
 }
@@ -447,7 +449,7 @@ static int plugin_flush(void* ud, const packet_receiver* dest) {
         final_len = userdata->buffer.duration;
 
         if(userdata->buffer.duration < userdata->frame_len) {
-            if( (r = frame_fill(&userdata->buffer, userdata->frame_len)) != 0) {
+            if( (r = audio_fifo_fill(&userdata->buffer, userdata->frame_len)) != 0) {
                 logs_fatal("error filling frame buffer");
                 return r;
             }
@@ -508,7 +510,7 @@ static int plugin_submit_frame(void* ud, const frame* frame, const packet_receiv
     plugin_userdata* userdata = (plugin_userdata*)ud;
     int r;
 
-    if( (r = frame_append(&userdata->buffer,frame)) != 0) {
+    if( (r = audio_fifo_write(&userdata->buffer,frame)) != 0) {
         log_fatal("error appending frame to internal buffer: %d",r);
         return r;
     }
@@ -524,7 +526,7 @@ static int plugin_reset(void* ud) {
 
     packet_free(&userdata->packet);
     packet_free(&userdata->packet2);
-    frame_free(&userdata->buffer);
+    audio_fifo_free(&userdata->buffer);
     packet_source_free(&userdata->me);
 
     return 0;
@@ -556,4 +558,5 @@ const encoder_plugin encoder_plugin_fdk_aac = {
     plugin_submit_frame,
     plugin_flush,
     plugin_reset,
+    NULL,
 };
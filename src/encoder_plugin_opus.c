@@ -14,6 +14,7 @@
 #include "pack_u32le.h"
 #include "version.h"
 #include "vorbis_mappings.h"
+#include "audio_fifo.h"
 
 #define LOG_PREFIX "[encoder:exhale]"
 #include "logger.h"
@@ -44,7 +45,7 @@ struct encoder_plugin_opus_userdata {
     OpusMSEncoder* enc;
     packet packet;
 
-    frame buffer;
+    audio_fifo buffer;
     frame samples;
     int complexity;
     int signal;
@@ -75,7 +76,7 @@ static int encoder_plugin_opus_create(void* ud) {
 
     userdata->enc = NULL;
     packet_init(&userdata->packet);
-    frame_init(&userdata->buffer);
+    audio_fifo_init(&userdata->buffer);
     frame_init(&userdata->samples);
     strbuf_init(&userdata->name);
 
@@ -98,7 +99,7 @@ static int encoder_plugin_opus_reset(void* ud) {
     encoder_plugin_opus_userdata* userdata = (encoder_plugin_opus_userdata*)ud;
 
     packet_free(&userdata->packet);
-    frame_free(&userdata->buffer);
+    audio_fifo_free(&userdata->buffer);
     frame_free(&userdata->samples);
     strbuf_free(&userdata->name);
 
@@ -240,15 +241,20 @@ static int opus_drain(encoder_plugin_opus_userdata* userdata, const packet_recei
     size_t c = 0;
     float* src = NULL;
     float* samples = NULL;
+    const frame* buffered = NULL;
     opus_int32 result = 0;
 
     samples = (float*)frame_get_channel_samples(&userdata->samples, 0);
 
     while(userdata->buffer.duration >= userdata->framelen) {
+        if( (buffered = audio_fifo_peek(&userdata->buffer, userdata->framelen)) == NULL) {
+            logs_error("error reading buffer frame");
+            return -1;
+        }
 
         for(i=0;i<userdata->channels;i++) {
             c = (size_t)vorbis_channel_layout[userdata->channels][i];
-            src = frame_get_channel_samples(&userdata->buffer, i);
+            src = frame_get_channel_samples(buffered, i);
             for(j=0;j<userdata->framelen;j++) {
                 samples[(j * ((size_t)userdata->channels)) + c] = src[j];
             }
@@ -260,7 +266,7 @@ static int opus_drain(encoder_plugin_opus_userdata* userdata, const packet_recei
             return -1;
         }
 
-        frame_trim(&userdata->buffer,userdata->framelen);
+        audio_fifo_consume(&userdata->buffer,userdata->framelen);
 
         userdata->packet.data.len = result;
         userdata->packet.duration = framelen;
@@ -329,18 +335,12 @@ static int encoder_plugin_opus_open(void *ud, const frame_source* source, const
         return r;
     }
 
-    userdata->buffer.format = SAMPLEFMT_FLOATP;
-    userdata->buffer.channels = userdata->channels;
-    userdata->buffer.duration = 0;
-    userdata->buffer.sample_rate = 48000;
-
-
-    if( (r = frame_ready(&userdata->buffer)) != 0) {
+    if( (r = audio_fifo_open(&userdata->buffer, SAMPLEFMT_FLOATP, userdata->channels, 48000)) != 0) {
         LOGERRNO("error allocating buffer frame");
         return r;
     }
 
-    if( (r = frame_fill(&userdata->buffer,lookahead)) != 0) {
+    if( (r = audio_fifo_fill(&userdata->buffer,lookahead)) != 0) {
         LOGERRNO("error allocating buffer frame");
         return r;
     }
@@ -408,7 +408,7 @@ static int encoder_plugin_opus_flush(void* ud, const packet_receiver* dest) {
 
         if(userdata->buffer.duration < userdata->framelen) {
             framelen = userdata->framelen;
-            if( (r = frame_fill(&userdata->buffer,userdata->framelen)) != 0) {
+            if( (r = audio_fifo_fill(&userdata->buffer,userdata->framelen)) != 0) {
                 logs_fatal("error filling frame buffer");
                 return r;
             }
@@ -423,7 +423,7 @@ static int encoder_plugin_opus_submit_frame(void* ud, const frame* frame, const
     int r;
     encoder_plugin_opus_userdata* userdata = (encoder_plugin_opus_userdata*)ud;
 
-    if( (r = frame_append(&userdata->buffer,frame)) != 0) {
+    if( (r = audio_fifo_write(&userdata->buffer,frame)) != 0) {
         log_error("error appending frame to internal buffer: %d",r);
         return r;
     }
@@ -451,4 +451,5 @@ const encoder_plugin encoder_plugin_opus = {
     encoder_plugin_opus_submit_frame,
     encoder_plugin_opus_flush,
     encoder_plugin_opus_reset,
+    NULL,
 };
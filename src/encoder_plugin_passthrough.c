@@ -75,5 +75,6 @@ const encoder_plugin encoder_plugin_passthrough = {
     plugin_submit_frame,
     plugin_flush,
     plugin_reset,
+    NULL,
 };
 
@@ -2,6 +2,7 @@
 
 #include "tflac.h"
 #include "packet.h"
+#include "audio_fifo.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,10 +16,23 @@
 #define LOGS(s,a) log_error(s,(int)(a).len,(char *)(a).x)
 #define TRY0(exp, act) if( (r = (exp)) != 0 ) { act; goto cleanup; }
 
+/* which of tflac's residual routines to use, "auto" takes the
+ * fastest one the CPU supports. Forcing one is meant for
+ * benchmarking, the CPU isn't checked */
+enum plugin_simd {
+    PLUGIN_SIMD_AUTO = 0,
+    PLUGIN_SIMD_NONE,
+    PLUGIN_SIMD_SSE2,
+    PLUGIN_SIMD_SSSE3,
+    PLUGIN_SIMD_SSE4_1,
+};
+
+typedef enum plugin_simd plugin_simd;
+
 struct plugin_userdata {
     tflac t;
     packet packet;
-    frame buffer;
+    audio_fifo buffer;
     frame scaled;
     membuf t_memory;
     packet_source me;
@@ -27,6 +41,7 @@ struct plugin_userdata {
     TFLAC_CHANNEL_MODE channel_mode;
     uint8_t enable_constant_subframe;
     uint8_t enable_fixed_subframe;
+    plugin_simd simd;
 };
 
 typedef struct plugin_userdata plugin_userdata;
@@ -36,7 +51,7 @@ static int plugin_create(void* ud) {
 
     tflac_init(&userdata->t);
     packet_init(&userdata->packet);
-    frame_init(&userdata->buffer);
+    audio_fifo_init(&userdata->buffer);
     frame_init(&userdata->scaled);
     membuf_init(&userdata->t_memory);
     userdata->me = packet_source_zero;
@@ -46,6 +61,7 @@ static int plugin_create(void* ud) {
     userdata->channel_mode = TFLAC_CHANNEL_INDEPENDENT;
     userdata->enable_constant_subframe = 0;
     userdata->enable_fixed_subframe = 1;
+    userdata->simd = PLUGIN_SIMD_AUTO;
     return 0;
 }
 
@@ -152,10 +168,67 @@ static int plugin_config(void* ud, const strbuf* key, const strbuf* value) {
         return -1;
     }
 
+    if(strbuf_equals_cstr(key, "simd")) {
+        if(strbuf_equals_cstr(value, "auto")) {
+            userdata->simd = PLUGIN_SIMD_AUTO;
+            return 0;
+        }
+        if(strbuf_equals_cstr(value, "none") || strbuf_falsey(value)) {
+            userdata->simd = PLUGIN_SIMD_NONE;
+            return 0;
+        }
+        if(strbuf_equals_cstr(value, "sse2")) {
+            userdata->simd = PLUGIN_SIMD_SSE2;
+            return 0;
+        }
+        if(strbuf_equals_cstr(value, "ssse3")) {
+            userdata->simd = PLUGIN_SIMD_SSSE3;
+            return 0;
+        }
+        if(strbuf_equals_cstr(value, "sse4.1") ||
+           strbuf_equals_cstr(value, "sse4-1") ||
+           strbuf_equals_cstr(value, "sse4_1")) {
+            userdata->simd = PLUGIN_SIMD_SSE4_1;
+            return 0;
+        }
+        LOGS("invalid value for simd: %.*s",(*value));
+        return -1;
+    }
+
     LOGS("unknown key: %.*s",*key);
     return -1;
 }
 
+/* tflac_init() already picked up the routines tflac_detect_cpu()
+ * chose, this is only needed when one is being forced */
+static int plugin_set_simd(plugin_userdata* userdata) {
+    switch(userdata->simd) {
+        case PLUGIN_SIMD_AUTO: return 0;
+        case PLUGIN_SIMD_NONE: {
+            /* fails if SSE2 isn't compiled in, in which case
+             * the plain routines are already in use */
+            tflac_enable_sse2(&userdata->t, 0);
+            return 0;
+        }
+        case PLUGIN_SIMD_SSE2: {
+            if(tflac_enable_sse2(&userdata->t, 1) == 0) return 0;
+            logs_error("SSE2 support not compiled in");
+            break;
+        }
+        case PLUGIN_SIMD_SSSE3: {
+            if(tflac_enable_ssse3(&userdata->t, 1) == 0) return 0;
+            logs_error("SSSE3 support not compiled in");
+            break;
+        }
+        case PLUGIN_SIMD_SSE4_1: {
+            if(tflac_enable_sse4_1(&userdata->t, 1) == 0) return 0;
+            logs_error("SSE4.1 support not compiled in");
+            break;
+        }
+    }
+    return -1;
+}
+
 static int plugin_reset(void* ud) {
     plugin_userdata* userdata = (plugin_userdata*)ud;
 
@@ -168,7 +241,7 @@ static void plugin_close(void* ud) {
     plugin_userdata* userdata = (plugin_userdata*)ud;
 
     packet_free(&userdata->packet);
-    frame_free(&userdata->buffer);
+    audio_fifo_free(&userdata->buffer);
     frame_free(&userdata->scaled);
     membuf_free(&userdata->t_memory);
     strbuf_free(&userdata->me.dsi);
@@ -217,11 +290,6 @@ static int plugin_open(void* ud, const frame_source* source, const packet_receiv
 
     userdata->packet.sample_rate = userdata->t.samplerate;
 
-    userdata->buffer.format = SAMPLEFMT_S32;
-    userdata->buffer.channels = userdata->t.channels;
-    userdata->buffer.duration = 0;
-    userdata->buffer.sample_rate = userdata->t.samplerate;
-
     userdata->scaled.format = SAMPLEFMT_S32;
     userdata->scaled.channels = userdata->t.channels;
     userdata->scaled.duration = userdata->t.blocksize;
@@ -230,9 +298,10 @@ static int plugin_open(void* ud, const frame_source* source, const packet_receiv
     TRY0(membuf_ready(&userdata->t_memory,tflac_size_memory(userdata->blocksize)), logs_fatal("error allocating tflac memory"));
     TRY0(membuf_ready(&userdata->packet.data,tflac_size_frame(userdata->t.blocksize, userdata->t.channels, userdata->t.bitdepth)), logs_fatal("error allocating packet buffer"));
 
+    TRY0(plugin_set_simd(userdata), logs_fatal("error selecting simd routines"));
     TRY0(tflac_validate(&userdata->t, userdata->t_memory.x, userdata->t_memory.a), logs_fatal("error validating tflac encoder"));
 
-    TRY0(frame_ready(&userdata->buffer), logs_fatal("error allocating samples buffer"));
+    TRY0(audio_fifo_open(&userdata->buffer, SAMPLEFMT_S32, userdata->t.channels, userdata->t.samplerate), logs_fatal("error allocating samples buffer"));
     TRY0(frame_buffer(&userdata->scaled), logs_fatal("error allocating scaled samples buffer"));
 
     tflac_encode_streaminfo(&userdata->t, 1, userdata->packet.data.x, userdata->packet.data.a, &mem_used);
@@ -251,20 +320,26 @@ static int plugin_open(void* ud, const frame_source* source, const packet_receiv
 
 static int plugin_encode_frame(plugin_userdata* userdata, const packet_receiver* dest, unsigned int blocksize) {
     int r = 0;
-    size_t i = 0;
     size_t len = 0;
-    tflac_s32 scale = 1 << (32 - userdata->t.bitdepth);
+    unsigned int shift = 32 - userdata->t.bitdepth;
     int32_t* scaled = NULL;
     int32_t* samples = NULL;
+    const frame* buffered = NULL;
     tflac_u32 mem_used = 0;
 
-    samples = (int32_t*) frame_get_channel_samples(&userdata->buffer, 0);
-    scaled  = (int32_t*) frame_get_channel_samples(&userdata->scaled, 0);
+    if( (buffered = audio_fifo_peek(&userdata->buffer, blocksize)) == NULL) {
+        logs_error("error reading samples buffer");
+        return -1;
+    }
 
-    len = ((size_t)userdata->buffer.channels) * ((size_t)blocksize);
-    while(i < len) {
-        scaled[i] = samples[i] / scale;
-        i++;
+    samples = (int32_t*) frame_get_channel_samples(buffered, 0);
+    scaled  = samples;
+
+    /* 32-bit output can be encoded straight out of the buffer */
+    if(shift != 0) {
+        scaled = (int32_t*) frame_get_channel_samples(&userdata->scaled, 0);
+        len = ((size_t)userdata->buffer.channels) * ((size_t)blocksize);
+        samplefmt_s32_shr(scaled, samples, len, shift);
     }
 
     TRY0(tflac_encode_s32i(&userdata->t, blocksize, scaled, userdata->packet.data.x, userdata->packet.data.a, &mem_used), logs_error("error encoding frame"));
@@ -275,7 +350,7 @@ static int plugin_encode_frame(plugin_userdata* userdata, const packet_receiver*
     TRY0(dest->submit_packet(dest->handle, &userdata->packet), logs_error("error sending packet to muxer"));
 
     userdata->packet.pts += blocksize;
-    frame_trim(&userdata->buffer, blocksize);
+    audio_fifo_consume(&userdata->buffer, blocksize);
 
     r = 0;
     cleanup:
@@ -313,13 +388,24 @@ static int plugin_submit_frame(void* ud, const frame* frame, const packet_receiv
 
     r = 0;
 
-    TRY0(frame_append(&userdata->buffer, frame), logs_error("error appending frame to buffer"));
+    TRY0(audio_fifo_write(&userdata->buffer, frame), logs_error("error appending frame to buffer"));
 
     r = plugin_drain(userdata, dest);
     cleanup:
     return r;
 }
 
+/* FLAC frames stand on their own, all a piece needs to know
+ * is where it starts so the frame numbers line up */
+static int plugin_split(void* ud, uint64_t pts, unsigned int* frame_len) {
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    userdata->packet.pts = pts;
+    userdata->t.frameno = (tflac_u32)(pts / userdata->t.blocksize);
+    *frame_len = userdata->t.blocksize;
+    return 0;
+}
+
 static STRBUF_CONST(plugin_name,"tflac");
 
 const encoder_plugin encoder_plugin_tflac = {
@@ -334,4 +420,5 @@ const encoder_plugin encoder_plugin_tflac = {
     plugin_submit_frame,
     plugin_flush,
     plugin_reset,
+    plugin_split,
 };
@@ -1,5 +1,6 @@
 #include "filter.h"
 #include "filter_plugin.h"
+#include "memacct.h"
 #include "frame.h"
 
 #include <stdio.h>
@@ -30,6 +31,7 @@ void filter_free(filter* f) {
 }
 
 int filter_create(filter* f, const strbuf* name) {
+    int r;
     const filter_plugin* plug;
     void* userdata;
 
@@ -52,7 +54,8 @@ int filter_create(filter* f, const strbuf* name) {
     f->userdata = userdata;
     f->plugin = plug;
 
-    return f->plugin->create(f->userdata);
+    MEMACCT_CALL(MEMACCT_FILTER, r, f->plugin->create(f->userdata));
+    return r;
 }
 
 static int filter_open_wrapper(void* ud, const frame_source* source) {
@@ -115,6 +118,7 @@ static int filter_submit_frame_wrapper(void* ud, const frame* frame) {
 }
 
 int filter_open(filter* f, const frame_source* source) {
+    int r;
     frame_receiver receiver = FRAME_RECEIVER_ZERO;
 
     if(f->plugin == NULL || f->userdata == NULL) {
@@ -131,10 +135,13 @@ int filter_open(filter* f, const frame_source* source) {
       (int)f->plugin->name->len,
       (const char *)f->plugin->name->x);
 
-    return f->plugin->open(f->userdata,source, &receiver);
+    MEMACCT_CALL(MEMACCT_FILTER, r, f->plugin->open(f->userdata,source, &receiver));
+    return r;
 }
 
 int filter_config(const filter* f, const strbuf* name, const strbuf* value) {
+    int r;
+
     log_debug("configuring plugin %.*s %.*s=%.*s",
       (int)f->plugin->name->len,
       (const char *)f->plugin->name->x,
@@ -142,7 +149,8 @@ int filter_config(const filter* f, const strbuf* name, const strbuf* value) {
       (const char *)name->x,
       (int)value->len,
       (const char *)value->x);
-    return f->plugin->config(f->userdata, name,value);
+    MEMACCT_CALL(MEMACCT_FILTER, r, f->plugin->config(f->userdata, name,value));
+    return r;
 }
 
 int filter_global_init(void) {
@@ -160,7 +168,7 @@ int filter_submit_frame(filter* f, const frame* frame) {
     receiver.handle = f;
     receiver.submit_frame = filter_submit_frame_wrapper;
 
-    r = f->plugin->submit_frame(f->userdata, frame, &receiver);
+    MEMACCT_CALL(MEMACCT_FILTER, r, f->plugin->submit_frame(f->userdata, frame, &receiver));
     if(r == 0) {
         ich_time_now(&f->ts);
         f->counter++;
@@ -169,11 +177,15 @@ int filter_submit_frame(filter* f, const frame* frame) {
 }
 
 int filter_flush(const filter* f) {
-    return f->plugin->flush(f->userdata, &f->frame_receiver);
+    int r;
+    MEMACCT_CALL(MEMACCT_FILTER, r, f->plugin->flush(f->userdata, &f->frame_receiver));
+    return r;
 }
 
 int filter_reset(const filter* f) {
-    return f->plugin->reset(f->userdata);
+    int r;
+    MEMACCT_CALL(MEMACCT_FILTER, r, f->plugin->reset(f->userdata));
+    return r;
 }
 
 void filter_dump_counters(const filter* f, const strbuf* prefix) {
@@ -1,4 +1,6 @@
 #include "frame.h"
+#include "sample_pool.h"
+#include "memacct.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -9,6 +11,8 @@
 
 void frame_init(frame* f) {
     membuf_init(&f->samples);
+    membuf_init(&f->planes);
+    f->stride = 0;
     packet_init(&f->packet);
     f->channels = 0;
     f->duration = 0;
@@ -25,11 +29,18 @@ void frame_free(frame* f) {
     m = (membuf*)f->samples.x;
     len = f->samples.len / sizeof(membuf);
 
+    /* channels point into f->planes */
     for(i=0;i<len;i++) {
-        membuf_free(&m[i]);
+        membuf_init(&m[i]);
     }
     membuf_free(&f->samples);
 
+    if(f->planes.a != 0) {
+        memacct_resize(f->planes.acct, f->planes.a, 0);
+        sample_pool_put(f->planes.x, f->planes.a);
+    }
+    membuf_init(&f->planes);
+
     packet_free(&f->packet);
     frame_init(f);
 }
@@ -87,11 +98,73 @@ int frame_ready(frame* f) {
     return 0;
 }
 
+#define FRAME_ALIGN_UP(x) (((x) + (FRAME_ALIGN - 1)) & ~((size_t)FRAME_ALIGN - 1))
+
+static inline uint8_t* frame_planes_base(const frame* f) {
+    return (uint8_t*)FRAME_ALIGN_UP((uintptr_t)f->planes.x);
+}
+
+/* makes room for planes channels of len bytes each in the
+ * contiguous block, growing it if needed. f->planes.len tracks
+ * how many bytes of the block are in use so existing samples
+ * can be carried over into a new block */
+static int frame_planes_ready(frame* f, size_t planes, size_t len) {
+    void* p;
+    size_t a;
+    size_t i;
+    size_t copy;
+    size_t stride;
+    size_t old_planes;
+    uint8_t* base;
+    uint8_t* old;
+    membuf* m;
+
+    stride = FRAME_ALIGN_UP(len);
+
+    if(stride > f->stride || f->stride * planes > f->planes.a - (frame_planes_base(f) - f->planes.x)) {
+        if( (p = sample_pool_get(stride * planes + FRAME_ALIGN - 1, &a)) == NULL) return -1;
+        base = (uint8_t*)FRAME_ALIGN_UP((uintptr_t)p);
+
+        /* pool blocks are rounded up, so spread any extra space
+         * between the channels - a frame that grows a bit at a
+         * time can keep the same block */
+        stride = ((a - (size_t)(base - (uint8_t*)p)) / planes) & ~((size_t)FRAME_ALIGN - 1);
+
+        if(f->planes.a != 0) {
+            old = frame_planes_base(f);
+            old_planes = f->stride == 0 ? 0 : f->planes.len / f->stride;
+            copy = f->stride < stride ? f->stride : stride;
+            for(i=0;i<planes && i<old_planes;i++) {
+                memcpy(&base[i * stride], &old[i * f->stride], copy);
+            }
+            sample_pool_put(f->planes.x, f->planes.a);
+        }
+
+        f->planes.acct = memacct_resize(f->planes.acct, f->planes.a, a);
+        f->planes.x = (uint8_t*)p;
+        f->planes.a = a;
+        f->stride = stride;
+    }
+
+    base = frame_planes_base(f);
+    f->planes.len = f->stride * planes;
+
+    for(i=0;i<f->samples.len / sizeof(membuf);i++) {
+        m = frame_get_channel_int(f,i);
+        if(i < planes) {
+            m->x = &base[i * f->stride];
+            m->a = f->stride;
+        } else {
+            membuf_init(m);
+        }
+    }
+
+    return 0;
+}
+
 int frame_buffer(frame* f) {
     int r;
-    size_t i;
     size_t samplesize;
-    membuf* m;
 
     if(f->duration == 0) return -1;
     if( (r = frame_ready(f)) != 0) return r;
@@ -99,24 +172,15 @@ int frame_buffer(frame* f) {
     samplesize = samplefmt_size(f->format);
 
     if(samplefmt_is_planar(f->format)) {
-        for(i=0;i<f->channels;i++) {
-            m = frame_get_channel_int(f,i);
-            if( (r = membuf_ready(m, samplesize * f->duration)) != 0) {
-                fprintf(stderr,"out of memory\n");
-                abort();
-                return r;
-            }
-        }
+        r = frame_planes_ready(f, f->channels, samplesize * f->duration);
     } else {
-        m = frame_get_channel_int(f,0);
-        if( (r = membuf_ready(m, f->channels * samplesize * f->duration)) != 0) {
-            fprintf(stderr,"out of memory\n");
-            abort();
-            return r;
-        }
+        r = frame_planes_ready(f, 1, f->channels * samplesize * f->duration);
     }
-
-    return 0;
+    if(r != 0) {
+        fprintf(stderr,"out of memory\n");
+        abort();
+    }
+    return r;
 }
 
 int frame_fill(frame* f, unsigned int duration) {
@@ -201,6 +265,8 @@ int frame_append_convert(frame* dest, const frame* src, samplefmt format) {
     membuf* dest_buf;
     int src_planar, dest_planar;
     size_t duration;
+    const void* src_planes[SAMPLEFMT_INTERLEAVE_MAX_CHANNELS];
+    void* dest_planes[SAMPLEFMT_INTERLEAVE_MAX_CHANNELS];
 
     if(dest->sample_rate != src->sample_rate) return -1;
 
@@ -230,6 +296,26 @@ int frame_append_convert(frame* dest, const frame* src, samplefmt format) {
         return 0;
     }
 
+    /* interleaving or deinterleaving, done in a single pass when
+     * the planes fit in our arrays */
+    if(src->channels <= SAMPLEFMT_INTERLEAVE_MAX_CHANNELS) {
+        if(!src_planar) {
+            src_buf = frame_get_channel_int(src,0);
+            for(i=0;i<src->channels;i++) {
+                dest_planes[i] = &frame_get_channel_int(dest,i)->x[duration * samplefmt_size(dest->format)];
+            }
+            samplefmt_deinterleave(dest_planes,src_buf->x,src->format,dest->format,src->duration,src->channels);
+            return 0;
+        }
+
+        dest_buf = frame_get_channel_int(dest,0);
+        for(i=0;i<src->channels;i++) {
+            src_planes[i] = frame_get_channel_int(src,i)->x;
+        }
+        samplefmt_interleave(&dest_buf->x[duration * samplefmt_size(dest->format) * dest->channels],src_planes,src->format,dest->format,src->duration,src->channels);
+        return 0;
+    }
+
     if(!src_planar && dest_planar) {
         for(i=0;i<src->channels;i++) {
             src_buf  = frame_get_channel_int(src,0);
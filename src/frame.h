@@ -5,9 +5,19 @@
 #include "membuf.h"
 #include "packet.h"
 
+/* sample data is kept in a single block, each channel starting
+ * on a FRAME_ALIGN boundary and f->stride bytes after the previous
+ * one. Channels that get processed together stay close in memory,
+ * and every channel is aligned for vector loads and stores. The
+ * samples are reached through frame_get_channel_samples(), plugins
+ * don't need to care. */
+#define FRAME_ALIGN 64
+
 /* represents a frame of audio */
 struct frame {
     membuf samples; /* in planer formats this has as many elements as there are channels */
+    membuf planes;  /* the block holding every channel */
+    size_t stride;  /* bytes between the start of each channel */
     samplefmt format;
     unsigned int channels;
     unsigned int duration; /* duration given in number of samples */
@@ -57,6 +67,8 @@ typedef struct frame_receiver frame_receiver;
 
 #define FRAME_ZERO { \
     .samples = MEMBUF_ZERO, \
+    .planes = MEMBUF_ZERO, \
+    .stride = 0, \
     .format = SAMPLEFMT_UNKNOWN, \
     .channels = 0, \
     .duration = 0, \
@@ -103,6 +115,9 @@ int frame_copy(frame*, const frame*);
 
 int frame_convert(frame*, const frame*, samplefmt fmt);
 
+/* appends src to dest, converting it to fmt */
+int frame_append_convert(frame*, const frame*, samplefmt fmt);
+
 int frame_append(frame*, const frame*);
 
 /* move sample data from one frame to another,
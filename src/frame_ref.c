@@ -0,0 +1,75 @@
+#include "frame_ref.h"
+
+#include <stdlib.h>
+
+void frame_ref_pool_init(frame_ref_pool* pool) {
+    thread_atomic_ptr_store(&pool->free, NULL);
+    membuf_init(&pool->all);
+}
+
+void frame_ref_pool_free(frame_ref_pool* pool) {
+    size_t i;
+    size_t len;
+    frame_ref** refs;
+
+    len = pool->all.len / sizeof(frame_ref*);
+    refs = (frame_ref**)pool->all.x;
+
+    for(i=0;i<len;i++) {
+        frame_free(&refs[i]->frame);
+        free(refs[i]);
+    }
+
+    membuf_free(&pool->all);
+    thread_atomic_ptr_store(&pool->free, NULL);
+}
+
+frame_ref* frame_ref_pool_get(frame_ref_pool* pool) {
+    frame_ref* ref;
+    frame_ref* next;
+
+    /* only the source thread pops from the stack, so the usual
+     * ABA problem with a lock-free stack can't happen here */
+    ref = (frame_ref*)thread_atomic_ptr_load(&pool->free);
+    while(ref != NULL) {
+        next = ref->next;
+        if(thread_atomic_ptr_compare_and_swap(&pool->free, ref, next) == ref) {
+            ref->next = NULL;
+            return ref;
+        }
+        ref = (frame_ref*)thread_atomic_ptr_load(&pool->free);
+    }
+
+    ref = (frame_ref*)malloc(sizeof(frame_ref));
+    if(ref == NULL) return NULL;
+
+    if(membuf_append(&pool->all, &ref, sizeof(frame_ref*)) != 0) {
+        free(ref);
+        return NULL;
+    }
+
+    frame_init(&ref->frame);
+    thread_atomic_int_store(&ref->refs, 0);
+    ref->pool = pool;
+    ref->next = NULL;
+
+    return ref;
+}
+
+void frame_ref_retain(frame_ref* ref, int count) {
+    thread_atomic_int_add(&ref->refs, count);
+}
+
+void frame_ref_discard(frame_ref* ref) {
+    frame_ref* head;
+
+    do {
+        head = (frame_ref*)thread_atomic_ptr_load(&ref->pool->free);
+        ref->next = head;
+    } while(thread_atomic_ptr_compare_and_swap(&ref->pool->free, head, ref) != head);
+}
+
+void frame_ref_release(frame_ref* ref) {
+    if(thread_atomic_int_dec(&ref->refs) != 1) return;
+    frame_ref_discard(ref);
+}
@@ -0,0 +1,60 @@
+#ifndef FRAME_REF_H
+#define FRAME_REF_H
+
+/* a reference-counted, read-only frame that a source
+ * thread can hand to many destination threads at once.
+ *
+ * The source thread fills in the frame, sets the reference
+ * count to the number of readers, and publishes the same
+ * pointer to every reader. Each reader calls frame_ref_release
+ * when it's done with it, the last one to release puts it
+ * back into the pool it came from.
+ *
+ * Only one thread (the source thread) may call frame_ref_pool_get,
+ * any thread may call frame_ref_release. */
+
+#include "frame.h"
+#include "membuf.h"
+#include "thread.h"
+
+typedef struct frame_ref_pool frame_ref_pool;
+typedef struct frame_ref frame_ref;
+
+struct frame_ref {
+    frame frame;
+    thread_atomic_int_t refs;
+    frame_ref_pool* pool;
+    frame_ref* next;
+};
+
+struct frame_ref_pool {
+    thread_atomic_ptr_t free; /* stack of released frame_refs */
+    membuf all; /* every frame_ref this pool allocated */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void frame_ref_pool_init(frame_ref_pool*);
+
+/* frees every frame_ref the pool has handed out, whether
+ * it was released or not, so all readers need to be finished */
+void frame_ref_pool_free(frame_ref_pool*);
+
+/* returns a frame_ref with a reference count of zero,
+ * or NULL on allocation failure */
+frame_ref* frame_ref_pool_get(frame_ref_pool*);
+
+void frame_ref_retain(frame_ref*, int count);
+void frame_ref_release(frame_ref*);
+
+/* puts a frame_ref nobody holds a reference to back into
+ * its pool, for when it never got handed out */
+void frame_ref_discard(frame_ref*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,5 +1,6 @@
 #include "input.h"
 #include "input_plugin.h"
+#include "memacct.h"
 
 #include <stddef.h>
 #include <stdlib.h>
@@ -34,6 +35,7 @@ void input_free(input* in) {
 }
 
 int input_create(input* in, const strbuf* name) {
+    int r;
     const input_plugin* plug;
     void* userdata;
 
@@ -56,10 +58,13 @@ int input_create(input* in, const strbuf* name) {
     in->userdata = userdata;
     in->plugin = plug;
 
-    return in->plugin->create(in->userdata);
+    MEMACCT_CALL(MEMACCT_INPUT, r, in->plugin->create(in->userdata));
+    return r;
 }
 
 int input_open(input* in) {
+    int r;
+
     if(in->plugin == NULL || in->userdata == NULL) {
         logs_error("plugin not selected");
         return -1;
@@ -71,11 +76,14 @@ int input_open(input* in) {
     log_debug("opening %.*s plugin",
       (int)in->plugin->name->len,
       (const char *)in->plugin->name->x);
-    return in->plugin->open(in->userdata);
+    MEMACCT_CALL(MEMACCT_INPUT, r, in->plugin->open(in->userdata));
+    return r;
 }
 
 size_t input_read(input* in, void* dest, size_t len) {
-    size_t r = in->plugin->read(in->userdata,dest,len, &in->tag_handler);
+    size_t r;
+
+    MEMACCT_CALL(MEMACCT_INPUT, r, in->plugin->read(in->userdata,dest,len, &in->tag_handler));
     if(r) {
         ich_time_now(&in->ts);
         in->counter++;
@@ -84,6 +92,8 @@ size_t input_read(input* in, void* dest, size_t len) {
 }
 
 int input_config(const input* in, const strbuf* name, const strbuf* value) {
+    int r;
+
     log_debug("configuring plugin %.*s %.*s=%.*s",
       (int)in->plugin->name->len,
       (const char *)in->plugin->name->x,
@@ -91,7 +101,8 @@ int input_config(const input* in, const strbuf* name, const strbuf* value) {
       (const char *)name->x,
       (int)value->len,
       (const char *)value->x);
-    return in->plugin->config(in->userdata,name,value);
+    MEMACCT_CALL(MEMACCT_INPUT, r, in->plugin->config(in->userdata,name,value));
+    return r;
 }
 
 int input_global_init(void) {
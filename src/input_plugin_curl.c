@@ -1,5 +1,6 @@
 #include "input_plugin_curl.h"
 #include "ich_time.h"
+#include "bytequeue.h"
 
 #include <curl/curl.h>
 
@@ -26,7 +27,7 @@ static STRBUF_CONST(ICY_URL,"icy_url");
 
 struct input_plugin_curl_userdata {
     strbuf url;
-    strbuf buffer;
+    bytequeue buffer;
     strbuf tmp;
     taglist tags;
     CURL* handle;
@@ -157,7 +158,7 @@ static size_t input_plugin_curl_read_nometaint(input_plugin_curl_userdata* userd
     if(r > len) r = len;
 
     memcpy(dest,userdata->buffer.x,r);
-    membuf_trim(&userdata->buffer,r);
+    bytequeue_consume(&userdata->buffer,r);
 
     return r;
 }
@@ -258,7 +259,7 @@ static size_t input_plugin_curl_read_metaint(input_plugin_curl_userdata* userdat
                     if(parse_icy_data(userdata, s, handler) != 0) return 0;
                 }
             }
-            membuf_trim(&userdata->buffer,s+1);
+            bytequeue_consume(&userdata->buffer,s+1);
             userdata->metaread = 0;
             continue;
         }
@@ -274,7 +275,7 @@ static size_t input_plugin_curl_read_metaint(input_plugin_curl_userdata* userdat
     if(r > len) r = len;
 
     memcpy(dest,userdata->buffer.x,r);
-    membuf_trim(&userdata->buffer,r);
+    bytequeue_consume(&userdata->buffer,r);
 
     return r;
 }
@@ -291,7 +292,7 @@ static int input_plugin_curl_create(void* ud) {
     input_plugin_curl_userdata* userdata = (input_plugin_curl_userdata*)ud;
 
     strbuf_init(&userdata->url);
-    strbuf_init(&userdata->buffer);
+    bytequeue_init(&userdata->buffer);
     strbuf_init(&userdata->tmp);
     taglist_init(&userdata->tags);
     userdata->handle   = NULL;
@@ -328,7 +329,7 @@ static void input_plugin_curl_close(void* ud) {
     }
 
     strbuf_free(&userdata->url);
-    strbuf_free(&userdata->buffer);
+    bytequeue_free(&userdata->buffer);
     strbuf_free(&userdata->tmp);
     taglist_free(&userdata->tags);
 
@@ -450,7 +451,7 @@ static size_t input_plugin_curl_write_callback(char* ptr, size_t size, size_t nm
 
     if(size*nmemb == 0) return 0;
 
-    if(strbuf_append(&userdata->buffer,ptr,size*nmemb) != 0) {
+    if(bytequeue_append(&userdata->buffer,ptr,size*nmemb) != 0) {
         LOGERRNO("error appending data to buffer");
         return 0;
     }
@@ -8,6 +8,10 @@
 #include "ich_time.h"
 #include "logger.h"
 #include "version.h"
+#include "sample_pool.h"
+#include "memacct.h"
+#include "samplefmt.h"
+#include "crc32.h"
 
 #include "input_plugin.h"
 #include "demuxer_plugin.h"
@@ -38,6 +42,7 @@
 
 struct app_config {
     uint8_t shortflag;
+    size_t workers; /* if non-zero, run destinations on a pool of this many threads */
     sourcelist* slist;
     destinationlist* dlist;
     tagmap* tagmap;
@@ -48,6 +53,7 @@ typedef struct app_config app_config;
 
 void app_config_init(app_config* config) {
     config->shortflag = 1; /* default is to stop all other streams on a source ending */
+    config->workers = 0;
     sourcelist_init(config->slist);
     destinationlist_init(config->dlist);
     tagmap_init(config->tagmap);
@@ -59,6 +65,7 @@ void app_config_free(app_config* config) {
 
     logger_set_prefix("main",4);
     logger_set_level(logger_get_default_level());
+    memacct_set_owner(0);
     tagmap_free(config->tagmap);
 }
 
@@ -83,6 +90,7 @@ static int config_handler(void* user, const char* section, const char* name, con
 
     logger_set_prefix("main",4);
     logger_set_level(logger_get_default_level());
+    memacct_set_owner(0);
 
     if(strbuf_begins_cstr(&section_buf,"source.")) {
         if(section_buf.len < strlen("source.") + 1) {
@@ -128,6 +136,35 @@ static int config_handler(void* user, const char* section, const char* name, con
             return 0;
         }
 
+        if(strbuf_equals_cstr(&name_buf,"memory-accounting") ||
+           strbuf_equals_cstr(&name_buf,"memory accounting")) {
+            if(strbuf_truthy(&value_buf)) {
+                memacct_set_enabled(1);
+                return 1;
+            }
+            if(strbuf_falsey(&value_buf)) {
+                memacct_set_enabled(0);
+                return 1;
+            }
+            fprintf(stderr,"[config] section %s: unknown value %s for option %s\n",section, value,name);
+            return 0;
+        }
+
+        if(strbuf_equals_cstr(&name_buf,"workers")) {
+            if(strbuf_caseequals_cstr(&value_buf,"auto")) {
+                config->workers = affinity_cpu_count();
+                return 1;
+            }
+            if(strbuf_falsey(&value_buf) || strbuf_caseequals_cstr(&value_buf,"none")) {
+                config->workers = 0;
+                return 1;
+            }
+            config->workers = strbuf_strtoul(&value_buf,10);
+            if(config->workers != 0) return 1;
+            fprintf(stderr,"[config] section %s: unknown value %s for option %s\n",section, value,name);
+            return 0;
+        }
+
         if(strbuf_equals_cstr(&name_buf,"loglevel") ||
            strbuf_equals_cstr(&name_buf,"log-level") ||
            strbuf_equals_cstr(&name_buf,"log level")) {
@@ -197,6 +234,8 @@ static int link_destinations(sourcelist* slist, destinationlist* dlist, tagmap *
 
     for(i=0;i<len;i++) {
         de = destinationlist_get(dlist,i);
+        /* fed by another destination's encoder */
+        if(de->destination.leader != NULL) continue;
         if(de->destination.source_id.len == 0) {
             fprintf(stderr,"error: destination %.*s has no source configured\n",
             (int)de->id.len,(char *)de->id.x);
@@ -209,6 +248,12 @@ static int link_destinations(sourcelist* slist, destinationlist* dlist, tagmap *
             return -1;
         }
         de->destination.source = &se->source;
+        if(affinity_resolve(&de->affinity, &se->affinity) != 0) {
+            fprintf(stderr,"error: destination %.*s has affinity = auto, but source %.*s has no affinity set\n",
+            (int)de->id.len,(char *)de->id.x,
+            (int)se->id.len,(char *)se->id.x);
+            return -1;
+        }
 
         sync = &de->sync;
         if( (r = membuf_append(&se->destination_syncs,&sync,sizeof(destination_sync*))) != 0) {
@@ -243,11 +288,15 @@ static int link_destinations(sourcelist* slist, destinationlist* dlist, tagmap *
 
 static sourcelist slist;
 static destinationlist dlist;
+static worker_pool pool;
+static STRBUF_CONST(main_prefix,"[main]");
 
 void sig_handler(int sig) {
     if(sig == SIGUSR1) {
         sourcelist_dump_counters(&slist);
         destinationlist_dump_counters(&dlist);
+        sample_pool_dump_counters();
+        memacct_dump_counters(0, &main_prefix);
     }
 }
 
@@ -339,10 +388,28 @@ int main(int argc, const char* argv[]) {
     config.tagmap = &tagmap;
     config.now = &now;
 
+    worker_pool_init(&pool);
+
     if( (r = logger_tls_init()) != 0) {
         return 1;
     }
 
+    if( (r = sample_pool_global_init()) != 0) {
+        return 1;
+    }
+
+    if( (r = memacct_global_init()) != 0) {
+        return 1;
+    }
+
+    if( (r = samplefmt_global_init()) != 0) {
+        return 1;
+    }
+
+    if( (r = crc32_global_init()) != 0) {
+        return 1;
+    }
+
     while(argc) {
         if(strcmp(*argv,"-V") == 0) {
             return dump_version_info(0);
@@ -362,6 +429,7 @@ int main(int argc, const char* argv[]) {
 
     logger_set_prefix("main",4);
     logger_set_level(logger_get_default_level());
+    memacct_set_owner(0);
 
     ich_time_now(&now);
 
@@ -390,9 +458,15 @@ int main(int argc, const char* argv[]) {
 
     logger_set_prefix("main",4);
     logger_set_level(logger_get_default_level());
+    memacct_set_owner(0);
 
     prep_tagmaps(&tagmap);
 
+    r = destinationlist_share_encoders(&dlist);
+    if(r != 0) {
+        goto cleanup;
+    }
+
     r = link_destinations(&slist,&dlist,&tagmap);
     if(r != 0) {
         goto cleanup;
@@ -403,6 +477,8 @@ int main(int argc, const char* argv[]) {
         goto cleanup;
     }
 
+    if(config.workers != 0) destinationlist_use_workers(&dlist);
+
     if( (r = destinationlist_open(&dlist,&now)) != 0) {
         fprintf(stderr,"[main] error opening a destination\n");
         goto cleanup;
@@ -410,17 +486,31 @@ int main(int argc, const char* argv[]) {
 
     logger_set_prefix("main",4);
     logger_set_level(logger_get_default_level());
+    memacct_set_owner(0);
 
-    destinationlist_start(&dlist);
+    if(config.workers != 0) {
+        if( (r = worker_pool_create(&pool,config.workers)) != 0) {
+            fprintf(stderr,"[main] error allocating worker pool\n");
+            goto cleanup;
+        }
+    }
+
+    if( (r = destinationlist_start(&dlist,config.workers != 0 ? &pool : NULL)) != 0) {
+        fprintf(stderr,"[main] error starting destinations\n");
+        goto cleanup;
+    }
     sourcelist_start(&slist);
     ret = sourcelist_wait(&slist) != 0;
-    destinationlist_wait(&dlist);
+    destinationlist_wait(&dlist,config.workers != 0 ? &pool : NULL);
 
     cleanup:
     app_config_free(&config);
+    worker_pool_free(&pool);
     source_global_deinit();
     destination_global_deinit();
     default_tagmap_deinit();
+    sample_pool_global_deinit();
+    memacct_global_deinit();
 
     logger_thread_cleanup();
     logger_tls_deinit();
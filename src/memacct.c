@@ -0,0 +1,152 @@
+#include "memacct.h"
+#include "thread.h"
+
+#define LOG_PREFIX "[memacct]"
+#include "logger.h"
+
+#define MEMACCT_ACCOUNTS (MEMACCT_MAX_OWNERS * MEMACCT_SUBSYSTEMS)
+
+struct memacct_counter {
+    thread_atomic_uint_t cur;    /* bytes allocated right now */
+    thread_atomic_uint_t peak;   /* highest cur has been */
+    thread_atomic_uint_t allocs; /* allocations and reallocations */
+};
+
+typedef struct memacct_counter memacct_counter;
+
+static memacct_counter counters[MEMACCT_ACCOUNTS];
+static thread_atomic_uint_t owners;
+static int enabled = 0;
+
+/* the thread's current account + 1, cast to a pointer, so
+ * NULL means owner 0 + MEMACCT_OTHER */
+static thread_tls_t context = NULL;
+
+static const char* const subsystem_names[MEMACCT_SUBSYSTEMS] = {
+    "other",
+    "input",
+    "demuxer",
+    "decoder",
+    "queue",
+    "filter",
+    "encoder",
+    "muxer",
+    "output",
+};
+
+int memacct_global_init(void) {
+    size_t i;
+
+    for(i=0;i<MEMACCT_ACCOUNTS;i++) {
+        thread_atomic_uint_store(&counters[i].cur, 0);
+        thread_atomic_uint_store(&counters[i].peak, 0);
+        thread_atomic_uint_store(&counters[i].allocs, 0);
+    }
+    /* owner 0 is the main thread */
+    thread_atomic_uint_store(&owners, 1);
+
+    context = thread_tls_create();
+    return context == NULL ? -1 : 0;
+}
+
+void memacct_global_deinit(void) {
+    enabled = 0;
+    if(context != NULL) thread_tls_destroy(context);
+    context = NULL;
+}
+
+void memacct_set_enabled(int e) {
+    enabled = e;
+}
+
+unsigned int memacct_owner(void) {
+    unsigned int owner = thread_atomic_uint_inc(&owners);
+    return owner < MEMACCT_MAX_OWNERS ? owner : 0;
+}
+
+static inline unsigned int memacct_context(void) {
+    return (unsigned int)(uintptr_t)thread_tls_get(context);
+}
+
+void memacct_set_owner(unsigned int owner) {
+    if(!enabled) return;
+    thread_tls_set(context, (void*)(uintptr_t)((owner * MEMACCT_SUBSYSTEMS) + MEMACCT_OTHER + 1));
+}
+
+unsigned int memacct_get_owner(void) {
+    unsigned int ctx;
+
+    if(!enabled) return 0;
+    ctx = memacct_context();
+    return ctx == 0 ? 0 : (ctx - 1) / MEMACCT_SUBSYSTEMS;
+}
+
+unsigned int memacct_enter(memacct_subsystem s) {
+    unsigned int prev;
+
+    if(!enabled) return 0;
+
+    prev = memacct_context();
+    thread_tls_set(context, (void*)(uintptr_t)((memacct_get_owner() * MEMACCT_SUBSYSTEMS) + s + 1));
+    return prev;
+}
+
+void memacct_leave(unsigned int prev) {
+    if(!enabled) return;
+    thread_tls_set(context, (void*)(uintptr_t)prev);
+}
+
+uint32_t memacct_resize(uint32_t acct, size_t old_a, size_t new_a) {
+    unsigned int cur;
+    unsigned int peak;
+    unsigned int prev;
+    unsigned int delta;
+    memacct_counter* c;
+
+    if(old_a == 0) {
+        /* a new buffer, whatever was in acct is left over */
+        if(!enabled || new_a == 0) return 0;
+        acct = memacct_context();
+        if(acct == 0) acct = MEMACCT_OTHER + 1;
+    }
+
+    if(acct == 0 || acct > MEMACCT_ACCOUNTS) return 0;
+    c = &counters[acct - 1];
+
+    if(new_a > old_a) {
+        delta = (unsigned int)(new_a - old_a);
+        cur = thread_atomic_uint_add(&c->cur, delta) + delta;
+        thread_atomic_uint_inc(&c->allocs);
+
+        peak = thread_atomic_uint_load(&c->peak);
+        while(cur > peak) {
+            prev = thread_atomic_uint_compare_and_swap(&c->peak, peak, cur);
+            if(prev == peak) break;
+            peak = prev;
+        }
+    } else if(new_a < old_a) {
+        thread_atomic_uint_sub(&c->cur, (unsigned int)(old_a - new_a));
+    }
+
+    return new_a == 0 ? 0 : acct;
+}
+
+void memacct_dump_counters(unsigned int owner, const strbuf* prefix) {
+    size_t i;
+    unsigned int allocs;
+    memacct_counter* c;
+
+    if(!enabled) return;
+    if(owner >= MEMACCT_MAX_OWNERS) return;
+
+    for(i=0;i<MEMACCT_SUBSYSTEMS;i++) {
+        c = &counters[(owner * MEMACCT_SUBSYSTEMS) + i];
+        if( (allocs = thread_atomic_uint_load(&c->allocs)) == 0) continue;
+        log_info("%.*s memory %s: current=%ukB peak=%ukB allocs=%u",
+          (int)prefix->len,(const char*)prefix->x,
+          subsystem_names[i],
+          thread_atomic_uint_load(&c->cur) / 1024,
+          thread_atomic_uint_load(&c->peak) / 1024,
+          allocs);
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef MEMACCT_H
+#define MEMACCT_H
+
+/* optional memory accounting, turned on with the
+ * "memory-accounting" option.
+ *
+ * Every buffer allocated through membuf, strbuf, bytequeue or
+ * the sample pool gets charged to an account, which is the
+ * owner (a source, a destination, or 0 for the main thread)
+ * and the subsystem that allocated it (input, encoder, ...).
+ * The owner is set per-thread, at the same spots the logger
+ * prefix is. The subsystem is set by the input/demuxer/decoder/
+ * filter/encoder/muxer/output wrappers around their plugin calls
+ * (and "queue" is a source copying frames and tags for its
+ * destinations), and restored afterwards, so a muxer allocating
+ * something while the encoder is handing it a packet still
+ * counts as the muxer.
+ *
+ * A buffer remembers which account it was charged to, so growing
+ * or freeing it (on any thread) updates that same account.
+ *
+ * Each account tracks current bytes, peak bytes and the number
+ * of allocations. These are 32-bit, a single account can't
+ * track more than 4GB. */
+
+#include "strbuf.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum memacct_subsystem {
+    MEMACCT_OTHER = 0,
+    MEMACCT_INPUT,
+    MEMACCT_DEMUXER,
+    MEMACCT_DECODER,
+    MEMACCT_QUEUE,
+    MEMACCT_FILTER,
+    MEMACCT_ENCODER,
+    MEMACCT_MUXER,
+    MEMACCT_OUTPUT,
+    MEMACCT_SUBSYSTEMS,
+};
+
+typedef enum memacct_subsystem memacct_subsystem;
+
+/* most sources + destinations we'll track, anything
+ * past this gets counted as the main thread */
+#define MEMACCT_MAX_OWNERS 256
+
+/* runs expr with the calling thread's allocations charged to
+ * subsystem s, storing the result in r */
+#define MEMACCT_CALL(s, r, expr) do { \
+    unsigned int memacct_prev = memacct_enter(s); \
+    r = (expr); \
+    memacct_leave(memacct_prev); \
+} while(0)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int memacct_global_init(void);
+void memacct_global_deinit(void);
+
+void memacct_set_enabled(int enabled);
+
+/* returns a new owner id, call before any threads are started */
+unsigned int memacct_owner(void);
+
+/* sets the owner for the calling thread, and resets
+ * the subsystem to MEMACCT_OTHER */
+void memacct_set_owner(unsigned int owner);
+
+/* returns the calling thread's owner, for handing to
+ * threads started on its behalf */
+unsigned int memacct_get_owner(void);
+
+/* switches the calling thread's subsystem, returns the
+ * previous state to hand to memacct_leave */
+unsigned int memacct_enter(memacct_subsystem);
+void memacct_leave(unsigned int prev);
+
+/* updates accounting for a buffer going from old_a bytes to
+ * new_a bytes (0 if it's being freed). acct is the account the
+ * buffer was charged to, or 0 if it hasn't been charged yet.
+ * Returns the account to store with the buffer */
+uint32_t memacct_resize(uint32_t acct, size_t old_a, size_t new_a);
+
+void memacct_dump_counters(unsigned int owner, const strbuf* prefix);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
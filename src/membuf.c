@@ -1,4 +1,5 @@
 #include "membuf.h"
+#include "memacct.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -10,6 +11,7 @@ void membuf_init(membuf* m) {
     m->a = 0;
     m->len = 0;
     m->blocksize = BLOCKSIZE;
+    m->acct = 0;
 }
 
 void membuf_init_bs(membuf* m, size_t bs) {
@@ -17,6 +19,7 @@ void membuf_init_bs(membuf* m, size_t bs) {
     m->a = 0;
     m->len = 0;
     m->blocksize = bs;
+    m->acct = 0;
 }
 
 void membuf_reset(membuf* m) {
@@ -24,10 +27,14 @@ void membuf_reset(membuf* m) {
 }
 
 void membuf_free(membuf* m) {
-    if(m->a != 0) free(m->x);
+    if(m->a != 0) {
+        memacct_resize(m->acct, m->a, 0);
+        free(m->x);
+    }
     m->x = NULL;
     m->len = 0;
     m->a = 0;
+    m->acct = 0;
 }
 
 int membuf_ready(membuf* m, size_t len) {
@@ -37,6 +44,7 @@ int membuf_ready(membuf* m, size_t len) {
         a = (len + (m->blocksize-1)) & -m->blocksize;
         t = realloc(m->x, a);
         if(t == NULL) return -1;
+        m->acct = memacct_resize(m->acct, m->a, a);
         m->x = t;
         m->a = a;
     }
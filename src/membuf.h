@@ -12,11 +12,12 @@ struct membuf {
     size_t len;
     size_t blocksize;
     uint8_t* x;
+    uint32_t acct; /* memory accounting, see memacct.h */
 };
 
 typedef struct membuf membuf;
 
-#define MEMBUF_ZERO { .a = 0, .len = 0, .blocksize = 512, .x = NULL }
+#define MEMBUF_ZERO { .a = 0, .len = 0, .blocksize = 512, .x = NULL, .acct = 0 }
 
 #ifdef __cplusplus
 extern "C" {
@@ -380,6 +380,14 @@ enum MINIFLAC_CONTAINER {
     MINIFLAC_CONTAINER_OGG,
 };
 
+/* which frame CRCs get computed and checked, for sources
+ * that are already trusted */
+enum MINIFLAC_VERIFY {
+    MINIFLAC_VERIFY_FULL,    /* frame header CRC-8 and frame CRC-16 (default) */
+    MINIFLAC_VERIFY_HEADERS, /* only the frame header CRC-8 */
+    MINIFLAC_VERIFY_NONE,    /* no CRCs at all */
+};
+
 enum MFLAC_RESULT {
     MFLAC_EOF          = 0,
     MFLAC_OK           = 1,
@@ -394,6 +402,8 @@ struct miniflac_bitreader_s {
     uint8_t  bits;
     uint8_t  crc8;
     uint16_t crc16;
+    uint8_t  verify; /* a MINIFLAC_VERIFY value */
+    uint8_t  crc;    /* non-zero if crc8/crc16 are being updated */
     uint32_t pos;
     uint32_t len;
     const uint8_t* buffer;
@@ -651,6 +661,7 @@ typedef enum MINIFLAC_FRAME_HEADER_STATE MINIFLAC_FRAME_HEADER_STATE;
 typedef enum MINIFLAC_FRAME_STATE MINIFLAC_FRAME_STATE;
 typedef enum MINIFLAC_STATE MINIFLAC_STATE;
 typedef enum MINIFLAC_CONTAINER MINIFLAC_CONTAINER;
+typedef enum MINIFLAC_VERIFY MINIFLAC_VERIFY;
 typedef enum MFLAC_RESULT MFLAC_RESULT;
 
 #ifdef __cplusplus
@@ -669,6 +680,22 @@ MINIFLAC_API
 void
 miniflac_init(miniflac_t* pFlac, MINIFLAC_CONTAINER container);
 
+/* set which CRCs to check, call after miniflac_init */
+MINIFLAC_API
+void
+miniflac_set_verify(miniflac_t* pFlac, MINIFLAC_VERIFY verify);
+
+/* updates a running frame header CRC-8 or frame CRC-16 with len bytes,
+ * start from 0. Running the CRC-16 over a whole frame, footer
+ * included, gives 0 for an intact frame */
+MINIFLAC_API
+uint8_t
+miniflac_crc8_update(uint8_t crc, const uint8_t* data, size_t len);
+
+MINIFLAC_API
+uint16_t
+miniflac_crc16_update(uint16_t crc, const uint8_t* data, size_t len);
+
 /* sync to the next metadata block or frame, parses the metadata header or frame header */
 MINIFLAC_API
 MINIFLAC_RESULT
@@ -2084,7 +2111,9 @@ miniflac_version_string(void) {
 static
 void
 miniflac_oggreset(miniflac_t* pFlac) {
+    uint8_t verify = pFlac->br.verify;
     miniflac_bitreader_init(&pFlac->br);
+    miniflac_set_verify(pFlac, (MINIFLAC_VERIFY)verify);
     miniflac_oggheader_init(&pFlac->oggheader);
     miniflac_streammarker_init(&pFlac->streammarker);
     miniflac_metadata_init(&pFlac->metadata);
@@ -2171,6 +2200,13 @@ miniflac_init(miniflac_t* pFlac, MINIFLAC_CONTAINER container) {
     pFlac->state = MINIFLAC_STREAMMARKER;
 }
 
+MINIFLAC_API
+void
+miniflac_set_verify(miniflac_t* pFlac, MINIFLAC_VERIFY verify) {
+    pFlac->br.verify = (uint8_t)verify;
+    pFlac->br.crc = verify != MINIFLAC_VERIFY_NONE;
+}
+
 static
 MINIFLAC_RESULT
 miniflac_sync_internal(miniflac_t* pFlac, miniflac_bitreader_t* br) {
@@ -2809,6 +2845,26 @@ static const uint16_t miniflac_crc16_table[256] = {
   0x8213, 0x0216, 0x021c, 0x8219, 0x0208, 0x820d, 0x8207, 0x0202,
 };
 
+MINIFLAC_API
+uint8_t
+miniflac_crc8_update(uint8_t crc, const uint8_t* data, size_t len) {
+    size_t i;
+    for(i=0;i<len;i++) {
+        crc = miniflac_crc8_table[crc ^ data[i]];
+    }
+    return crc;
+}
+
+MINIFLAC_API
+uint16_t
+miniflac_crc16_update(uint16_t crc, const uint8_t* data, size_t len) {
+    size_t i;
+    for(i=0;i<len;i++) {
+        crc = miniflac_crc16_table[ (crc >> 8) ^ data[i] ] ^ (( crc & 0x00FF ) << 8);
+    }
+    return crc;
+}
+
 MINIFLAC_PRIVATE
 void
 miniflac_bitreader_init(miniflac_bitreader_t* br) {
@@ -2816,6 +2872,8 @@ miniflac_bitreader_init(miniflac_bitreader_t* br) {
     br->bits = 0;
     br->crc8 = 0;
     br->crc16 = 0;
+    br->verify = MINIFLAC_VERIFY_FULL;
+    br->crc = 1;
     br->pos = 0;
     br->len = 0;
     br->buffer = NULL;
@@ -2831,8 +2889,10 @@ miniflac_bitreader_fill(miniflac_bitreader_t* br, uint8_t bits) {
         byte = br->buffer[br->pos++];
         br->val = (br->val << 8) | byte;
         br->bits += 8;
-        br->crc8 = miniflac_crc8_table[br->crc8 ^ byte];
-        br->crc16 = miniflac_crc16_table[ (br->crc16 >> 8) ^ byte ] ^ (( br->crc16 & 0x00FF ) << 8);
+        if(br->crc) {
+            br->crc8 = miniflac_crc8_table[br->crc8 ^ byte];
+            br->crc16 = miniflac_crc16_table[ (br->crc16 >> 8) ^ byte ] ^ (( br->crc16 & 0x00FF ) << 8);
+        }
     }
     return br->bits < bits;
 }
@@ -2943,6 +3003,8 @@ miniflac_bitreader_reset_crc(miniflac_bitreader_t* br) {
 
     br->crc8 = 0;
     br->crc16 = 0;
+    br->crc = br->verify != MINIFLAC_VERIFY_NONE;
+    if(!br->crc) return;
 
     while(bits > 0) {
         mask = -1LL;
@@ -3267,7 +3329,7 @@ miniflac_frame_decode(miniflac_frame_t* frame, miniflac_bitreader_t* br, minifla
         case MINIFLAC_FRAME_FOOTER: {
             if(miniflac_bitreader_fill(br,16)) return MINIFLAC_CONTINUE;
             t = miniflac_bitreader_read(br,16);
-            if(frame->crc16 != t) {
+            if(br->verify == MINIFLAC_VERIFY_FULL && frame->crc16 != t) {
                 miniflac_abort();
                 return MINIFLAC_FRAME_CRC16_INVALID;
             }
@@ -3705,10 +3767,12 @@ miniflac_frame_header_decode(miniflac_frame_header_t* header, miniflac_bitreader
         case MINIFLAC_FRAME_HEADER_CRC8: {
             if(miniflac_bitreader_fill(br,8)) return MINIFLAC_CONTINUE;
             t = miniflac_bitreader_read(br,8);
-            if(header->crc8 != t) {
+            if(br->verify != MINIFLAC_VERIFY_NONE && header->crc8 != t) {
                 miniflac_abort();
                 return MINIFLAC_FRAME_CRC8_INVALID;
             }
+            /* nothing left to compute a crc for */
+            if(br->verify == MINIFLAC_VERIFY_HEADERS) br->crc = 0;
         }
         /* fall-through */
         default: break;
@@ -50,6 +50,16 @@ enum MINIOGG_DEMUX_STATE {
 
 typedef enum MINIOGG_DEMUX_STATE MINIOGG_DEMUX_STATE;
 
+/* which pages get their crc checked when demuxing */
+enum MINIOGG_VERIFY {
+    MINIOGG_VERIFY_FULL,    /* every page (default) */
+    MINIOGG_VERIFY_HEADERS, /* only pages with the bos flag or a granulepos of 0,
+                               which is where codec headers live */
+    MINIOGG_VERIFY_NONE,    /* no pages */
+};
+
+typedef enum MINIOGG_VERIFY MINIOGG_VERIFY;
+
 struct miniogg {
     /* when demuxing:
      *   all fields are automatically set and only
@@ -97,6 +107,9 @@ struct miniogg {
      * detects that the packet spans multiple pages */
     uint8_t continuation;
 
+    /* can be set before demuxing, defaults to MINIOGG_VERIFY_FULL */
+    MINIOGG_VERIFY verify;
+
     /* used to track demuxing state */
     MINIOGG_DEMUX_STATE demux_state;
     uint32_t header_pos;
@@ -144,7 +157,9 @@ uint32_t miniogg_available_space(const miniogg* p);
 /* ### DEMUXING API ### */
 
 /* returns 0 if the page was added fully, 1 if more bytes are needed,
- * the number of bytes read is returned in used */
+ * the number of bytes read is returned in used. Returns -1 if the
+ * page doesn't start with a capture pattern and -2 on a bad crc,
+ * either way the demuxer is ready for a new page afterwards */
 MINIOGG_API
 int miniogg_add_page(miniogg* p, const void* data, size_t len, size_t *used);
 
@@ -171,6 +186,11 @@ const void* miniogg_get_packet(const miniogg* p, uint32_t packetno, size_t *len,
 
 #include <string.h>
 
+/* define MINIOGG_CRC32 to a function that can be called like
+ * crc32() below to use your own (faster) crc implementation */
+#ifndef MINIOGG_CRC32
+#define MINIOGG_CRC32 crc32
+
 static const uint32_t crc32_table[256] = {
   0x00000000, 0x04C11DB7L, 0x09823B6EL, 0x0D4326D9L,
   0x130476DC, 0x17C56B6BL, 0x1A864DB2L, 0x1E475005L,
@@ -247,6 +267,7 @@ static inline uint32_t crc32(uint32_t crc, const uint8_t* buf, size_t len) {
 
     return crc;
 }
+#endif
 
 static inline void miniogg_pack_u32le(uint8_t* d, uint32_t n) {
     d[0] = (uint8_t)(( n       ) & 0xFF);
@@ -343,6 +364,7 @@ void miniogg_init(miniogg* p, uint32_t serialno) {
     p->header[2] = 'g';
     p->header[3] = 'S';
 
+    p->verify = MINIOGG_VERIFY_FULL;
     p->demux_state = MINIOGG_DEMUX_HEADER_FIXED;
     p->header_pos = 0;
     p->body_pos = 0;
@@ -417,8 +439,8 @@ void miniogg_finish_page(miniogg* p) {
     p->header_len = (size_t)p->segments + MINIOGG_HEADER_SIZE;
     p->body_len = miniogg_used_space__inline(p);
 
-    crc = crc32(crc,p->header,p->header_len);
-    crc = crc32(crc,p->body,p->body_len);
+    crc = MINIOGG_CRC32(crc,p->header,p->header_len);
+    crc = MINIOGG_CRC32(crc,p->body,p->body_len);
     miniogg_set_crc(p,crc);
 
     if(p->segments == MINIOGG_MAX_SEGMENTS &&
@@ -460,6 +482,8 @@ int miniogg_add_page(miniogg* p, const void* data, size_t len, size_t *used) {
                p->header[1] != 'g' ||
                p->header[2] != 'g' ||
                p->header[3] != 'S') {
+                p->header_pos = 0;
+                p->packets = 0;
                 r = -1;
                 goto finish;
             }
@@ -502,16 +526,23 @@ int miniogg_add_page(miniogg* p, const void* data, size_t len, size_t *used) {
             }
 
             /* check the crc */
-            crc_tmp = miniogg_get_crc(p);
-            miniogg_set_crc(p,0);
-            crc = 0;
-            crc = crc32(crc,p->header,p->header_len);
-            crc = crc32(crc,p->body,p->body_len);
-            miniogg_set_crc(p,crc_tmp);
-
-            if(crc != crc_tmp) return -2;
+            if(p->verify == MINIOGG_VERIFY_FULL ||
+              (p->verify == MINIOGG_VERIFY_HEADERS && (p->bos || p->granulepos == 0))) {
+                crc_tmp = miniogg_get_crc(p);
+                miniogg_set_crc(p,0);
+                crc = 0;
+                crc = MINIOGG_CRC32(crc,p->header,p->header_len);
+                crc = MINIOGG_CRC32(crc,p->body,p->body_len);
+                miniogg_set_crc(p,crc_tmp);
+            } else {
+                crc = crc_tmp = 0;
+            }
 
             r = 0;
+            if(crc != crc_tmp) {
+                p->packets = 0;
+                r = -2;
+            }
             p->header_pos = 0;
             p->packet = 0;
             p->segment = 0;
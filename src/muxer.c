@@ -1,4 +1,5 @@
 #include "muxer.h"
+#include "memacct.h"
 #include "unpack_u32be.h"
 #include "pack_u32be.h"
 
@@ -38,6 +39,7 @@ void muxer_free(muxer* m) {
 }
 
 int muxer_create(muxer* m, const strbuf* name) {
+    int r;
     const muxer_plugin* plug;
     void* userdata;
 
@@ -60,11 +62,14 @@ int muxer_create(muxer* m, const strbuf* name) {
     m->userdata = userdata;
     m->plugin = plug;
 
-    return m->plugin->create(m->userdata);
+    MEMACCT_CALL(MEMACCT_MUXER, r, m->plugin->create(m->userdata));
+    return r;
 }
 
 int muxer_reset(const muxer* m) {
-    return m->plugin->reset(m->userdata);
+    int r;
+    MEMACCT_CALL(MEMACCT_MUXER, r, m->plugin->reset(m->userdata));
+    return r;
 }
 
 /* most other things _open method (filter_open, encoder_open, etc) call
@@ -104,6 +109,7 @@ static int muxer_flush_wrapper(void* ud) {
 }
 
 int muxer_open(muxer* m, const packet_source* source) {
+    int r;
     segment_receiver receiver = SEGMENT_RECEIVER_ZERO;
 
     if(m->plugin == NULL || m->userdata == NULL) {
@@ -124,10 +130,13 @@ int muxer_open(muxer* m, const packet_source* source) {
       (int)m->plugin->name->len,
       (const char *)m->plugin->name->x);
 
-    return m->plugin->open(m->userdata, source, &receiver);
+    MEMACCT_CALL(MEMACCT_MUXER, r, m->plugin->open(m->userdata, source, &receiver));
+    return r;
 }
 
 int muxer_config(const muxer* m, const strbuf* name, const strbuf* value) {
+    int r;
+
     log_debug("configuring plugin %.*s %.*s=%.*s",
       (int)m->plugin->name->len,
       (const char *)m->plugin->name->x,
@@ -135,7 +144,8 @@ int muxer_config(const muxer* m, const strbuf* name, const strbuf* value) {
       (const char *)name->x,
       (int)value->len,
       (const char *)value->x);
-    return m->plugin->config(m->userdata,name,value);
+    MEMACCT_CALL(MEMACCT_MUXER, r, m->plugin->config(m->userdata,name,value));
+    return r;
 }
 
 int muxer_global_init(void) {
@@ -147,7 +157,9 @@ void muxer_global_deinit(void) {
 }
 
 int muxer_submit_packet(muxer* m, const packet* p) {
-    int r = m->plugin->submit_packet(m->userdata, p, &m->segment_receiver);
+    int r;
+
+    MEMACCT_CALL(MEMACCT_MUXER, r, m->plugin->submit_packet(m->userdata, p, &m->segment_receiver));
     if(r == 0) {
         ich_time_now(&m->ts);
         m->counter++;
@@ -155,7 +167,7 @@ int muxer_submit_packet(muxer* m, const packet* p) {
     return r;
 }
 
-int muxer_submit_tags(const muxer* m, const taglist* tags) {
+static int muxer_submit_tags_internal(const muxer* m, const taglist* tags) {
     int r = 0;
     size_t apic_idx = 0;
     uint32_t mime_len = 0;
@@ -261,8 +273,16 @@ int muxer_submit_tags(const muxer* m, const taglist* tags) {
     return r;
 }
 
+int muxer_submit_tags(const muxer* m, const taglist* tags) {
+    int r;
+    MEMACCT_CALL(MEMACCT_MUXER, r, muxer_submit_tags_internal(m, tags));
+    return r;
+}
+
 int muxer_flush(const muxer* m) {
-    return m->plugin->flush(m->userdata, &m->segment_receiver);
+    int r;
+    MEMACCT_CALL(MEMACCT_MUXER, r, m->plugin->flush(m->userdata, &m->segment_receiver));
+    return r;
 }
 
 uint32_t muxer_get_caps(const muxer* m) {
@@ -270,7 +290,9 @@ uint32_t muxer_get_caps(const muxer* m) {
 }
 
 int muxer_get_segment_info(const muxer* m, const packet_source_info* s, packet_source_params* i) {
-    return m->plugin->get_segment_info(m->userdata,s,&m->segment_receiver,i);
+    int r;
+    MEMACCT_CALL(MEMACCT_MUXER, r, m->plugin->get_segment_info(m->userdata,s,&m->segment_receiver,i));
+    return r;
 }
 
 void muxer_dump_counters(const muxer* in, const strbuf* prefix) {
@@ -14,6 +14,7 @@
 
 #define MINIOGG_API static
 #include "miniogg.h"
+#include "crc32.h"
 
 #include "base64encode.h"
 
@@ -407,6 +408,7 @@ const muxer_plugin muxer_plugin_ogg_opus = {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-function"
 #define MINIOGG_IMPLEMENTATION
+#define MINIOGG_CRC32 crc32_update
 #include "miniogg.h"
 #pragma GCC diagnostic pop
 
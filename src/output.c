@@ -1,5 +1,6 @@
 #include "output.h"
 #include "output_plugin.h"
+#include "memacct.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,6 +25,7 @@ void output_free(output* out) {
 }
 
 int output_create(output* out, const strbuf* name) {
+    int r;
     const output_plugin* plug;
     void* userdata;
 
@@ -46,7 +48,8 @@ int output_create(output* out, const strbuf* name) {
     out->userdata = userdata;
     out->plugin = plug;
 
-    return out->plugin->create(out->userdata);
+    MEMACCT_CALL(MEMACCT_OUTPUT, r, out->plugin->create(out->userdata));
+    return r;
 }
 
 int output_get_segment_info(const output* out, const segment_source_info* info, segment_params* params) {
@@ -56,7 +59,8 @@ int output_get_segment_info(const output* out, const segment_source_info* info,
         logs_error("plugin not selected");
         return r;
     }
-    if( (r = out->plugin->get_segment_info(out->userdata,info,params)) != 0) return r;
+    MEMACCT_CALL(MEMACCT_OUTPUT, r, out->plugin->get_segment_info(out->userdata,info,params));
+    if(r != 0) return r;
 
     if(params->segment_length == 0) {
         /* plugin didn't set a length so we set
@@ -79,6 +83,8 @@ int output_get_segment_info(const output* out, const segment_source_info* info,
 }
 
 int output_open(output* out, const segment_source* source) {
+    int r;
+
     if(out->plugin == NULL || out->userdata == NULL) {
         logs_error("plugin not selected");
         return -1;
@@ -95,10 +101,13 @@ int output_open(output* out, const segment_source* source) {
       (int)out->plugin->name->len,
       (const char *)out->plugin->name->x);
 
-    return out->plugin->open(out->userdata, source);
+    MEMACCT_CALL(MEMACCT_OUTPUT, r, out->plugin->open(out->userdata, source));
+    return r;
 }
 
 int output_config(const output* out, const strbuf* name, const strbuf* value) {
+    int r;
+
     log_debug("configuring plugin %.*s %.*s=%.*s",
       (int)out->plugin->name->len,
       (const char *)out->plugin->name->x,
@@ -106,15 +115,20 @@ int output_config(const output* out, const strbuf* name, const strbuf* value) {
       (const char *)name->x,
       (int)value->len,
       (const char *)value->x);
-    return out->plugin->config(out->userdata,name,value);
+    MEMACCT_CALL(MEMACCT_OUTPUT, r, out->plugin->config(out->userdata,name,value));
+    return r;
 }
 
 int output_set_time(const output* out, const ich_time* now) {
-    return out->plugin->set_time(out->userdata,now);
+    int r;
+    MEMACCT_CALL(MEMACCT_OUTPUT, r, out->plugin->set_time(out->userdata,now));
+    return r;
 }
 
 int output_submit_segment(output* out, const segment* seg) {
-    int r = out->plugin->submit_segment(out->userdata,seg);
+    int r;
+
+    MEMACCT_CALL(MEMACCT_OUTPUT, r, out->plugin->submit_segment(out->userdata,seg));
     if(r == 0) {
         ich_time_now(&out->ts);
         out->counter++;
@@ -123,19 +137,27 @@ int output_submit_segment(output* out, const segment* seg) {
 }
 
 int output_submit_tags(const output* out, const taglist* tags) {
-    return out->plugin->submit_tags(out->userdata,tags);
+    int r;
+    MEMACCT_CALL(MEMACCT_OUTPUT, r, out->plugin->submit_tags(out->userdata,tags));
+    return r;
 }
 
 int output_submit_picture(const output* out, const picture* seg, picture* p) {
-    return out->plugin->submit_picture(out->userdata,seg,p);
+    int r;
+    MEMACCT_CALL(MEMACCT_OUTPUT, r, out->plugin->submit_picture(out->userdata,seg,p));
+    return r;
 }
 
 int output_flush(const output* out) {
-    return out->plugin->flush(out->userdata);
+    int r;
+    MEMACCT_CALL(MEMACCT_OUTPUT, r, out->plugin->flush(out->userdata));
+    return r;
 }
 
 int output_reset(const output* out) {
-    return out->plugin->reset(out->userdata);
+    int r;
+    MEMACCT_CALL(MEMACCT_OUTPUT, r, out->plugin->reset(out->userdata));
+    return r;
 }
 
 int output_global_init(void) {
@@ -2,6 +2,7 @@
 #include "output_plugin_file.h"
 #include "output_plugin_folder.h"
 #include "output_plugin_icecast.h"
+#include "output_plugin_tee.h"
 
 #ifndef OUTPUT_PLUGIN_CURL
 #define OUTPUT_PLUGIN_CURL 0
@@ -16,6 +17,7 @@ const output_plugin* output_plugin_list[] = {
     &output_plugin_file,
     &output_plugin_folder,
     &output_plugin_icecast,
+    &output_plugin_tee,
 #if OUTPUT_PLUGIN_CURL
     &output_plugin_curl,
 #endif
@@ -0,0 +1,340 @@
+#include "output_plugin_tee.h"
+#include "output.h"
+
+#include "strbuf.h"
+#include "membuf.h"
+
+#include <stdlib.h>
+
+#define LOG_PREFIX "[output:tee]"
+#include "logger.h"
+
+/* the tee output hands every segment it gets to multiple child
+ * outputs, so one muxer can feed (for example) a local folder
+ * and a remote server. Each child is a full output with its own
+ * state (hls playlists, connections, etc).
+ *
+ * Configure it like:
+ *   output = tee
+ *   tee = folder
+ *   folder = /path/to/folder
+ *   tee = curl
+ *   url = https://example.com/
+ *
+ * Every "tee" key adds a child output, other keys configure the
+ * most recently added child.
+ *
+ * A child that fails is logged and disabled, the remaining
+ * children keep going. The tee only reports an error once every
+ * child has failed. */
+
+static STRBUF_CONST(plugin_name,"tee");
+
+struct tee_child {
+    output output;
+    uint8_t failed;
+};
+
+typedef struct tee_child tee_child;
+
+struct plugin_userdata {
+    membuf children;
+    picture scratch; /* picture info from children after the first */
+};
+
+typedef struct plugin_userdata plugin_userdata;
+
+static size_t plugin_children_len(const plugin_userdata* userdata) {
+    return userdata->children.len / sizeof(tee_child);
+}
+
+static tee_child* plugin_children(const plugin_userdata* userdata) {
+    return (tee_child*)userdata->children.x;
+}
+
+/* disables a child after an error, returns an error
+ * once no children are left */
+static int plugin_child_failed(plugin_userdata* userdata, tee_child* child, const char* action) {
+    size_t i;
+    size_t len;
+    tee_child* children;
+
+    child->failed = 1;
+    log_error("child output %.*s failed to %s, disabling it",
+      (int)child->output.plugin->name->len,
+      (const char *)child->output.plugin->name->x,
+      action);
+
+    len = plugin_children_len(userdata);
+    children = plugin_children(userdata);
+    for(i=0;i<len;i++) {
+        if(!children[i].failed) return 0;
+    }
+
+    logs_error("all child outputs have failed");
+    return -1;
+}
+
+static int plugin_init(void) {
+    return 0;
+}
+
+static void plugin_deinit(void) {
+    return;
+}
+
+static size_t plugin_size(void) {
+    return sizeof(plugin_userdata);
+}
+
+static int plugin_create(void* ud) {
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    membuf_init(&userdata->children);
+    strbuf_init(&userdata->scratch.mime);
+    strbuf_init(&userdata->scratch.desc);
+    strbuf_init(&userdata->scratch.data);
+
+    return 0;
+}
+
+static void plugin_close(void* ud) {
+    size_t i;
+    size_t len;
+    tee_child* children;
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    len = plugin_children_len(userdata);
+    children = plugin_children(userdata);
+    for(i=0;i<len;i++) {
+        output_free(&children[i].output);
+    }
+
+    membuf_free(&userdata->children);
+    strbuf_free(&userdata->scratch.mime);
+    strbuf_free(&userdata->scratch.desc);
+    strbuf_free(&userdata->scratch.data);
+}
+
+static int plugin_config(void* ud, const strbuf* key, const strbuf* value) {
+    int r;
+    size_t len;
+    tee_child child;
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    if(strbuf_equals_cstr(key,"tee")) {
+        output_init(&child.output);
+        child.failed = 0;
+        if( (r = output_create(&child.output,value)) != 0) {
+            output_free(&child.output);
+            return r;
+        }
+        if( (r = membuf_append(&userdata->children,&child,sizeof(tee_child))) != 0) {
+            logs_error("unable to allocate child output");
+            output_free(&child.output);
+            return r;
+        }
+        return 0;
+    }
+
+    len = plugin_children_len(userdata);
+    if(len == 0) {
+        log_error("option %.*s given before any \"tee\" child outputs",
+          (int)key->len,(const char *)key->x);
+        return -1;
+    }
+
+    return output_config(&plugin_children(userdata)[len-1].output,key,value);
+}
+
+static int plugin_set_time(void* ud, const ich_time* now) {
+    int r;
+    size_t i;
+    size_t len;
+    tee_child* children;
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    len = plugin_children_len(userdata);
+    children = plugin_children(userdata);
+    for(i=0;i<len;i++) {
+        if( (r = output_set_time(&children[i].output,now)) != 0) return r;
+    }
+    return 0;
+}
+
+static int plugin_get_segment_info(const void* ud, const segment_source_info* info, segment_params* params) {
+    int r;
+    size_t i;
+    size_t len;
+    segment_params p;
+    segment_params orig;
+    tee_child* children;
+    const plugin_userdata* userdata = (const plugin_userdata*)ud;
+
+    len = plugin_children_len(userdata);
+    children = plugin_children(userdata);
+
+    if(len == 0) {
+        logs_error("no child outputs configured");
+        return -1;
+    }
+
+    orig = *params;
+    if( (r = output_get_segment_info(&children[0].output,info,params)) != 0) return r;
+
+    /* every child gets the same segments, so they have to agree on sizing */
+    for(i=1;i<len;i++) {
+        p = orig;
+        if( (r = output_get_segment_info(&children[i].output,info,&p)) != 0) return r;
+        if(p.segment_length != params->segment_length ||
+           p.packets_per_segment != params->packets_per_segment ||
+           p.subsegment_length != params->subsegment_length ||
+           p.packets_per_subsegment != params->packets_per_subsegment) {
+            logs_error("child outputs have different segment settings");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int plugin_open(void* ud, const segment_source* source) {
+    int r;
+    size_t i;
+    size_t len;
+    tee_child* children;
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    len = plugin_children_len(userdata);
+    children = plugin_children(userdata);
+
+    if(len == 0) {
+        logs_error("no child outputs configured");
+        return -1;
+    }
+
+    for(i=0;i<len;i++) {
+        if(output_open(&children[i].output,source) != 0) {
+            if( (r = plugin_child_failed(userdata,&children[i],"open")) != 0) return r;
+        }
+    }
+    return 0;
+}
+
+static int plugin_submit_segment(void* ud, const segment* seg) {
+    int r;
+    size_t i;
+    size_t len;
+    tee_child* children;
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    len = plugin_children_len(userdata);
+    children = plugin_children(userdata);
+    for(i=0;i<len;i++) {
+        if(children[i].failed) continue;
+        if(output_submit_segment(&children[i].output,seg) != 0) {
+            if( (r = plugin_child_failed(userdata,&children[i],"write a segment")) != 0) return r;
+        }
+    }
+    return 0;
+}
+
+static int plugin_submit_tags(void* ud, const taglist* tags) {
+    int r;
+    size_t i;
+    size_t len;
+    tee_child* children;
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    len = plugin_children_len(userdata);
+    children = plugin_children(userdata);
+    for(i=0;i<len;i++) {
+        if(children[i].failed) continue;
+        if(output_submit_tags(&children[i].output,tags) != 0) {
+            if( (r = plugin_child_failed(userdata,&children[i],"write tags")) != 0) return r;
+        }
+    }
+    return 0;
+}
+
+static int plugin_submit_picture(void* ud, const picture* src, picture* out) {
+    int r;
+    size_t i;
+    size_t len;
+    picture* dest;
+    tee_child* children;
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    len = plugin_children_len(userdata);
+    children = plugin_children(userdata);
+
+    /* the first working child decides what the muxer embeds,
+     * the rest just get a chance to store the picture */
+    dest = out;
+    for(i=0;i<len;i++) {
+        if(children[i].failed) continue;
+        if(output_submit_picture(&children[i].output,src,dest) != 0) {
+            if( (r = plugin_child_failed(userdata,&children[i],"write a picture")) != 0) return r;
+            continue;
+        }
+        dest = &userdata->scratch;
+        userdata->scratch.mime.len = 0;
+        userdata->scratch.desc.len = 0;
+        userdata->scratch.data.len = 0;
+    }
+    return 0;
+}
+
+static int plugin_flush(void* ud) {
+    int r;
+    size_t i;
+    size_t len;
+    tee_child* children;
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    len = plugin_children_len(userdata);
+    children = plugin_children(userdata);
+    for(i=0;i<len;i++) {
+        if(children[i].failed) continue;
+        if(output_flush(&children[i].output) != 0) {
+            if( (r = plugin_child_failed(userdata,&children[i],"flush")) != 0) return r;
+        }
+    }
+    return 0;
+}
+
+static int plugin_reset(void* ud) {
+    int r;
+    size_t i;
+    size_t len;
+    tee_child* children;
+    plugin_userdata* userdata = (plugin_userdata*)ud;
+
+    len = plugin_children_len(userdata);
+    children = plugin_children(userdata);
+    for(i=0;i<len;i++) {
+        if(children[i].failed) continue;
+        if(output_reset(&children[i].output) != 0) {
+            if( (r = plugin_child_failed(userdata,&children[i],"reset")) != 0) return r;
+        }
+    }
+    return 0;
+}
+
+const output_plugin output_plugin_tee = {
+    &plugin_name,
+    plugin_size,
+    plugin_init,
+    plugin_deinit,
+    plugin_create,
+    plugin_config,
+    plugin_open,
+    plugin_close,
+    plugin_set_time,
+    plugin_submit_segment,
+    plugin_submit_picture,
+    plugin_submit_tags,
+    plugin_flush,
+    plugin_reset,
+    plugin_get_segment_info,
+};
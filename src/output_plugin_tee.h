@@ -0,0 +1,8 @@
+#ifndef OUTPUT_PLUGIN_TEE_H
+#define OUTPUT_PLUGIN_TEE_H
+
+#include "output_plugin.h"
+
+extern const output_plugin output_plugin_tee;
+
+#endif
@@ -0,0 +1,263 @@
+#include "output_sync.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#define LOG_PREFIX "[output]"
+#include "logger.h"
+
+void output_sync_init(output_sync* sync) {
+    thread_atomic_int_store(&sync->status, 0);
+    thread_atomic_int_store(&sync->quit, 0);
+    thread_atomic_int_store(&sync->count, 0);
+    thread_atomic_int_store(&sync->producer_waiting, 0);
+    thread_atomic_int_store(&sync->consumer_waiting, 0);
+    sync->msgs = NULL;
+    sync->depth = 0;
+    sync->head = 0;
+    sync->tail = 0;
+    sync->output = NULL;
+    sync->high_water = 0;
+    sync->stalls = 0;
+    sync->stall_time = 0;
+
+    thread_signal_init(&sync->ready);
+    thread_signal_init(&sync->consumed);
+}
+
+void output_sync_free(output_sync* sync) {
+    size_t i;
+
+    if(sync->msgs != NULL) {
+        for(i=0;i<sync->depth;i++) {
+            membuf_free(&sync->msgs[i].data);
+            taglist_free(&sync->msgs[i].tags);
+        }
+        free(sync->msgs);
+        sync->msgs = NULL;
+    }
+
+    thread_signal_term(&sync->ready);
+    thread_signal_term(&sync->consumed);
+}
+
+int output_sync_create(output_sync* sync, output* out) {
+    size_t i;
+
+    sync->output = out;
+
+    sync->msgs = (output_sync_msg*)malloc(sizeof(output_sync_msg) * sync->depth);
+    if(sync->msgs == NULL) return -1;
+
+    for(i=0;i<sync->depth;i++) {
+        sync->msgs[i].type = OUTPUT_SYNC_UNKNOWN;
+        sync->msgs[i].segment = segment_zero;
+        membuf_init(&sync->msgs[i].data);
+        taglist_init(&sync->msgs[i].tags);
+    }
+
+    return 0;
+}
+
+/* waits until no more than limit messages are queued,
+ * returns the output thread's status */
+static int output_sync_wait(output_sync* sync, int limit) {
+    ich_time start;
+    ich_time end;
+    ich_time diff;
+    int r;
+
+    if( (r = thread_atomic_int_load(&sync->status)) != 0) return r;
+    if(thread_atomic_int_load(&sync->count) <= limit) return 0;
+
+    ich_time_now(&start);
+    sync->stalls++;
+
+    for(;;) {
+        if( (r = thread_atomic_int_load(&sync->status)) != 0) break;
+        if(thread_atomic_int_load(&sync->count) <= limit) break;
+
+        thread_atomic_int_store(&sync->producer_waiting, 1);
+        if(thread_atomic_int_load(&sync->count) > limit &&
+           thread_atomic_int_load(&sync->status) == 0) {
+            thread_signal_wait(&sync->consumed, THREAD_SIGNAL_WAIT_INFINITE);
+        }
+        thread_atomic_int_store(&sync->producer_waiting, 0);
+    }
+
+    ich_time_now(&end);
+    ich_time_sub(&diff,&end,&start);
+    sync->stall_time += (uint64_t)diff.seconds * 1000000 + (uint64_t)diff.nanoseconds / 1000;
+
+    return r;
+}
+
+/* waits for a free slot in the ring, returns NULL
+ * if the output thread has stopped */
+static output_sync_msg* output_sync_acquire(output_sync* sync) {
+    if(output_sync_wait(sync, (int)sync->depth - 1) != 0) return NULL;
+    return &sync->msgs[sync->tail];
+}
+
+static int output_sync_publish(output_sync* sync, output_sync_msg* msg, output_sync_type type) {
+    size_t count;
+
+    msg->type = type;
+    sync->tail = (sync->tail + 1) % sync->depth;
+    count = (size_t)thread_atomic_int_inc(&sync->count) + 1;
+    if(count > sync->high_water) sync->high_water = count;
+
+    if(thread_atomic_int_load(&sync->consumer_waiting)) {
+        thread_signal_raise(&sync->ready);
+    }
+    return thread_atomic_int_load(&sync->status);
+}
+
+/* releases the slot at the head of the ring back to the destination thread */
+static void output_sync_release(output_sync* sync) {
+    sync->head = (sync->head + 1) % sync->depth;
+    thread_atomic_int_dec(&sync->count);
+    if(thread_atomic_int_load(&sync->producer_waiting)) {
+        thread_signal_raise(&sync->consumed);
+    }
+}
+
+int output_sync_drain(output_sync* sync) {
+    return output_sync_wait(sync, 0);
+}
+
+void output_sync_quit(output_sync* sync) {
+    thread_atomic_int_store(&sync->quit, 1);
+    thread_signal_raise(&sync->ready);
+}
+
+int output_sync_open(output_sync* sync, const segment_source* source) {
+    int r;
+    if( (r = output_sync_drain(sync)) != 0) return r;
+    return output_open(sync->output, source);
+}
+
+int output_sync_get_segment_info(output_sync* sync, const segment_source_info* info, segment_params* params) {
+    int r;
+    if( (r = output_sync_drain(sync)) != 0) return r;
+    return output_get_segment_info(sync->output, info, params);
+}
+
+int output_sync_submit_picture(output_sync* sync, const picture* src, picture* out) {
+    int r;
+    if( (r = output_sync_drain(sync)) != 0) return r;
+    return output_submit_picture(sync->output, src, out);
+}
+
+int output_sync_submit_segment(output_sync* sync, const segment* seg) {
+    int r;
+    output_sync_msg* msg;
+
+    if( (msg = output_sync_acquire(sync)) == NULL) return thread_atomic_int_load(&sync->status);
+
+    /* the muxer re-uses its buffer, so we need our own copy */
+    membuf_reset(&msg->data);
+    if( (r = membuf_append(&msg->data, seg->data, seg->len)) != 0) {
+        logs_error("unable to allocate segment");
+        return r;
+    }
+    msg->segment = *seg;
+    msg->segment.data = msg->data.x;
+
+    return output_sync_publish(sync, msg, OUTPUT_SYNC_SEGMENT);
+}
+
+int output_sync_submit_tags(output_sync* sync, const taglist* tags) {
+    int r;
+    output_sync_msg* msg;
+
+    if( (msg = output_sync_acquire(sync)) == NULL) return thread_atomic_int_load(&sync->status);
+
+    if( (r = taglist_deep_copy(&msg->tags, tags)) != 0) {
+        logs_error("unable to copy tags");
+        return r;
+    }
+
+    return output_sync_publish(sync, msg, OUTPUT_SYNC_TAGS);
+}
+
+int output_sync_flush(output_sync* sync) {
+    output_sync_msg* msg;
+
+    if( (msg = output_sync_acquire(sync)) == NULL) return thread_atomic_int_load(&sync->status);
+    return output_sync_publish(sync, msg, OUTPUT_SYNC_FLUSH);
+}
+
+int output_sync_reset(output_sync* sync) {
+    output_sync_msg* msg;
+
+    if( (msg = output_sync_acquire(sync)) == NULL) return thread_atomic_int_load(&sync->status);
+    return output_sync_publish(sync, msg, OUTPUT_SYNC_RESET);
+}
+
+int output_sync_run(output_sync* sync) {
+    int ret = 0;
+    output_sync_msg* msg;
+
+    for(;;) {
+        if(thread_atomic_int_load(&sync->count) == 0) {
+            /* a quit only takes effect once everything the destination
+             * queued before it has been handled */
+            if(thread_atomic_int_load(&sync->quit)) break;
+            thread_atomic_int_store(&sync->consumer_waiting, 1);
+            if(thread_atomic_int_load(&sync->count) == 0 &&
+               thread_atomic_int_load(&sync->quit) == 0) {
+                thread_signal_wait(&sync->ready, THREAD_SIGNAL_WAIT_INFINITE);
+            }
+            thread_atomic_int_store(&sync->consumer_waiting, 0);
+            continue;
+        }
+
+        msg = &sync->msgs[sync->head];
+
+        switch(msg->type) {
+            case OUTPUT_SYNC_SEGMENT: {
+                ret = output_submit_segment(sync->output, &msg->segment);
+                break;
+            }
+            case OUTPUT_SYNC_TAGS: {
+                ret = output_submit_tags(sync->output, &msg->tags);
+                break;
+            }
+            case OUTPUT_SYNC_FLUSH: {
+                ret = output_flush(sync->output);
+                break;
+            }
+            case OUTPUT_SYNC_RESET: {
+                ret = output_reset(sync->output);
+                break;
+            }
+            case OUTPUT_SYNC_UNKNOWN: /* fall-through */
+            default: ret = -1; break;
+        }
+
+        if(ret != 0) {
+            logs_error("output thread stopping after an error");
+            break;
+        }
+
+        output_sync_release(sync);
+    }
+
+    /* store our final status in case the destination thread
+     * is still trying to push to us */
+    thread_atomic_int_store(&sync->status, ret);
+    thread_signal_raise(&sync->consumed);
+
+    return ret;
+}
+
+void output_sync_dump_counters(const output_sync* sync, const strbuf* prefix) {
+    log_info("%.*s output queue: depth=%zu queued=%d high_water=%zu stalls=%zu stall_time=%llums",
+      (int)prefix->len,(const char*)prefix->x,
+      sync->depth,
+      thread_atomic_int_load((thread_atomic_int_t*)&sync->count),
+      sync->high_water,
+      sync->stalls,
+      (unsigned long long)(sync->stall_time / 1000));
+}
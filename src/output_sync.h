@@ -0,0 +1,122 @@
+#ifndef OUTPUT_SYNC_H
+#define OUTPUT_SYNC_H
+
+/* an optional meeting-point between a destination thread
+ * and a dedicated output thread.
+ *
+ * Normally the muxer hands segments straight to the output, so
+ * a slow upload (or a blocking socket send) holds up the encoder,
+ * and eventually the source and every other destination. With an
+ * output thread the muxer's segments go into a bounded,
+ * single-producer/single-consumer ring instead. Every message is
+ * one of:
+ *     a segment (the data is copied into the slot)
+ *     a taglist
+ *     a "flush" command
+ *     a "reset" command
+ *
+ * Calls that need an answer from the output (open, get_segment_info,
+ * and pictures) wait for the ring to empty, then call the output
+ * directly - the output thread is idle at that point, so the output
+ * is only ever touched by one thread at a time.
+ *
+ * The destination thread only waits when the ring is full, the time
+ * spent waiting is tracked as stall time.
+ *
+ * It's imperative that the output thread set the status flag and
+ * raise the consumed signal when it exits, to keep the destination
+ * thread from waiting forever on a full ring.
+ */
+
+#include "thread.h"
+#include "output.h"
+#include "segment.h"
+#include "picture.h"
+#include "membuf.h"
+#include "tag.h"
+
+#include <stdint.h>
+
+/* default ring depth, in segments */
+#define OUTPUT_SYNC_DEFAULT_DEPTH 8
+#define OUTPUT_SYNC_MAX_DEPTH 256
+
+enum output_sync_type {
+    OUTPUT_SYNC_UNKNOWN = -1,
+    OUTPUT_SYNC_SEGMENT =  0,
+    OUTPUT_SYNC_TAGS    =  1,
+    OUTPUT_SYNC_FLUSH   =  2,
+    OUTPUT_SYNC_RESET   =  3,
+};
+
+typedef enum output_sync_type output_sync_type;
+
+struct output_sync_msg {
+    output_sync_type type;
+    segment segment; /* segment.data points into data */
+    membuf data;
+    taglist tags;
+};
+
+typedef struct output_sync_msg output_sync_msg;
+
+struct output_sync {
+    thread_atomic_int_t status;
+    thread_atomic_int_t quit;
+    thread_atomic_int_t count; /* number of queued messages */
+    thread_atomic_int_t producer_waiting;
+    thread_atomic_int_t consumer_waiting;
+    thread_signal_t ready;
+    thread_signal_t consumed;
+    output_sync_msg* msgs;
+    size_t depth; /* number of slots in the ring, 0 = no output thread */
+    size_t head; /* only touched by the output thread */
+    size_t tail; /* only touched by the destination thread */
+    output* output;
+
+    /* counters, only updated by the destination thread */
+    size_t high_water; /* most messages queued at once */
+    size_t stalls; /* number of times the destination thread had to wait */
+    uint64_t stall_time; /* total time spent waiting, in microseconds */
+};
+
+typedef struct output_sync output_sync;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void output_sync_init(output_sync*);
+void output_sync_free(output_sync*);
+
+/* allocates the ring, call after configuration and before
+ * either thread starts */
+int output_sync_create(output_sync*, output*);
+
+/* the output thread's main function */
+int output_sync_run(output_sync*);
+
+/* tells the output thread to exit once the ring is empty */
+void output_sync_quit(output_sync*);
+
+/* waits for the output thread to handle everything queued,
+ * returns the output thread's status */
+int output_sync_drain(output_sync*);
+
+/* these mirror the output_ functions and are used as the
+ * muxer's segment receiver and picture handler */
+int output_sync_open(output_sync*, const segment_source* source);
+int output_sync_get_segment_info(output_sync*, const segment_source_info* info, segment_params* params);
+int output_sync_submit_segment(output_sync*, const segment*);
+int output_sync_submit_tags(output_sync*, const taglist*);
+int output_sync_submit_picture(output_sync*, const picture*, picture*);
+int output_sync_flush(output_sync*);
+int output_sync_reset(output_sync*);
+
+void output_sync_dump_counters(const output_sync*, const strbuf*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,161 @@
+#include "sample_pool.h"
+#include "thread.h"
+
+#include <stdlib.h>
+
+#define LOG_PREFIX "[sample_pool]"
+#include "logger.h"
+
+#define SAMPLE_POOL_CLASSES (SAMPLE_POOL_MAX_SHIFT - SAMPLE_POOL_MIN_SHIFT + 1)
+
+/* free buffers are kept in a list, linked through their first bytes */
+struct sample_pool_block {
+    struct sample_pool_block* next;
+};
+
+typedef struct sample_pool_block sample_pool_block;
+
+struct sample_pool_class {
+    thread_mutex_t lock;
+    sample_pool_block* head;
+    size_t len;      /* number of buffers in the list */
+    size_t keep;     /* most buffers we'll hold on to */
+    size_t hits;     /* requests served from the list */
+    size_t misses;   /* requests that needed a malloc */
+    size_t returns;  /* buffers put back in the list */
+    size_t releases; /* buffers freed because the list was full */
+};
+
+typedef struct sample_pool_class sample_pool_class;
+
+static sample_pool_class classes[SAMPLE_POOL_CLASSES];
+static thread_atomic_int_t oversize; /* requests too big for any class */
+
+int sample_pool_global_init(void) {
+    size_t i;
+
+    for(i=0;i<SAMPLE_POOL_CLASSES;i++) {
+        thread_mutex_init(&classes[i].lock);
+        classes[i].head = NULL;
+        classes[i].len = 0;
+        classes[i].keep = SAMPLE_POOL_CLASS_BYTES >> (i + SAMPLE_POOL_MIN_SHIFT);
+        if(classes[i].keep < SAMPLE_POOL_MIN_KEEP) classes[i].keep = SAMPLE_POOL_MIN_KEEP;
+        classes[i].hits = 0;
+        classes[i].misses = 0;
+        classes[i].returns = 0;
+        classes[i].releases = 0;
+    }
+    thread_atomic_int_store(&oversize, 0);
+
+    return 0;
+}
+
+void sample_pool_global_deinit(void) {
+    size_t i;
+    sample_pool_block* b;
+
+    for(i=0;i<SAMPLE_POOL_CLASSES;i++) {
+        while( (b = classes[i].head) != NULL) {
+            classes[i].head = b->next;
+            free(b);
+        }
+        classes[i].len = 0;
+        thread_mutex_term(&classes[i].lock);
+    }
+}
+
+/* smallest class that holds len bytes */
+static size_t sample_pool_class_up(size_t len) {
+    size_t shift = SAMPLE_POOL_MIN_SHIFT;
+    while(((size_t)1 << shift) < len) shift++;
+    return shift - SAMPLE_POOL_MIN_SHIFT;
+}
+
+/* largest class a buffer of a bytes can stand in for */
+static size_t sample_pool_class_down(size_t a) {
+    size_t shift = SAMPLE_POOL_MIN_SHIFT;
+    while(shift < SAMPLE_POOL_MAX_SHIFT && ((size_t)1 << (shift + 1)) <= a) shift++;
+    return shift - SAMPLE_POOL_MIN_SHIFT;
+}
+
+void* sample_pool_get(size_t len, size_t* a) {
+    size_t idx;
+    void* p;
+    sample_pool_class* c;
+
+    if(len > ((size_t)1 << SAMPLE_POOL_MAX_SHIFT)) {
+        thread_atomic_int_inc(&oversize);
+        if( (p = malloc(len)) != NULL) *a = len;
+        return p;
+    }
+
+    idx = sample_pool_class_up(len);
+    c = &classes[idx];
+
+    thread_mutex_lock(&c->lock);
+    if( (p = c->head) != NULL) {
+        c->head = c->head->next;
+        c->len--;
+        c->hits++;
+    } else {
+        c->misses++;
+    }
+    thread_mutex_unlock(&c->lock);
+
+    if(p == NULL) {
+        if( (p = malloc((size_t)1 << (idx + SAMPLE_POOL_MIN_SHIFT))) == NULL) return NULL;
+    }
+
+    *a = (size_t)1 << (idx + SAMPLE_POOL_MIN_SHIFT);
+    return p;
+}
+
+void sample_pool_put(void* p, size_t a) {
+    sample_pool_block* b = (sample_pool_block*)p;
+    sample_pool_class* c;
+
+    if(p == NULL) return;
+
+    if(a < ((size_t)1 << SAMPLE_POOL_MIN_SHIFT)) {
+        free(p);
+        return;
+    }
+
+    c = &classes[sample_pool_class_down(a)];
+
+    thread_mutex_lock(&c->lock);
+    if(c->len < c->keep) {
+        b->next = c->head;
+        c->head = b;
+        c->len++;
+        c->returns++;
+        b = NULL;
+    } else {
+        c->releases++;
+    }
+    thread_mutex_unlock(&c->lock);
+
+    if(b != NULL) free(b);
+}
+
+void sample_pool_dump_counters(void) {
+    size_t i;
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t returns = 0;
+    size_t releases = 0;
+    size_t cached = 0;
+
+    for(i=0;i<SAMPLE_POOL_CLASSES;i++) {
+        hits += classes[i].hits;
+        misses += classes[i].misses;
+        returns += classes[i].returns;
+        releases += classes[i].releases;
+        cached += classes[i].len << (i + SAMPLE_POOL_MIN_SHIFT);
+    }
+
+    log_info("sample pool: hits=%zu misses=%zu returns=%zu releases=%zu oversize=%d cached=%zukB",
+      hits, misses, returns, releases,
+      thread_atomic_int_load(&oversize),
+      cached / 1024);
+}
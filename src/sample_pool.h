@@ -0,0 +1,56 @@
+#ifndef SAMPLE_POOL_H
+#define SAMPLE_POOL_H
+
+/* a process-wide pool of sample buffers, used by frame_buffer()
+ * and frame_free() for the per-channel sample planes.
+ *
+ * Buffers come in power-of-two size classes, so a frame that
+ * grows a little at a time (or a chained stream that changes
+ * channel count or format) gets a buffer it can keep using
+ * instead of being realloc()'d every time. Freed buffers go
+ * back to their class and are handed to the next frame that
+ * needs one, so once every stage has seen its largest frame
+ * nothing is allocated per-frame.
+ *
+ * Buffers are often allocated on one thread and freed on
+ * another (a source's frames end up freed by destination
+ * threads), so each class has its own lock. Taking a buffer
+ * is rare once things are running, so the locks don't see
+ * much contention.
+ *
+ * Buffers are plain malloc() blocks, anything outside of the
+ * pool can safely realloc() or free() them. */
+
+#include <stddef.h>
+
+/* smallest and largest size classes, as powers of two. Larger
+ * requests bypass the pool */
+#define SAMPLE_POOL_MIN_SHIFT 9
+#define SAMPLE_POOL_MAX_SHIFT 26
+
+/* how much memory each class may hold on to, every class keeps
+ * at least SAMPLE_POOL_MIN_KEEP buffers regardless */
+#define SAMPLE_POOL_CLASS_BYTES (16 * 1024 * 1024)
+#define SAMPLE_POOL_MIN_KEEP 4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int sample_pool_global_init(void);
+void sample_pool_global_deinit(void);
+
+/* returns a buffer of at least len bytes, its actual size
+ * is stored in a. Returns NULL on allocation failure */
+void* sample_pool_get(size_t len, size_t* a);
+
+/* hands a buffer of size a back to the pool */
+void sample_pool_put(void* p, size_t a);
+
+void sample_pool_dump_counters(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
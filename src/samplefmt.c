@@ -1,6 +1,80 @@
 #include "samplefmt.h"
+#include "samplefmt_simd.h"
 
 #include <string.h>
+
+static void samplefmt_s32_to_s16_c(int16_t* dest, const int32_t* src, size_t samples) {
+    samplefmt_s32_to_s16(dest, src, samples, 1, 0, 1, 0);
+}
+
+static void samplefmt_s32_to_float_c(float* dest, const int32_t* src, size_t samples) {
+    samplefmt_s32_to_float(dest, src, samples, 1, 0, 1, 0);
+}
+
+static void samplefmt_s16_to_float_c(float* dest, const int16_t* src, size_t samples) {
+    samplefmt_s16_to_float(dest, src, samples, 1, 0, 1, 0);
+}
+
+static void samplefmt_float_to_s16_c(int16_t* dest, const float* src, size_t samples) {
+    samplefmt_float_to_s16(dest, src, samples, 1, 0, 1, 0);
+}
+
+static void samplefmt_float_to_s32_c(int32_t* dest, const float* src, size_t samples) {
+    samplefmt_float_to_s32(dest, src, samples, 1, 0, 1, 0);
+}
+
+static void samplefmt_interleave_s32_s16_2_c(int16_t* dest, const int32_t* left, const int32_t* right, size_t samples) {
+    size_t i;
+    for(i=0;i<samples;i++) {
+        dest[(i*2)]     = (int16_t)(left[i] / (1 << 16));
+        dest[(i*2) + 1] = (int16_t)(right[i] / (1 << 16));
+    }
+}
+
+static void samplefmt_s32_shl_c(int32_t* samples, size_t len, unsigned int shift) {
+    size_t i;
+    for(i=0;i<len;i++) {
+        samples[i] *= (1 << shift);
+    }
+}
+
+static void samplefmt_s32_shr_c(int32_t* dest, const int32_t* src, size_t len, unsigned int shift) {
+    size_t i;
+    for(i=0;i<len;i++) {
+        dest[i] = src[i] >> shift;
+    }
+}
+
+static samplefmt_kernels kernels = {
+    samplefmt_s32_to_s16_c,
+    samplefmt_s32_to_float_c,
+    samplefmt_s16_to_float_c,
+    samplefmt_float_to_s16_c,
+    samplefmt_float_to_s32_c,
+    samplefmt_interleave_s32_s16_2_c,
+    samplefmt_s32_shl_c,
+    samplefmt_s32_shr_c,
+    "none",
+};
+
+int samplefmt_global_init(void) {
+    samplefmt_simd_detect(&kernels);
+    return 0;
+}
+
+const char* samplefmt_simd_str(void) {
+    return kernels.name;
+}
+
+void samplefmt_s32_shl(int32_t* samples, size_t len, unsigned int shift) {
+    if(shift == 0) return;
+    kernels.s32_shl(samples, len, shift);
+}
+
+void samplefmt_s32_shr(int32_t* dest, const int32_t* src, size_t len, unsigned int shift) {
+    kernels.s32_shr(dest, src, len, shift);
+}
+
 static const char * const samplefmt_strs[] = {
     "unnkown",
     "u8",
@@ -22,9 +96,70 @@ const char* samplefmt_str(samplefmt f) {
     return samplefmt_strs[f];
 }
 
+/* maps planar formats to their interleaved counterpart */
+static samplefmt samplefmt_packed(samplefmt fmt) {
+    switch(fmt) {
+        case SAMPLEFMT_U8P: return SAMPLEFMT_U8;
+        case SAMPLEFMT_S16P: return SAMPLEFMT_S16;
+        case SAMPLEFMT_S32P: return SAMPLEFMT_S32;
+        case SAMPLEFMT_S64P: return SAMPLEFMT_S64;
+        case SAMPLEFMT_FLOATP: return SAMPLEFMT_FLOAT;
+        case SAMPLEFMT_DOUBLEP: return SAMPLEFMT_DOUBLE;
+        default: break;
+    }
+    return fmt;
+}
+
+/* contiguous buffers get the vectorized kernels, or a
+ * plain memcpy when the sample type isn't changing */
+static int samplefmt_convert_contiguous(void* dest, const void* src, samplefmt srcfmt, samplefmt destfmt, size_t samples) {
+    srcfmt = samplefmt_packed(srcfmt);
+    destfmt = samplefmt_packed(destfmt);
+
+    if(srcfmt == destfmt) {
+        if(samplefmt_size(srcfmt) == 0) return -1;
+        memcpy(dest, src, samples * samplefmt_size(srcfmt));
+        return 0;
+    }
+
+    switch(srcfmt) {
+        case SAMPLEFMT_S32: {
+            switch(destfmt) {
+                case SAMPLEFMT_S16: kernels.s32_to_s16((int16_t*)dest, (const int32_t*)src, samples); return 0;
+                case SAMPLEFMT_FLOAT: kernels.s32_to_float((float*)dest, (const int32_t*)src, samples); return 0;
+                default: break;
+            }
+            break;
+        }
+        case SAMPLEFMT_S16: {
+            if(destfmt == SAMPLEFMT_FLOAT) {
+                kernels.s16_to_float((float*)dest, (const int16_t*)src, samples);
+                return 0;
+            }
+            break;
+        }
+        case SAMPLEFMT_FLOAT: {
+            switch(destfmt) {
+                case SAMPLEFMT_S16: kernels.float_to_s16((int16_t*)dest, (const float*)src, samples); return 0;
+                case SAMPLEFMT_S32: kernels.float_to_s32((int32_t*)dest, (const float*)src, samples); return 0;
+                default: break;
+            }
+            break;
+        }
+        default: break;
+    }
+
+    return -1;
+}
+
 int samplefmt_convert(void* dest, const void* src, samplefmt srcfmt, samplefmt destfmt,size_t samples, size_t src_channels, size_t src_channel, size_t dest_channels, size_t dest_channel) {
 #define GO(fname) fname(dest,src,samples,src_channels,src_channel,dest_channels,dest_channel)
 
+    if(src_channels == 1 && dest_channels == 1 && src_channel == 0 && dest_channel == 0 &&
+       srcfmt != SAMPLEFMT_BINARY && destfmt != SAMPLEFMT_BINARY) {
+        if(samplefmt_convert_contiguous(dest, src, srcfmt, destfmt, samples) == 0) return 0;
+    }
+
     switch(srcfmt) {
 
         case SAMPLEFMT_U8: /* fall-through */
@@ -149,6 +284,7 @@ int samplefmt_convert(void* dest, const void* src, samplefmt srcfmt, samplefmt d
         }
         default: break;
     }
+#undef GO
     return -1;
 }
 
@@ -243,7 +379,7 @@ void samplefmt_ ## srctyp ## _to_ ## desttyp(desttype* dest, const srctype* src,
 
 #define clamp_u8(val) (val < 0.0f ? 0.0f : val > 255.0f ? 255.0f : val)
 #define clamp_s16(val) (val < -32768.0f ? -32768.0f : val > 32767.0f ? 32767.0f : val)
-#define clamp_s32(val) ( val < - 2147483648.0f ?  2147483648.0f : val > 2147483647.0f ? 2147483647.0f : val)
+#define clamp_s32(val) ( val < -2147483648.0 ? -2147483648.0 : val > 2147483647.0 ? 2147483647.0 : val)
 #define clamp_s64(val) ( val < -9223372036854775808.0f ? -9223372036854775808.0f : val > 9223372036854775807.0f ? 9223372036854775807.0f : val)
 
 
@@ -288,3 +424,161 @@ GENFUNC(double, double, int32_t, s32, double, conv_double_s32, clamp_s32)
 GENFUNC(double, double, int64_t, s64, double, conv_double_s64, clamp_s64)
 GENFUNC(double, double, float, float, double, conv_float_double, noclamp)
 GENFUNC(double, double, double, double, double, conv_double_double, noclamp)
+
+/* the fused interleave/deinterleave loops, the common channel
+ * counts get a constant so the compiler can unroll the inner loop */
+
+#define INTERLEAVE_LOOP(srctype,desttype,tmptype,conv,clamp,ch) \
+    for(i=0;i<samples;i++) { \
+        for(c=0;c<ch;c++) { \
+            t = (tmptype)((const srctype*)src[c])[i]; \
+            t = conv(t); \
+            dest[(i*ch) + c] = (desttype)(clamp(t)); \
+        } \
+    }
+
+#define DEINTERLEAVE_LOOP(srctype,desttype,tmptype,conv,clamp,ch) \
+    for(i=0;i<samples;i++) { \
+        for(c=0;c<ch;c++) { \
+            t = (tmptype)src[(i*ch) + c]; \
+            t = conv(t); \
+            ((desttype*)dest[c])[i] = (desttype)(clamp(t)); \
+        } \
+    }
+
+#define GENINTERLEAVE(srctype,srctyp,desttype,desttyp,tmptype,conv,clamp) \
+static void samplefmt_ ## srctyp ## _to_ ## desttyp ## _interleave(desttype* dest, const void* const* src, size_t samples, size_t channels) { \
+    size_t i, c; \
+    tmptype t; \
+    switch(channels) { \
+        case 2: INTERLEAVE_LOOP(srctype,desttype,tmptype,conv,clamp,2); break; \
+        case 6: INTERLEAVE_LOOP(srctype,desttype,tmptype,conv,clamp,6); break; \
+        case 8: INTERLEAVE_LOOP(srctype,desttype,tmptype,conv,clamp,8); break; \
+        default: INTERLEAVE_LOOP(srctype,desttype,tmptype,conv,clamp,channels); break; \
+    } \
+} \
+static void samplefmt_ ## srctyp ## _to_ ## desttyp ## _deinterleave(void* const* dest, const srctype* src, size_t samples, size_t channels) { \
+    size_t i, c; \
+    tmptype t; \
+    switch(channels) { \
+        case 2: DEINTERLEAVE_LOOP(srctype,desttype,tmptype,conv,clamp,2); break; \
+        case 6: DEINTERLEAVE_LOOP(srctype,desttype,tmptype,conv,clamp,6); break; \
+        case 8: DEINTERLEAVE_LOOP(srctype,desttype,tmptype,conv,clamp,8); break; \
+        default: DEINTERLEAVE_LOOP(srctype,desttype,tmptype,conv,clamp,channels); break; \
+    } \
+}
+
+GENINTERLEAVE(int16_t, s16, int16_t, s16, int32_t, conv_s16_s16, noclamp)
+GENINTERLEAVE(int16_t, s16, int32_t, s32, int32_t, conv_s16_s32, noclamp)
+GENINTERLEAVE(int16_t, s16, float, float, double, conv_s16_float, noclamp)
+
+GENINTERLEAVE(int32_t, s32, int16_t, s16, int32_t, conv_s32_s16, noclamp)
+GENINTERLEAVE(int32_t, s32, int32_t, s32, int32_t, conv_s32_s32, noclamp)
+GENINTERLEAVE(int32_t, s32, float, float, double, conv_s32_float, noclamp)
+
+GENINTERLEAVE(float, float, int16_t, s16, double, conv_float_s16, clamp_s16)
+GENINTERLEAVE(float, float, int32_t, s32, double, conv_float_s32, clamp_s32)
+GENINTERLEAVE(float, float, float, float, float, conv_float_float, noclamp)
+
+int samplefmt_interleave(void* dest, const void* const* src, samplefmt srcfmt, samplefmt destfmt, size_t samples, size_t channels) {
+#define GO(fname) fname(dest,src,samples,channels)
+    int r;
+    size_t c;
+
+    if(channels == 1) return samplefmt_convert(dest, src[0], srcfmt, destfmt, samples, 1, 0, 1, 0);
+
+    srcfmt = samplefmt_packed(srcfmt);
+    destfmt = samplefmt_packed(destfmt);
+
+    switch(srcfmt) {
+        case SAMPLEFMT_S16: {
+            switch(destfmt) {
+                case SAMPLEFMT_S16: GO(samplefmt_s16_to_s16_interleave); return 0;
+                case SAMPLEFMT_S32: GO(samplefmt_s16_to_s32_interleave); return 0;
+                case SAMPLEFMT_FLOAT: GO(samplefmt_s16_to_float_interleave); return 0;
+                default: break;
+            }
+            break;
+        }
+        case SAMPLEFMT_S32: {
+            switch(destfmt) {
+                case SAMPLEFMT_S16: {
+                    if(channels == 2) {
+                        kernels.interleave_s32_s16_2((int16_t*)dest, (const int32_t*)src[0], (const int32_t*)src[1], samples);
+                        return 0;
+                    }
+                    GO(samplefmt_s32_to_s16_interleave); return 0;
+                }
+                case SAMPLEFMT_S32: GO(samplefmt_s32_to_s32_interleave); return 0;
+                case SAMPLEFMT_FLOAT: GO(samplefmt_s32_to_float_interleave); return 0;
+                default: break;
+            }
+            break;
+        }
+        case SAMPLEFMT_FLOAT: {
+            switch(destfmt) {
+                case SAMPLEFMT_S16: GO(samplefmt_float_to_s16_interleave); return 0;
+                case SAMPLEFMT_S32: GO(samplefmt_float_to_s32_interleave); return 0;
+                case SAMPLEFMT_FLOAT: GO(samplefmt_float_to_float_interleave); return 0;
+                default: break;
+            }
+            break;
+        }
+        default: break;
+    }
+#undef GO
+
+    /* everything else gets a pass per channel */
+    for(c=0;c<channels;c++) {
+        if( (r = samplefmt_convert(dest, src[c], srcfmt, destfmt, samples, 1, 0, channels, c)) != 0) return r;
+    }
+    return 0;
+}
+
+int samplefmt_deinterleave(void* const* dest, const void* src, samplefmt srcfmt, samplefmt destfmt, size_t samples, size_t channels) {
+#define GO(fname) fname(dest,src,samples,channels)
+    int r;
+    size_t c;
+
+    if(channels == 1) return samplefmt_convert(dest[0], src, srcfmt, destfmt, samples, 1, 0, 1, 0);
+
+    srcfmt = samplefmt_packed(srcfmt);
+    destfmt = samplefmt_packed(destfmt);
+
+    switch(srcfmt) {
+        case SAMPLEFMT_S16: {
+            switch(destfmt) {
+                case SAMPLEFMT_S16: GO(samplefmt_s16_to_s16_deinterleave); return 0;
+                case SAMPLEFMT_S32: GO(samplefmt_s16_to_s32_deinterleave); return 0;
+                case SAMPLEFMT_FLOAT: GO(samplefmt_s16_to_float_deinterleave); return 0;
+                default: break;
+            }
+            break;
+        }
+        case SAMPLEFMT_S32: {
+            switch(destfmt) {
+                case SAMPLEFMT_S16: GO(samplefmt_s32_to_s16_deinterleave); return 0;
+                case SAMPLEFMT_S32: GO(samplefmt_s32_to_s32_deinterleave); return 0;
+                case SAMPLEFMT_FLOAT: GO(samplefmt_s32_to_float_deinterleave); return 0;
+                default: break;
+            }
+            break;
+        }
+        case SAMPLEFMT_FLOAT: {
+            switch(destfmt) {
+                case SAMPLEFMT_S16: GO(samplefmt_float_to_s16_deinterleave); return 0;
+                case SAMPLEFMT_S32: GO(samplefmt_float_to_s32_deinterleave); return 0;
+                case SAMPLEFMT_FLOAT: GO(samplefmt_float_to_float_deinterleave); return 0;
+                default: break;
+            }
+            break;
+        }
+        default: break;
+    }
+#undef GO
+
+    for(c=0;c<channels;c++) {
+        if( (r = samplefmt_convert(dest[c], src, srcfmt, destfmt, samples, channels, c, 1, 0)) != 0) return r;
+    }
+    return 0;
+}
@@ -27,6 +27,21 @@ typedef enum samplefmt samplefmt;
 extern "C" {
 #endif
 
+/* picks the fastest conversion routines this CPU supports,
+ * conversions still work (just slower) if this isn't called */
+int samplefmt_global_init(void);
+
+/* name of the conversion routines in use, like "avx2" */
+const char* samplefmt_simd_str(void);
+
+/* scales s32 samples up by 2^shift in place, for bringing
+ * decoder output with a lower bit depth up to full scale */
+void samplefmt_s32_shl(int32_t* samples, size_t len, unsigned int shift);
+
+/* the reverse, an arithmetic shift down to a lower bit depth.
+ * This rounds towards negative infinity, not towards zero */
+void samplefmt_s32_shr(int32_t* dest, const int32_t* src, size_t len, unsigned int shift);
+
 /* gets the size needed, in bytes, for a single sample */
 size_t samplefmt_size(samplefmt);
 int samplefmt_is_planar(samplefmt);
@@ -35,6 +50,19 @@ const char* samplefmt_str(samplefmt);
 
 int samplefmt_convert(void* dest, const void* src, samplefmt srcfmt, samplefmt destfmt, size_t samples, size_t src_channels, size_t src_channel, size_t dest_channels, size_t dest_channel);
 
+/* callers keep their plane pointers in a stack array of this
+ * size, frames with more channels use samplefmt_convert per channel */
+#define SAMPLEFMT_INTERLEAVE_MAX_CHANNELS 8
+
+/* converts and interleaves the planes src[0] .. src[channels-1]
+ * into dest in a single pass, instead of making one strided pass
+ * over dest per channel */
+int samplefmt_interleave(void* dest, const void* const* src, samplefmt srcfmt, samplefmt destfmt, size_t samples, size_t channels);
+
+/* the reverse, converts and splits an interleaved buffer out
+ * into the planes dest[0] .. dest[channels-1] */
+int samplefmt_deinterleave(void* const* dest, const void* src, samplefmt srcfmt, samplefmt destfmt, size_t samples, size_t channels);
+
 #define GENSIG(srctype,srctyp,desttype,desttyp) \
 void samplefmt_ ## srctyp ## _to_ ## desttyp(desttype* dest, const srctype* src, size_t samples, size_t src_channels, size_t src_channel, size_t dest_channels, size_t dest_channel);
 
@@ -0,0 +1,441 @@
+#include "samplefmt_simd.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SAMPLEFMT_X64
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SAMPLEFMT_ARM64
+#endif
+
+#ifdef SAMPLEFMT_X64
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/* GCC and clang need to be told a function may use AVX2, MSVC
+ * lets you use any intrinsic anywhere */
+#if defined(__GNUC__)
+#define SAMPLEFMT_ENABLE_AVX2
+#define SAMPLEFMT_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && _MSC_VER >= 1800
+#define SAMPLEFMT_ENABLE_AVX2
+#define SAMPLEFMT_TARGET_AVX2
+#endif
+#endif
+
+#ifdef SAMPLEFMT_ARM64
+#include <arm_neon.h>
+#endif
+
+/* scalar versions for the leftover samples at the end of a
+ * buffer, these match the GENFUNC conversions in samplefmt.c */
+
+static inline int16_t s32_to_s16_1(int32_t s) {
+    return (int16_t)(s / (1 << 16));
+}
+
+static inline float s32_to_float_1(int32_t s) {
+    return (float)((double)s / 2147483648.0);
+}
+
+static inline float s16_to_float_1(int16_t s) {
+    return (float)((double)s / 32768.0);
+}
+
+static inline int16_t float_to_s16_1(float s) {
+    double t = (double)s * 32768.0;
+    t = t < -32768.0 ? -32768.0 : t > 32767.0 ? 32767.0 : t;
+    return (int16_t)t;
+}
+
+static inline int32_t float_to_s32_1(float s) {
+    double t = (double)s * 2147483648.0;
+    t = t < -2147483648.0 ? -2147483648.0 : t > 2147483647.0 ? 2147483647.0 : t;
+    return (int32_t)t;
+}
+
+/* samples are within bps bits, this can't overflow */
+static inline int32_t s32_shl_1(int32_t s, unsigned int shift) {
+    return s * (1 << shift);
+}
+
+static inline int32_t s32_shr_1(int32_t s, unsigned int shift) {
+    return s >> shift;
+}
+
+/* INT32_MAX isn't representable as a float, anything scaled up
+ * to 2^31 or past it is out of range. The x86 conversions return
+ * INT32_MIN for those, so they're found with a compare and
+ * flipped to INT32_MAX */
+#define FLOAT_S32_OVERFLOW 2147483648.0f
+
+#ifdef SAMPLEFMT_X64
+
+/* dividing by 65536 truncates towards zero, a shift rounds
+ * down - negative samples get 65535 added first to make up
+ * the difference */
+static inline __m128i sse2_s32_div16(__m128i v) {
+    return _mm_srai_epi32(_mm_add_epi32(v, _mm_srli_epi32(_mm_srai_epi32(v, 31), 16)), 16);
+}
+
+static void s32_to_s16_sse2(int16_t* dest, const int32_t* src, size_t samples) {
+    size_t i = 0;
+    __m128i a, b;
+
+    for(;i + 8 <= samples; i += 8) {
+        a = sse2_s32_div16(_mm_loadu_si128((const __m128i*)&src[i]));
+        b = sse2_s32_div16(_mm_loadu_si128((const __m128i*)&src[i + 4]));
+        _mm_storeu_si128((__m128i*)&dest[i], _mm_packs_epi32(a, b));
+    }
+    for(;i<samples;i++) dest[i] = s32_to_s16_1(src[i]);
+}
+
+static void s32_to_float_sse2(float* dest, const int32_t* src, size_t samples) {
+    size_t i = 0;
+    const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+
+    for(;i + 4 <= samples; i += 4) {
+        _mm_storeu_ps(&dest[i], _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&src[i])), scale));
+    }
+    for(;i<samples;i++) dest[i] = s32_to_float_1(src[i]);
+}
+
+static void s16_to_float_sse2(float* dest, const int16_t* src, size_t samples) {
+    size_t i = 0;
+    __m128i v;
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+
+    for(;i + 8 <= samples; i += 8) {
+        v = _mm_loadu_si128((const __m128i*)&src[i]);
+        /* sign-extend by unpacking into the high halves and shifting down */
+        _mm_storeu_ps(&dest[i], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), scale));
+        _mm_storeu_ps(&dest[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), scale));
+    }
+    for(;i<samples;i++) dest[i] = s16_to_float_1(src[i]);
+}
+
+static void float_to_s16_sse2(int16_t* dest, const float* src, size_t samples) {
+    size_t i = 0;
+    __m128i a, b;
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 lo = _mm_set1_ps(-32768.0f);
+    const __m128 hi = _mm_set1_ps(32767.0f);
+
+    for(;i + 8 <= samples; i += 8) {
+        a = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&src[i]), scale), lo), hi));
+        b = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&src[i + 4]), scale), lo), hi));
+        _mm_storeu_si128((__m128i*)&dest[i], _mm_packs_epi32(a, b));
+    }
+    for(;i<samples;i++) dest[i] = float_to_s16_1(src[i]);
+}
+
+static void float_to_s32_sse2(int32_t* dest, const float* src, size_t samples) {
+    size_t i = 0;
+    const __m128 scale = _mm_set1_ps(2147483648.0f);
+    const __m128 lo = _mm_set1_ps(-2147483648.0f);
+    const __m128 hi = _mm_set1_ps(FLOAT_S32_OVERFLOW);
+    __m128 t;
+
+    for(;i + 4 <= samples; i += 4) {
+        t = _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&src[i]), scale), lo);
+        _mm_storeu_si128((__m128i*)&dest[i], _mm_xor_si128(_mm_cvttps_epi32(t), _mm_castps_si128(_mm_cmpge_ps(t, hi))));
+    }
+    for(;i<samples;i++) dest[i] = float_to_s32_1(src[i]);
+}
+
+static void interleave_s32_s16_2_sse2(int16_t* dest, const int32_t* left, const int32_t* right, size_t samples) {
+    size_t i = 0;
+    __m128i l, r;
+
+    for(;i + 8 <= samples; i += 8) {
+        l = _mm_packs_epi32(sse2_s32_div16(_mm_loadu_si128((const __m128i*)&left[i])), sse2_s32_div16(_mm_loadu_si128((const __m128i*)&left[i + 4])));
+        r = _mm_packs_epi32(sse2_s32_div16(_mm_loadu_si128((const __m128i*)&right[i])), sse2_s32_div16(_mm_loadu_si128((const __m128i*)&right[i + 4])));
+        _mm_storeu_si128((__m128i*)&dest[i * 2], _mm_unpacklo_epi16(l, r));
+        _mm_storeu_si128((__m128i*)&dest[(i * 2) + 8], _mm_unpackhi_epi16(l, r));
+    }
+    for(;i<samples;i++) {
+        dest[i * 2] = s32_to_s16_1(left[i]);
+        dest[(i * 2) + 1] = s32_to_s16_1(right[i]);
+    }
+}
+
+static void s32_shl_sse2(int32_t* samples, size_t len, unsigned int shift) {
+    size_t i = 0;
+    const __m128i count = _mm_cvtsi32_si128((int)shift);
+
+    for(;i + 4 <= len; i += 4) {
+        _mm_storeu_si128((__m128i*)&samples[i], _mm_sll_epi32(_mm_loadu_si128((const __m128i*)&samples[i]), count));
+    }
+    for(;i<len;i++) samples[i] = s32_shl_1(samples[i], shift);
+}
+
+static void s32_shr_sse2(int32_t* dest, const int32_t* src, size_t len, unsigned int shift) {
+    size_t i = 0;
+    const __m128i count = _mm_cvtsi32_si128((int)shift);
+
+    for(;i + 4 <= len; i += 4) {
+        _mm_storeu_si128((__m128i*)&dest[i], _mm_sra_epi32(_mm_loadu_si128((const __m128i*)&src[i]), count));
+    }
+    for(;i<len;i++) dest[i] = s32_shr_1(src[i], shift);
+}
+
+#ifdef SAMPLEFMT_ENABLE_AVX2
+
+SAMPLEFMT_TARGET_AVX2
+static inline __m256i avx2_s32_div16(__m256i v) {
+    return _mm256_srai_epi32(_mm256_add_epi32(v, _mm256_srli_epi32(_mm256_srai_epi32(v, 31), 16)), 16);
+}
+
+SAMPLEFMT_TARGET_AVX2
+static void s32_to_s16_avx2(int16_t* dest, const int32_t* src, size_t samples) {
+    size_t i = 0;
+    __m256i a, b;
+
+    for(;i + 16 <= samples; i += 16) {
+        a = avx2_s32_div16(_mm256_loadu_si256((const __m256i*)&src[i]));
+        b = avx2_s32_div16(_mm256_loadu_si256((const __m256i*)&src[i + 8]));
+        /* packs works per 128-bit lane, put the quarters back in order */
+        _mm256_storeu_si256((__m256i*)&dest[i], _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8));
+    }
+    for(;i<samples;i++) dest[i] = s32_to_s16_1(src[i]);
+}
+
+SAMPLEFMT_TARGET_AVX2
+static void s32_to_float_avx2(float* dest, const int32_t* src, size_t samples) {
+    size_t i = 0;
+    const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+
+    for(;i + 8 <= samples; i += 8) {
+        _mm256_storeu_ps(&dest[i], _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)&src[i])), scale));
+    }
+    for(;i<samples;i++) dest[i] = s32_to_float_1(src[i]);
+}
+
+SAMPLEFMT_TARGET_AVX2
+static void s16_to_float_avx2(float* dest, const int16_t* src, size_t samples) {
+    size_t i = 0;
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+
+    for(;i + 8 <= samples; i += 8) {
+        _mm256_storeu_ps(&dest[i], _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&src[i]))), scale));
+    }
+    for(;i<samples;i++) dest[i] = s16_to_float_1(src[i]);
+}
+
+SAMPLEFMT_TARGET_AVX2
+static void float_to_s16_avx2(int16_t* dest, const float* src, size_t samples) {
+    size_t i = 0;
+    __m256i a, b;
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 lo = _mm256_set1_ps(-32768.0f);
+    const __m256 hi = _mm256_set1_ps(32767.0f);
+
+    for(;i + 16 <= samples; i += 16) {
+        a = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&src[i]), scale), lo), hi));
+        b = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&src[i + 8]), scale), lo), hi));
+        _mm256_storeu_si256((__m256i*)&dest[i], _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8));
+    }
+    for(;i<samples;i++) dest[i] = float_to_s16_1(src[i]);
+}
+
+SAMPLEFMT_TARGET_AVX2
+static void float_to_s32_avx2(int32_t* dest, const float* src, size_t samples) {
+    size_t i = 0;
+    const __m256 scale = _mm256_set1_ps(2147483648.0f);
+    const __m256 lo = _mm256_set1_ps(-2147483648.0f);
+    const __m256 hi = _mm256_set1_ps(FLOAT_S32_OVERFLOW);
+    __m256 t;
+
+    for(;i + 8 <= samples; i += 8) {
+        t = _mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&src[i]), scale), lo);
+        _mm256_storeu_si256((__m256i*)&dest[i], _mm256_xor_si256(_mm256_cvttps_epi32(t), _mm256_castps_si256(_mm256_cmp_ps(t, hi, _CMP_GE_OQ))));
+    }
+    for(;i<samples;i++) dest[i] = float_to_s32_1(src[i]);
+}
+
+static int cpu_has_avx2(void) {
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    int info[4];
+    __cpuid(info, 1);
+    if( (info[2] & (1 << 27)) == 0) return 0; /* no OSXSAVE */
+    if( (_xgetbv(0) & 6) != 6) return 0; /* the OS doesn't save YMM registers */
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#endif
+}
+
+SAMPLEFMT_TARGET_AVX2
+static void s32_shl_avx2(int32_t* samples, size_t len, unsigned int shift) {
+    size_t i = 0;
+    const __m128i count = _mm_cvtsi32_si128((int)shift);
+
+    for(;i + 8 <= len; i += 8) {
+        _mm256_storeu_si256((__m256i*)&samples[i], _mm256_sll_epi32(_mm256_loadu_si256((const __m256i*)&samples[i]), count));
+    }
+    for(;i<len;i++) samples[i] = s32_shl_1(samples[i], shift);
+}
+
+SAMPLEFMT_TARGET_AVX2
+static void s32_shr_avx2(int32_t* dest, const int32_t* src, size_t len, unsigned int shift) {
+    size_t i = 0;
+    const __m128i count = _mm_cvtsi32_si128((int)shift);
+
+    for(;i + 8 <= len; i += 8) {
+        _mm256_storeu_si256((__m256i*)&dest[i], _mm256_sra_epi32(_mm256_loadu_si256((const __m256i*)&src[i]), count));
+    }
+    for(;i<len;i++) dest[i] = s32_shr_1(src[i], shift);
+}
+
+#endif /* SAMPLEFMT_ENABLE_AVX2 */
+
+#endif /* SAMPLEFMT_X64 */
+
+#ifdef SAMPLEFMT_ARM64
+
+static inline int16x4_t neon_s32_div16(int32x4_t v) {
+    uint32x4_t bias = vshrq_n_u32(vreinterpretq_u32_s32(vshrq_n_s32(v, 31)), 16);
+    return vshrn_n_s32(vaddq_s32(v, vreinterpretq_s32_u32(bias)), 16);
+}
+
+static void s32_to_s16_neon(int16_t* dest, const int32_t* src, size_t samples) {
+    size_t i = 0;
+
+    for(;i + 8 <= samples; i += 8) {
+        vst1q_s16(&dest[i], vcombine_s16(neon_s32_div16(vld1q_s32(&src[i])), neon_s32_div16(vld1q_s32(&src[i + 4]))));
+    }
+    for(;i<samples;i++) dest[i] = s32_to_s16_1(src[i]);
+}
+
+static void s32_to_float_neon(float* dest, const int32_t* src, size_t samples) {
+    size_t i = 0;
+    const float32x4_t scale = vdupq_n_f32(1.0f / 2147483648.0f);
+
+    for(;i + 4 <= samples; i += 4) {
+        vst1q_f32(&dest[i], vmulq_f32(vcvtq_f32_s32(vld1q_s32(&src[i])), scale));
+    }
+    for(;i<samples;i++) dest[i] = s32_to_float_1(src[i]);
+}
+
+static void s16_to_float_neon(float* dest, const int16_t* src, size_t samples) {
+    size_t i = 0;
+    int16x8_t v;
+    const float32x4_t scale = vdupq_n_f32(1.0f / 32768.0f);
+
+    for(;i + 8 <= samples; i += 8) {
+        v = vld1q_s16(&src[i]);
+        vst1q_f32(&dest[i], vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+        vst1q_f32(&dest[i + 4], vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+    }
+    for(;i<samples;i++) dest[i] = s16_to_float_1(src[i]);
+}
+
+static void float_to_s16_neon(int16_t* dest, const float* src, size_t samples) {
+    size_t i = 0;
+    int32x4_t a, b;
+    const float32x4_t scale = vdupq_n_f32(32768.0f);
+    const float32x4_t lo = vdupq_n_f32(-32768.0f);
+    const float32x4_t hi = vdupq_n_f32(32767.0f);
+
+    for(;i + 8 <= samples; i += 8) {
+        a = vcvtq_s32_f32(vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(&src[i]), scale), lo), hi));
+        b = vcvtq_s32_f32(vminq_f32(vmaxq_f32(vmulq_f32(vld1q_f32(&src[i + 4]), scale), lo), hi));
+        vst1q_s16(&dest[i], vcombine_s16(vmovn_s32(a), vmovn_s32(b)));
+    }
+    for(;i<samples;i++) dest[i] = float_to_s16_1(src[i]);
+}
+
+static void float_to_s32_neon(int32_t* dest, const float* src, size_t samples) {
+    size_t i = 0;
+    const float32x4_t scale = vdupq_n_f32(2147483648.0f);
+
+    /* NEON conversions saturate, no clamping needed */
+    for(;i + 4 <= samples; i += 4) {
+        vst1q_s32(&dest[i], vcvtq_s32_f32(vmulq_f32(vld1q_f32(&src[i]), scale)));
+    }
+    for(;i<samples;i++) dest[i] = float_to_s32_1(src[i]);
+}
+
+static void interleave_s32_s16_2_neon(int16_t* dest, const int32_t* left, const int32_t* right, size_t samples) {
+    size_t i = 0;
+    int16x8x2_t v;
+
+    for(;i + 8 <= samples; i += 8) {
+        v.val[0] = vcombine_s16(neon_s32_div16(vld1q_s32(&left[i])), neon_s32_div16(vld1q_s32(&left[i + 4])));
+        v.val[1] = vcombine_s16(neon_s32_div16(vld1q_s32(&right[i])), neon_s32_div16(vld1q_s32(&right[i + 4])));
+        vst2q_s16(&dest[i * 2], v);
+    }
+    for(;i<samples;i++) {
+        dest[i * 2] = s32_to_s16_1(left[i]);
+        dest[(i * 2) + 1] = s32_to_s16_1(right[i]);
+    }
+}
+
+static void s32_shl_neon(int32_t* samples, size_t len, unsigned int shift) {
+    size_t i = 0;
+    const int32x4_t count = vdupq_n_s32((int32_t)shift);
+
+    for(;i + 4 <= len; i += 4) {
+        vst1q_s32(&samples[i], vshlq_s32(vld1q_s32(&samples[i]), count));
+    }
+    for(;i<len;i++) samples[i] = s32_shl_1(samples[i], shift);
+}
+
+static void s32_shr_neon(int32_t* dest, const int32_t* src, size_t len, unsigned int shift) {
+    size_t i = 0;
+    /* NEON shifts right by shifting left a negative amount */
+    const int32x4_t count = vdupq_n_s32(-(int32_t)shift);
+
+    for(;i + 4 <= len; i += 4) {
+        vst1q_s32(&dest[i], vshlq_s32(vld1q_s32(&src[i]), count));
+    }
+    for(;i<len;i++) dest[i] = s32_shr_1(src[i], shift);
+}
+
+#endif /* SAMPLEFMT_ARM64 */
+
+void samplefmt_simd_detect(samplefmt_kernels* k) {
+#ifdef SAMPLEFMT_X64
+    /* SSE2 is part of x86-64 */
+    k->s32_to_s16   = s32_to_s16_sse2;
+    k->s32_to_float = s32_to_float_sse2;
+    k->s16_to_float = s16_to_float_sse2;
+    k->float_to_s16 = float_to_s16_sse2;
+    k->float_to_s32 = float_to_s32_sse2;
+    k->interleave_s32_s16_2 = interleave_s32_s16_2_sse2;
+    k->s32_shl = s32_shl_sse2;
+    k->s32_shr = s32_shr_sse2;
+    k->name = "sse2";
+
+#ifdef SAMPLEFMT_ENABLE_AVX2
+    if(cpu_has_avx2()) {
+        k->s32_to_s16   = s32_to_s16_avx2;
+        k->s32_to_float = s32_to_float_avx2;
+        k->s16_to_float = s16_to_float_avx2;
+        k->float_to_s16 = float_to_s16_avx2;
+        k->float_to_s32 = float_to_s32_avx2;
+        k->s32_shl = s32_shl_avx2;
+        k->s32_shr = s32_shr_avx2;
+        k->name = "avx2";
+    }
+#endif
+#endif
+
+#ifdef SAMPLEFMT_ARM64
+    /* NEON is part of AArch64 */
+    k->s32_to_s16   = s32_to_s16_neon;
+    k->s32_to_float = s32_to_float_neon;
+    k->s16_to_float = s16_to_float_neon;
+    k->float_to_s16 = float_to_s16_neon;
+    k->float_to_s32 = float_to_s32_neon;
+    k->interleave_s32_s16_2 = interleave_s32_s16_2_neon;
+    k->s32_shl = s32_shl_neon;
+    k->s32_shr = s32_shr_neon;
+    k->name = "neon";
+#endif
+
+    (void)k;
+}
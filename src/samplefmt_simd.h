@@ -0,0 +1,45 @@
+#ifndef SAMPLEFMT_SIMD_H
+#define SAMPLEFMT_SIMD_H
+
+/* vectorized versions of the conversions that run on every
+ * frame - decoders hand us s16 or s32, encoders want s16 or
+ * float. These only handle contiguous buffers (a single plane,
+ * or a whole interleaved buffer as one long run of samples),
+ * and give the exact same results as the scalar conversions
+ * in samplefmt.c, including truncation and clamping.
+ *
+ * interleave_s32_s16_2 is the one fused kernel, converting a
+ * pair of planar s32 channels into interleaved stereo s16 -
+ * that's FLAC decoder output heading into an AAC encoder.
+ *
+ * samplefmt_simd_detect() checks the CPU once at startup and
+ * replaces whichever kernels it has a faster version of. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct samplefmt_kernels {
+    void (*s32_to_s16)(int16_t* dest, const int32_t* src, size_t samples);
+    void (*s32_to_float)(float* dest, const int32_t* src, size_t samples);
+    void (*s16_to_float)(float* dest, const int16_t* src, size_t samples);
+    void (*float_to_s16)(int16_t* dest, const float* src, size_t samples);
+    void (*float_to_s32)(int32_t* dest, const float* src, size_t samples);
+    void (*interleave_s32_s16_2)(int16_t* dest, const int32_t* left, const int32_t* right, size_t samples);
+    void (*s32_shl)(int32_t* samples, size_t len, unsigned int shift);
+    void (*s32_shr)(int32_t* dest, const int32_t* src, size_t len, unsigned int shift);
+    const char* name;
+};
+
+typedef struct samplefmt_kernels samplefmt_kernels;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void samplefmt_simd_detect(samplefmt_kernels*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -21,6 +21,10 @@ static int source_default_tag_handler(void* ud, const taglist* tags) {
 
 static int source_tag_handler_wrapper(void* ud, const taglist* tags) {
     source *s = (source *)ud;
+    int r;
+
+    /* audio the decoder is still grouping belongs before the new tags */
+    if( (r = decoder_drain(&s->decoder)) != 0) return r;
     return s->tag_handler.cb(s->tag_handler.userdata, tags);
 }
 
@@ -251,6 +255,10 @@ int source_run(source* s) {
         goto tryagain;
     }
 
+    if(r == 1) {
+        if(decoder_drain(&s->decoder) != 0) r = -1;
+    }
+
     done:
     return r != 1;
 }
@@ -10,81 +10,303 @@ void source_sync_free(source_sync* sync) {
     return;
 }
 
-int source_sync_open(source_sync* sync, const frame_source* source) {
+static int source_sync_full(destination_sync* dest) {
+    if(thread_atomic_int_load(&dest->count) == (int)dest->depth) return 1;
+    if(dest->depth_ms != 0 &&
+       thread_atomic_int_load(&dest->queued) >= (int)(dest->depth_ms * 1000)) return 1;
+    return 0;
+}
+
+/* a destination that stopped leaves whatever was queued in its
+ * ring, including the message it failed on. Its thread won't touch
+ * the ring again, so the source releases the frames - otherwise
+ * they'd never go back to the pool */
+static void source_sync_drain(destination_sync* dest) {
+    destination_sync_msg* msg;
+
+    while(thread_atomic_int_load(&dest->count) > 0) {
+        msg = &dest->msgs[dest->head];
+        if(msg->type == DESTINATION_SYNC_FRAME && msg->frame != NULL) {
+            frame_ref_release(msg->frame);
+            msg->frame = NULL;
+        }
+        dest->head = (dest->head + 1) % dest->depth;
+        thread_atomic_int_sub(&dest->queued, msg->duration);
+        thread_atomic_int_dec(&dest->count);
+    }
+}
+
+/* returns the destination's status, draining its ring if it stopped */
+static int source_sync_status(destination_sync* dest) {
     int r;
 
-    if( (r = thread_atomic_int_load(&sync->dest->status)) != 0) return r;
+    if( (r = thread_atomic_int_load(&dest->status)) != 0) source_sync_drain(dest);
+    return r;
+}
+
+/* waits for a free slot in the destination's ring, returns NULL
+ * if the destination thread has stopped */
+static destination_sync_msg* source_sync_acquire(source_sync* sync) {
+    destination_sync* dest = sync->dest;
+
+    for(;;) {
+        if(source_sync_status(dest) != 0) return NULL;
+        if(!source_sync_full(dest)) break;
 
-    thread_atomic_ptr_store(&sync->dest->data, (void*)source);
-    thread_atomic_int_store(&sync->dest->type, (int)DESTINATION_SYNC_OPEN);
-    thread_signal_raise(&sync->dest->ready);
-    thread_signal_wait(&sync->dest->consumed, THREAD_SIGNAL_WAIT_INFINITE);
-    return thread_atomic_int_load(&sync->dest->status);
+        thread_atomic_int_store(&dest->producer_waiting, 1);
+        if(source_sync_full(dest) && thread_atomic_int_load(&dest->status) == 0) {
+            thread_signal_wait(dest->wakeup, THREAD_SIGNAL_WAIT_INFINITE);
+        }
+        thread_atomic_int_store(&dest->producer_waiting, 0);
+    }
+
+    return &dest->msgs[dest->tail];
 }
 
-int source_sync_frame(source_sync* sync, const frame* frame) {
+/* wakes up a destination that's waiting for messages */
+static void source_sync_wake(destination_sync* dest) {
+    if(dest->pool == NULL) {
+        if(thread_atomic_int_load(&dest->consumer_waiting)) {
+            thread_signal_raise(&dest->ready);
+        }
+        return;
+    }
+
+    /* on a worker pool whoever clears the waiting flag schedules it,
+     * so it's only ever queued once */
+    if(thread_atomic_int_compare_and_swap(&dest->consumer_waiting, 1, 0) == 1) {
+        worker_pool_schedule(dest->pool, dest->task);
+    }
+}
+
+static int source_sync_publish(source_sync* sync, destination_sync_msg* msg, destination_sync_type type) {
+    int lag;
+    destination_sync* dest = sync->dest;
+
+    msg->type = type;
+    dest->tail = (dest->tail + 1) % dest->depth;
+    lag = thread_atomic_int_add(&dest->queued, msg->duration) + msg->duration;
+    if(lag > dest->max_lag) dest->max_lag = lag;
+    thread_atomic_int_inc(&dest->count);
+    source_sync_wake(dest);
+    return source_sync_status(dest);
+}
+
+int source_sync_open(source_sync* sync, const frame_source* source) {
     int r;
+    destination_sync_msg* msg;
+
+    if( (msg = source_sync_acquire(sync)) == NULL) return thread_atomic_int_load(&sync->dest->status);
 
-    if( (r = thread_atomic_int_load(&sync->dest->status)) != 0) return r;
+    if( (r = frame_source_copy(&msg->source, source)) != 0) return r;
+    msg->duration = 0;
 
-    thread_atomic_ptr_store(&sync->dest->data, (void*)frame);
-    thread_atomic_int_store(&sync->dest->type, (int)DESTINATION_SYNC_FRAME);
-    thread_signal_raise(&sync->dest->ready);
-    thread_signal_wait(&sync->dest->consumed, THREAD_SIGNAL_WAIT_INFINITE);
-    return thread_atomic_int_load(&sync->dest->status);
+    return source_sync_publish(sync, msg, DESTINATION_SYNC_OPEN);
 }
 
-int source_sync_tags(source_sync* sync, const taglist* tags) {
+static int source_sync_queue_tags(source_sync* sync, const taglist* tags) {
     int r;
+    destination_sync_msg* msg;
+
+    if( (msg = source_sync_acquire(sync)) == NULL) return thread_atomic_int_load(&sync->dest->status);
 
-    if( (r = thread_atomic_int_load(&sync->dest->status)) != 0) return r;
+    if( (r = taglist_deep_copy(&msg->tags, tags)) != 0) return r;
+    msg->duration = 0;
 
-    thread_atomic_ptr_store(&sync->dest->data, (void*)tags);
-    thread_atomic_int_store(&sync->dest->type, (int)DESTINATION_SYNC_TAGS);
-    thread_signal_raise(&sync->dest->ready);
-    thread_signal_wait(&sync->dest->consumed, THREAD_SIGNAL_WAIT_INFINITE);
-    return thread_atomic_int_load(&sync->dest->status);
+    return source_sync_publish(sync, msg, DESTINATION_SYNC_TAGS);
 }
 
-int source_sync_flush(source_sync* sync) {
+static int source_sync_command(source_sync* sync, destination_sync_type type) {
+    destination_sync_msg* msg;
+
+    if( (msg = source_sync_acquire(sync)) == NULL) return thread_atomic_int_load(&sync->dest->status);
+
+    msg->duration = 0;
+    return source_sync_publish(sync, msg, type);
+}
+
+/* applies the destination's lag policy before queueing a frame.
+ * Returns 1 if the frame should be dropped, 0 if it should be queued
+ * as usual and negative on error. A destination that's caught back up
+ * gets a reset (and any tags it missed) ahead of the frame */
+static int source_sync_lagging(destination_sync* dest) {
     int r;
+    size_t count;
+    size_t needed;
+    source_sync sync;
+
+    if(dest->lag_policy == DESTINATION_SYNC_LAG_BLOCK) return 0;
+
+    if(!dest->lagging) {
+        if(!source_sync_full(dest)) return 0;
+        dest->lagging = 1;
+        dest->lag_events++;
+        dest->dropped++;
+        return 1;
+    }
 
-    if( (r = thread_atomic_int_load(&sync->dest->status)) != 0) return r;
+    /* drop rejoins as soon as there's room for the reset, tags
+     * and frame, detach waits until everything old is gone */
+    count = (size_t)thread_atomic_int_load(&dest->count);
+    needed = 2 + dest->has_pending_tags;
+    if(count != 0 &&
+       (dest->lag_policy == DESTINATION_SYNC_LAG_DETACH ||
+        count + needed > dest->depth || source_sync_full(dest))) {
+        dest->dropped++;
+        return 1;
+    }
 
-    thread_atomic_ptr_store(&sync->dest->data, NULL);
-    thread_atomic_int_store(&sync->dest->type, (int)DESTINATION_SYNC_FLUSH);
-    thread_signal_raise(&sync->dest->ready);
-    thread_signal_wait(&sync->dest->consumed, THREAD_SIGNAL_WAIT_INFINITE);
-    return thread_atomic_int_load(&sync->dest->status);
+    dest->lagging = 0;
+    sync.dest = dest;
+    if( (r = source_sync_command(&sync, DESTINATION_SYNC_RESET)) != 0) return r;
+    if(dest->has_pending_tags) {
+        dest->has_pending_tags = 0;
+        if( (r = source_sync_queue_tags(&sync, &dest->pending_tags)) != 0) return r;
+    }
+    return 0;
 }
 
-int source_sync_reset(source_sync* sync) {
+static void source_sync_set_frame(destination_sync_msg* msg, frame_ref* ref) {
+    msg->frame = ref;
+    msg->duration = ref->frame.sample_rate == 0 ? 0 :
+      (int)((uint64_t)ref->frame.duration * 1000000 / (uint64_t)ref->frame.sample_rate);
+}
+
+int source_sync_frame(source_sync* sync, frame_ref* ref) {
     int r;
+    destination_sync_msg* msg;
+
+    if( (r = source_sync_lagging(sync->dest)) != 0) {
+        frame_ref_release(ref);
+        return r < 0 ? r : 0;
+    }
 
-    if( (r = thread_atomic_int_load(&sync->dest->status)) != 0) return r;
+    if( (msg = source_sync_acquire(sync)) == NULL) {
+        frame_ref_release(ref);
+        return thread_atomic_int_load(&sync->dest->status);
+    }
 
-    thread_atomic_ptr_store(&sync->dest->data, NULL);
-    thread_atomic_int_store(&sync->dest->type, (int)DESTINATION_SYNC_RESET);
-    thread_signal_raise(&sync->dest->ready);
-    thread_signal_wait(&sync->dest->consumed, THREAD_SIGNAL_WAIT_INFINITE);
-    return thread_atomic_int_load(&sync->dest->status);
+    source_sync_set_frame(msg, ref);
+    return source_sync_publish(sync, msg, DESTINATION_SYNC_FRAME);
 }
 
-int source_sync_eof(source_sync* sync) {
+int source_sync_broadcast_frame(destination_sync** dests, size_t len, frame_ref* ref, membuf* pending) {
+    int r = 0;
+    int waiting;
+    size_t i;
+    size_t j;
+    size_t npending;
+    size_t left = len;
+    source_sync sync;
+    destination_sync** p;
+
+    if(len == 0) {
+        frame_ref_discard(ref);
+        return 0;
+    }
+
+    frame_ref_retain(ref,(int)len);
+    membuf_reset(pending);
+
+    /* queue the frame everywhere there's room first, so no
+     * destination is held up by another one's full ring */
+    for(i=0;i<len;i++) {
+        if( (r = source_sync_status(dests[i])) != 0) goto fail;
+        if( (r = source_sync_lagging(dests[i])) != 0) {
+            if(r < 0) goto fail;
+            frame_ref_release(ref);
+            left--;
+            continue;
+        }
+        if(source_sync_full(dests[i])) {
+            if( (r = membuf_append(pending,&dests[i],sizeof(destination_sync*))) != 0) goto fail;
+            continue;
+        }
+        sync.dest = dests[i];
+        source_sync_set_frame(&sync.dest->msgs[sync.dest->tail], ref);
+        source_sync_publish(&sync, &sync.dest->msgs[sync.dest->tail], DESTINATION_SYNC_FRAME);
+        left--;
+    }
+
+    npending = pending->len / sizeof(destination_sync*);
+    p = (destination_sync**)pending->x;
+
+    /* then wait on the shared wakeup signal until every
+     * remaining ring has room */
+    while(npending) {
+        waiting = 1;
+        for(j=0;j<npending;j++) {
+            thread_atomic_int_store(&p[j]->producer_waiting, 1);
+        }
+        for(j=0;j<npending;j++) {
+            if(!source_sync_full(p[j]) || thread_atomic_int_load(&p[j]->status) != 0) waiting = 0;
+        }
+        if(waiting) {
+            thread_signal_wait(p[0]->wakeup, THREAD_SIGNAL_WAIT_INFINITE);
+        }
+        for(j=0;j<npending;j++) {
+            thread_atomic_int_store(&p[j]->producer_waiting, 0);
+        }
+
+        i = 0;
+        for(j=0;j<npending;j++) {
+            if( (r = source_sync_status(p[j])) != 0) goto fail;
+            if(source_sync_full(p[j])) {
+                p[i++] = p[j];
+                continue;
+            }
+            sync.dest = p[j];
+            source_sync_set_frame(&sync.dest->msgs[sync.dest->tail], ref);
+            source_sync_publish(&sync, &sync.dest->msgs[sync.dest->tail], DESTINATION_SYNC_FRAME);
+            left--;
+        }
+        npending = i;
+    }
+
+    return 0;
+
+    fail:
+    /* drop the references we didn't hand out */
+    while(left--) frame_ref_release(ref);
+    return r;
+}
+
+int source_sync_tags(source_sync* sync, const taglist* tags) {
     int r;
+    destination_sync* dest = sync->dest;
+
+    /* a destination that's behind only needs the latest tags,
+     * they're queued once it catches up */
+    if(dest->lag_policy != DESTINATION_SYNC_LAG_BLOCK &&
+       (dest->lagging || source_sync_full(dest))) {
+        if(!dest->lagging) {
+            dest->lagging = 1;
+            dest->lag_events++;
+        }
+        if( (r = taglist_deep_copy(&dest->pending_tags, tags)) != 0) return r;
+        dest->has_pending_tags = 1;
+        return 0;
+    }
 
-    if( (r = thread_atomic_int_load(&sync->dest->status)) != 0) return r;
-    thread_atomic_ptr_store(&sync->dest->data, NULL);
-    thread_atomic_int_store(&sync->dest->type, (int)DESTINATION_SYNC_EOF);
-    thread_signal_raise(&sync->dest->ready);
-    thread_signal_wait(&sync->dest->consumed, THREAD_SIGNAL_WAIT_INFINITE);
-    return thread_atomic_int_load(&sync->dest->status);
+    return source_sync_queue_tags(sync, tags);
+}
+
+int source_sync_flush(source_sync* sync) {
+    return source_sync_command(sync, DESTINATION_SYNC_FLUSH);
+}
+
+int source_sync_reset(source_sync* sync) {
+    return source_sync_command(sync, DESTINATION_SYNC_RESET);
+}
+
+int source_sync_eof(source_sync* sync) {
+    return source_sync_command(sync, DESTINATION_SYNC_EOF);
 }
 
 /* in case of some kind of "you gotta quit right now emergency" */
 void source_sync_quit(source_sync* sync) {
-    /* on EOF we don't wait for the destination threads to acknowledge */
-    thread_atomic_ptr_store(&sync->dest->data, NULL);
-    thread_atomic_int_store(&sync->dest->type, (int)DESTINATION_SYNC_QUIT);
-    thread_signal_raise(&sync->dest->ready);
+    /* we don't wait for the destination threads to acknowledge,
+     * they stop at the next message without handling the rest */
+    thread_atomic_int_store(&sync->dest->quit, 1);
+    source_sync_wake(sync->dest);
 }
@@ -19,7 +19,14 @@ void source_sync_free(source_sync*);
 /* all these void*s are cast into source_sync */
 int source_sync_open(source_sync*, const frame_source* source);
 int source_sync_tags(source_sync*, const taglist* tags);
-int source_sync_frame(source_sync*, const frame* frame);
+/* hands one reference of the frame over to the destination,
+ * the reference is released on failure */
+int source_sync_frame(source_sync*, frame_ref* ref);
+
+/* hands a reference of the frame to every destination at once, only
+ * waiting when a destination's ring is full. pending is scratch space
+ * for tracking which destinations still need the frame */
+int source_sync_broadcast_frame(destination_sync** dests, size_t len, frame_ref* ref, membuf* pending);
 int source_sync_flush(source_sync*);
 int source_sync_reset(source_sync*);
 int source_sync_eof(source_sync*);
@@ -1,5 +1,6 @@
 #include "sourcelist.h"
 #include "source_sync.h"
+#include "memacct.h"
 
 #include "destination.h"
 
@@ -38,11 +39,16 @@ void sourcelist_entry_init(sourcelist_entry* entry) {
     strbuf_init(&entry->id);
     /* source_init(&entry->source); */
     membuf_init(&entry->destination_syncs);
+    frame_ref_pool_init(&entry->frames);
+    thread_signal_init(&entry->wakeup);
+    membuf_init(&entry->pending);
     thread_atomic_int_store(&entry->status, 0);
     entry->quit = NULL;
     entry->quit_userdata = NULL;
     entry->samplecount = 0;
     entry->loglevel = -1;
+    affinity_init(&entry->affinity);
+    entry->memacct = 0;
 }
 
 void sourcelist_entry_dump_counters(const sourcelist_entry* entry) {
@@ -51,6 +57,7 @@ void sourcelist_entry_dump_counters(const sourcelist_entry* entry) {
     if(strbuf_cat(&tmp,&entry->id)) abort();
     if(strbuf_append_cstr(&tmp,"]")) abort();
     source_dump_counters(&entry->source, &tmp);
+    memacct_dump_counters(entry->memacct, &tmp);
     strbuf_free(&tmp);
 }
 
@@ -58,6 +65,9 @@ void sourcelist_entry_free(sourcelist_entry* entry) {
     strbuf_free(&entry->id);
     source_free(&entry->source);
     membuf_free(&entry->destination_syncs);
+    frame_ref_pool_free(&entry->frames);
+    thread_signal_term(&entry->wakeup);
+    membuf_free(&entry->pending);
 }
 
 void sourcelist_free(sourcelist* slist) {
@@ -70,6 +80,7 @@ void sourcelist_free(sourcelist* slist) {
     for(i=0;i<len;i++) {
         logger_set_prefix("source.",7);
         logger_append_prefix((const char *)entry[i].id.x, entry[i].id.len);
+        memacct_set_owner(entry[i].memacct);
         logger_set_level((enum LOG_LEVEL) (entry[i].loglevel == -1 ? 
           logger_get_default_level() : (enum LOG_LEVEL)entry[i].loglevel));
         sourcelist_entry_free(&entry[i]);
@@ -106,6 +117,7 @@ int sourcelist_configure(const strbuf* id, const strbuf* key, const strbuf* valu
 
     if(entry == NULL)  {
         sourcelist_entry_init(&empty);
+        empty.memacct = memacct_owner();
         if( (r = strbuf_copy(&empty.id,id)) != 0 ) return r;
         if( (r = membuf_append(list,&empty,sizeof(sourcelist_entry))) != 0) return r;
         entry = sourcelist_find(list,id);
@@ -116,6 +128,7 @@ int sourcelist_configure(const strbuf* id, const strbuf* key, const strbuf* valu
 
     logger_set_prefix("source.",7);
     logger_append_prefix((const char *)entry->id.x, entry->id.len);
+    memacct_set_owner(entry->memacct);
 
     if(strbuf_equals_cstr(key,"loglevel") ||
        strbuf_equals_cstr(key,"log-level") ||
@@ -150,6 +163,26 @@ int sourcelist_configure(const strbuf* id, const strbuf* key, const strbuf* valu
         return 1;
     }
 
+    if(strbuf_equals_cstr(key,"cpu") ||
+       strbuf_equals_cstr(key,"cpus")) {
+        if(affinity_parse_cpus(&entry->affinity,value) != 0) {
+            fprintf(stderr,"unknown value %.*s for option %.*s\n",(int)value->len,value->x,
+              (int)key->len,key->x);
+            return 1;
+        }
+        return 0;
+    }
+
+    if(strbuf_equals_cstr(key,"numa-node") ||
+       strbuf_equals_cstr(key,"numa node")) {
+        if(affinity_parse_node(&entry->affinity,value) != 0) {
+            fprintf(stderr,"unknown value %.*s for option %.*s\n",(int)value->len,value->x,
+              (int)key->len,key->x);
+            return 1;
+        }
+        return 0;
+    }
+
     logger_set_level((enum LOG_LEVEL) (entry->loglevel == -1 ? 
       logger_get_default_level() : (enum LOG_LEVEL)entry->loglevel));
 
@@ -159,7 +192,10 @@ int sourcelist_configure(const strbuf* id, const strbuf* key, const strbuf* valu
 int sourcelist_open(const sourcelist* list, uint8_t shortflag) {
     int r;
     size_t i;
+    size_t j;
     size_t len;
+    size_t dest_len;
+    destination_sync** dest_sync;
 
     sourcelist_entry* entry = (sourcelist_entry *)list->x;
     len = list->len / sizeof(sourcelist_entry);
@@ -167,6 +203,7 @@ int sourcelist_open(const sourcelist* list, uint8_t shortflag) {
     for(i=0;i<len;i++) {
         logger_set_prefix("source.",7);
         logger_append_prefix((const char *)entry[i].id.x, entry[i].id.len);
+        memacct_set_owner(entry[i].memacct);
         logger_set_level((enum LOG_LEVEL) (entry[i].loglevel == -1 ? 
           logger_get_default_level() : (enum LOG_LEVEL)entry[i].loglevel));
 
@@ -176,6 +213,13 @@ int sourcelist_open(const sourcelist* list, uint8_t shortflag) {
             return r;
         }
 
+        /* all of our destinations wake us through the same signal */
+        dest_len = entry[i].destination_syncs.len / sizeof(destination_sync*);
+        dest_sync = (destination_sync**)entry[i].destination_syncs.x;
+        for(j=0;j<dest_len;j++) {
+            dest_sync[j]->wakeup = &entry[i].wakeup;
+        }
+
         if(shortflag) {
             entry[i].quit = (sourcelist_quit_func)sourcelist_quit;
             entry[i].quit_userdata = (void *)list;
@@ -209,9 +253,8 @@ static int sourcelist_entry_tag_handler(void* userdata, const taglist* tags) {
 
     for(i=0;i<len;i++) {
         sync.dest = dest_sync[i];
-        if( (r = source_sync_tags(&sync,tags)) != 0) {
-            return r;
-        }
+        MEMACCT_CALL(MEMACCT_QUEUE, r, source_sync_tags(&sync,tags));
+        if(r != 0) return r;
     }
     return 0;
 }
@@ -243,14 +286,12 @@ static int sourcelist_entry_open_handler(void* userdata, const frame_source* sou
 
 static int sourcelist_entry_frame_handler(void* userdata, const frame* frame) {
     int r;
-    size_t i;
     size_t len;
-    source_sync sync;
     ich_time now;
     ich_time exp;
     ich_time diff;
     ich_frac frac;
-
+    frame_ref* ref;
 
     sourcelist_entry* entry = (sourcelist_entry *)userdata;
     destination_sync** dest_sync;
@@ -285,13 +326,21 @@ static int sourcelist_entry_frame_handler(void* userdata, const frame* frame) {
         return r;
     }
 
-    for(i=0;i<len;i++) {
-        sync.dest = dest_sync[i];
-        if( (r = source_sync_frame(&sync,frame)) != 0) {
-            return r;
-        }
+    /* copy the frame once, every destination borrows the same copy */
+    MEMACCT_CALL(MEMACCT_QUEUE, ref, frame_ref_pool_get(&entry->frames));
+    if(ref == NULL) {
+        logs_error("out of memory");
+        return -1;
     }
-    return 0;
+    MEMACCT_CALL(MEMACCT_QUEUE, r, frame_copy(&ref->frame,frame));
+    if(r != 0) {
+        frame_ref_discard(ref);
+        logs_error("out of memory");
+        return r;
+    }
+
+    MEMACCT_CALL(MEMACCT_QUEUE, r, source_sync_broadcast_frame(dest_sync,len,ref,&entry->pending));
+    return r;
 }
 
 static int sourcelist_entry_flush_handler(void* userdata) {
@@ -376,9 +425,14 @@ static int sourcelist_entry_run(void *userdata) {
 
     logger_set_prefix("source.",7);
     logger_append_prefix((const char *)entry->id.x,entry->id.len);
+    memacct_set_owner(entry->memacct);
     logger_set_level((enum LOG_LEVEL) (entry->loglevel == -1 ? 
       logger_get_default_level() : (enum LOG_LEVEL)entry->loglevel));
 
+    /* pin before anything allocates frames, so they're
+     * placed on our node */
+    affinity_apply(&entry->affinity);
+
     /* this is where/how we forward tags, previously the source just cached them */
     tag_handler thdlr;
 
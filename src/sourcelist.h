@@ -3,8 +3,10 @@
 
 #include "membuf.h"
 #include "source.h"
+#include "frame_ref.h"
 #include "thread.h"
 #include "ich_time.h"
+#include "affinity.h"
 
 typedef void (*sourcelist_quit_func)(void*,int);
 
@@ -15,10 +17,15 @@ struct sourcelist_entry {
     thread_atomic_int_t status;
     source source;
     membuf destination_syncs; /* stores pointers to destination_sync objects */
+    frame_ref_pool frames; /* frames shared with all destinations */
+    thread_signal_t wakeup; /* raised by destinations when their queue has room */
+    membuf pending; /* destinations still waiting on the current frame */
     sourcelist_quit_func quit; /* used to end all threads when one dies */
     void* quit_userdata;
     size_t samplecount; /* counts number of samples seen */
     ich_time ts; /* timestamp to track datarate */
+    affinity affinity; /* CPUs to run the source thread on */
+    unsigned int memacct; /* memory accounting owner id */
 };
 
 typedef struct sourcelist_entry sourcelist_entry;
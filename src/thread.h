@@ -1150,11 +1150,11 @@ int thread_atomic_int_compare_and_swap( thread_atomic_int_t* atomic, int expecte
     
     #elif defined( __linux__ ) || defined( __APPLE__ ) || defined( __ANDROID__ )
 
-        /* not quite right, InterLockedCompareExchange always returns the existing value.
-         * I'm assuming here, if the exchange occured you'd want the expected value returned,
-         * if the exchange didn't - you probably don't care what the return value is, so long
-         * as it's not your expected value */
-        return __atomic_compare_exchange_n(&atomic->i, &expected, &desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) ? expected : !expected;
+        /* on failure, __atomic_compare_exchange_n writes the current value into
+         * expected, so either way expected holds the previous value - same as
+         * InterlockedCompareExchange */
+        __atomic_compare_exchange_n(&atomic->i, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+        return expected;
     
     #else 
         #error Unknown platform.
@@ -1281,11 +1281,11 @@ unsigned int thread_atomic_uint_compare_and_swap( thread_atomic_uint_t* atomic,
     
     #elif defined( __linux__ ) || defined( __APPLE__ ) || defined( __ANDROID__ )
 
-        /* not quite right, InterLockedCompareExchange always returns the existing value.
-         * I'm assuming here, if the exchange occured you'd want the expected value returned,
-         * if the exchange didn't - you probably don't care what the return value is, so long
-         * as it's not your expected value */
-        return __atomic_compare_exchange_n(&atomic->i, &expected, &desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) ? expected : !expected;
+        /* on failure, __atomic_compare_exchange_n writes the current value into
+         * expected, so either way expected holds the previous value - same as
+         * InterlockedCompareExchange */
+        __atomic_compare_exchange_n(&atomic->i, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+        return expected;
     
     #else 
         #error Unknown platform.
@@ -1360,11 +1360,11 @@ void* thread_atomic_ptr_compare_and_swap( thread_atomic_ptr_t* atomic, void* exp
     
     #elif defined( __linux__ ) || defined( __APPLE__ ) || defined( __ANDROID__ )
 
-        /* not quite right, InterLockedCompareExchange always returns the existing value.
-         * I'm assuming here, if the exchange occured you'd want the expected value returned,
-         * if the exchange didn't - you probably don't care what the return value is, so long
-         * as it's not your expected value */
-        return __atomic_compare_exchange_n(&atomic->ptr, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) ? expected : (void*)((uintptr_t)!expected);
+        /* on failure, __atomic_compare_exchange_n writes the current value into
+         * expected, so either way expected holds the previous value - same as
+         * InterlockedCompareExchange */
+        __atomic_compare_exchange_n(&atomic->ptr, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+        return expected;
 
     #else 
         #error Unknown platform.
@@ -1455,9 +1455,10 @@ thread_tls_t thread_tls_create( void )
     
     #elif defined( __linux__ ) || defined( __APPLE__ ) || defined( __ANDROID__ )
 
+        /* key 0 is valid, store key + 1 so it isn't mistaken for NULL */
         pthread_key_t tls;
         if( pthread_key_create( &tls, NULL ) == 0 )
-            return (thread_tls_t) tls;
+            return (thread_tls_t) ( (uintptr_t) tls + 1 );
         else
             return NULL;
 
@@ -1475,7 +1476,7 @@ void thread_tls_destroy( thread_tls_t tls )
     
     #elif defined( __linux__ ) || defined( __APPLE__ ) || defined( __ANDROID__ )
 
-        pthread_key_delete( (pthread_key_t) (uintptr_t) tls );
+        pthread_key_delete( (pthread_key_t) ( (uintptr_t) tls - 1 ) );
     
     #else 
         #error Unknown platform.
@@ -1491,7 +1492,7 @@ void thread_tls_set( thread_tls_t tls, void* value )
     
     #elif defined( __linux__ ) || defined( __APPLE__ ) || defined( __ANDROID__ )
 
-        pthread_setspecific( (pthread_key_t) (uintptr_t) tls, value );
+        pthread_setspecific( (pthread_key_t) ( (uintptr_t) tls - 1 ), value );
     
     #else 
         #error Unknown platform.
@@ -1507,7 +1508,7 @@ void* thread_tls_get( thread_tls_t tls )
     
     #elif defined( __linux__ ) || defined( __APPLE__ ) || defined( __ANDROID__ )
 
-        return pthread_getspecific( (pthread_key_t) (uintptr_t) tls );
+        return pthread_getspecific( (pthread_key_t) ( (uintptr_t) tls - 1 ) );
     
     #else 
         #error Unknown platform.
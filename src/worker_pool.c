@@ -0,0 +1,188 @@
+#include "worker_pool.h"
+#include "logger.h"
+
+#include <stdlib.h>
+
+void worker_pool_init(worker_pool* pool) {
+    pool->workers = NULL;
+    pool->len = 0;
+    pool->tasks = 0;
+    thread_atomic_int_store(&pool->live, 0);
+}
+
+void worker_pool_free(worker_pool* pool) {
+    size_t i;
+
+    if(pool->workers != NULL) {
+        for(i=0;i<pool->len;i++) {
+            if(pool->workers[i].queue != NULL) free(pool->workers[i].queue);
+            thread_mutex_term(&pool->workers[i].lock);
+            thread_signal_term(&pool->workers[i].wake);
+        }
+        free(pool->workers);
+        pool->workers = NULL;
+    }
+    pool->len = 0;
+}
+
+int worker_pool_create(worker_pool* pool, size_t workers) {
+    size_t i;
+
+    pool->workers = (worker*)malloc(sizeof(worker) * workers);
+    if(pool->workers == NULL) return -1;
+    pool->len = workers;
+
+    for(i=0;i<workers;i++) {
+        pool->workers[i].pool = pool;
+        thread_mutex_init(&pool->workers[i].lock);
+        pool->workers[i].queue = NULL;
+        pool->workers[i].head = 0;
+        pool->workers[i].len = 0;
+        thread_signal_init(&pool->workers[i].wake);
+        thread_atomic_int_store(&pool->workers[i].sleeping, 0);
+        pool->workers[i].thread = NULL;
+        pool->workers[i].index = i;
+    }
+
+    return 0;
+}
+
+void worker_pool_add(worker_pool* pool, worker_task* task) {
+    task->home = pool->tasks++ % pool->len;
+    thread_atomic_int_inc(&pool->live);
+}
+
+static void worker_push(worker* w, worker_task* task) {
+    thread_mutex_lock(&w->lock);
+    w->queue[(w->head + w->len) % w->pool->tasks] = task;
+    w->len++;
+    thread_mutex_unlock(&w->lock);
+}
+
+/* the owner takes from the front of its queue */
+static worker_task* worker_pop(worker* w) {
+    worker_task* task = NULL;
+
+    thread_mutex_lock(&w->lock);
+    if(w->len != 0) {
+        task = w->queue[w->head];
+        w->head = (w->head + 1) % w->pool->tasks;
+        w->len--;
+    }
+    thread_mutex_unlock(&w->lock);
+    return task;
+}
+
+/* thieves take from the back */
+static worker_task* worker_steal(worker* w) {
+    worker_task* task = NULL;
+
+    thread_mutex_lock(&w->lock);
+    if(w->len != 0) {
+        w->len--;
+        task = w->queue[(w->head + w->len) % w->pool->tasks];
+    }
+    thread_mutex_unlock(&w->lock);
+    return task;
+}
+
+static worker_task* worker_next(worker* w) {
+    size_t i;
+    worker_task* task;
+    worker_pool* pool = w->pool;
+
+    if( (task = worker_pop(w)) != NULL) return task;
+
+    for(i=1;i<pool->len;i++) {
+        if( (task = worker_steal(&pool->workers[(w->index + i) % pool->len])) != NULL) return task;
+    }
+
+    return NULL;
+}
+
+void worker_pool_schedule(worker_pool* pool, worker_task* task) {
+    size_t i;
+    worker* home = &pool->workers[task->home];
+
+    worker_push(home, task);
+
+    if(thread_atomic_int_load(&home->sleeping)) {
+        thread_signal_raise(&home->wake);
+        return;
+    }
+
+    /* the home worker is busy, let somebody else steal it */
+    for(i=0;i<pool->len;i++) {
+        if(thread_atomic_int_load(&pool->workers[i].sleeping)) {
+            thread_signal_raise(&pool->workers[i].wake);
+            return;
+        }
+    }
+}
+
+static int worker_run(void* userdata) {
+    size_t i;
+    worker* w = (worker*)userdata;
+    worker_pool* pool = w->pool;
+    worker_task* task;
+
+    while(thread_atomic_int_load(&pool->live) != 0) {
+        if( (task = worker_next(w)) == NULL) {
+            /* announce we're sleeping before the last look, so anybody
+             * queueing a task after this point will wake us */
+            thread_atomic_int_store(&w->sleeping, 1);
+            if( (task = worker_next(w)) == NULL) {
+                if(thread_atomic_int_load(&pool->live) != 0) {
+                    thread_signal_wait(&w->wake, THREAD_SIGNAL_WAIT_INFINITE);
+                }
+                thread_atomic_int_store(&w->sleeping, 0);
+                continue;
+            }
+            thread_atomic_int_store(&w->sleeping, 0);
+        }
+
+        switch(task->step(task->userdata)) {
+            case WORKER_TASK_IDLE: break;
+            case WORKER_TASK_BUSY: {
+                worker_pool_schedule(pool, task);
+                break;
+            }
+            case WORKER_TASK_DONE: {
+                if(thread_atomic_int_dec(&pool->live) == 1) {
+                    /* that was the last one, everybody can go home */
+                    for(i=0;i<pool->len;i++) {
+                        thread_signal_raise(&pool->workers[i].wake);
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    logger_thread_cleanup();
+    thread_exit(0);
+    return 0;
+}
+
+int worker_pool_start(worker_pool* pool) {
+    size_t i;
+
+    for(i=0;i<pool->len;i++) {
+        pool->workers[i].queue = (worker_task**)malloc(sizeof(worker_task*) * (pool->tasks ? pool->tasks : 1));
+        if(pool->workers[i].queue == NULL) return -1;
+    }
+
+    for(i=0;i<pool->len;i++) {
+        pool->workers[i].thread = thread_create(worker_run, &pool->workers[i], THREAD_STACK_SIZE_DEFAULT);
+    }
+
+    return 0;
+}
+
+void worker_pool_wait(worker_pool* pool) {
+    size_t i;
+
+    for(i=0;i<pool->len;i++) {
+        if(pool->workers[i].thread != NULL) thread_join(pool->workers[i].thread);
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+/* a fixed set of worker threads that run tasks, used instead
+ * of one thread per destination.
+ *
+ * A task is anything with a step function. Each call to step
+ * should do a bounded amount of work and return:
+ *     WORKER_TASK_IDLE - nothing left to do, the task will be
+ *                        scheduled again by whoever gives it work
+ *     WORKER_TASK_BUSY - there's more to do, run it again later
+ *     WORKER_TASK_DONE - the task is finished for good
+ *
+ * Every task has a home worker, and is always queued on that
+ * worker so its data stays in one core's cache. A worker with
+ * nothing to do will steal tasks from the other workers' queues.
+ *
+ * A task must only be scheduled when it isn't queued or running,
+ * it's up to the caller to track that (see destination_sync_park).
+ *
+ * The queues are filled by threads outside the pool (sources), so
+ * each one is a small ring behind a mutex rather than a lock-free
+ * owner-only deque. */
+
+#include "thread.h"
+#include <stddef.h>
+
+enum worker_task_state {
+    WORKER_TASK_IDLE = 0,
+    WORKER_TASK_BUSY = 1,
+    WORKER_TASK_DONE = 2,
+};
+
+typedef enum worker_task_state worker_task_state;
+
+typedef worker_task_state (*worker_task_step_cb)(void* userdata);
+
+struct worker_task {
+    worker_task_step_cb step;
+    void* userdata;
+    size_t home; /* index of this task's worker, assigned by worker_pool_add */
+};
+
+typedef struct worker_task worker_task;
+
+struct worker_pool;
+
+struct worker {
+    struct worker_pool* pool;
+    thread_mutex_t lock; /* protects the queue */
+    worker_task** queue; /* ring of tasks waiting to run */
+    size_t head;
+    size_t len;
+    thread_signal_t wake;
+    thread_atomic_int_t sleeping;
+    thread_ptr_t thread;
+    size_t index;
+};
+
+typedef struct worker worker;
+
+struct worker_pool {
+    worker* workers;
+    size_t len; /* number of workers */
+    size_t tasks; /* number of tasks added, also the queue size */
+    thread_atomic_int_t live; /* tasks that haven't returned WORKER_TASK_DONE */
+};
+
+typedef struct worker_pool worker_pool;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void worker_pool_init(worker_pool*);
+void worker_pool_free(worker_pool*);
+
+/* allocates the workers, doesn't start them */
+int worker_pool_create(worker_pool*, size_t workers);
+
+/* registers a task and assigns its home worker, all tasks
+ * need to be added before starting the pool */
+void worker_pool_add(worker_pool*, worker_task*);
+
+/* starts the worker threads, tasks don't run until they're scheduled */
+int worker_pool_start(worker_pool*);
+
+/* queues a task to run, may be called from any thread */
+void worker_pool_schedule(worker_pool*, worker_task*);
+
+/* waits for every task to finish and the workers to exit */
+void worker_pool_wait(worker_pool*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif